@@ -14,7 +14,7 @@
 #include <protocols/interaction_model/StatusCode.h>
 #include "dishwasher_manager.h"
 #include <esp_debug_helpers.h>
-#include "iot_button.h"
+#include "push_buttons.h"
 
 using namespace chip;
 using namespace chip::app;
@@ -29,7 +29,7 @@ static const char *TAG = "app_driver";
 DataModel::Nullable<uint32_t> OperationalStateDelegate::GetCountdownTime()
 {
     ESP_LOGI(TAG, "GetCountdownTime");
-    uint32_t timeRemaining = DishwasherMgr().GetTimeRemaining();
+    uint32_t timeRemaining = DishwasherMgr().GetPublishedTimeRemaining();
     return DataModel::MakeNullable(timeRemaining);
 }
 
@@ -51,24 +51,34 @@ CHIP_ERROR OperationalStateDelegate::GetOperationalPhaseAtIndex(size_t index, Mu
 {
     ESP_LOGI(TAG, "GetOperationalPhaseAtIndex");
 
-    if (index >= mOperationalPhaseList.size())
+    // The phase list comes straight from the program table.
+    //
+    if (index >= kPhaseCount)
     {
         return CHIP_ERROR_NOT_FOUND;
     }
-    return CopyCharSpanToMutableCharSpan(mOperationalPhaseList[index], operationalPhase);
+    return CopyCharSpanToMutableCharSpan(CharSpan::fromCharString(kOperationalPhaseNames[index]), operationalPhase);
 }
 
 void OperationalStateDelegate::HandlePauseStateCallback(GenericOperationalError &err)
 {
     ESP_LOGI(TAG, "HandlePauseStateCallback");
-    DishwasherMgr().PauseProgram();
+    // The manager handles the pause on its own task, so check against the state it last published.
+    //
+    if (!DishwasherMgr().IsPublishedPhasePausable())
+    {
+        err.Set(to_underlying(ErrorStateEnum::kCommandInvalidInState));
+        return;
+    }
+
+    DishwasherMgr().PostCommand(DishwasherCommand::kPause);
     err.Set(to_underlying(ErrorStateEnum::kNoError));
 }
 
 void OperationalStateDelegate::HandleResumeStateCallback(GenericOperationalError &err)
 {
     ESP_LOGI(TAG, "HandleResumeStateCallback");
-    DishwasherMgr().ResumeProgram();
+    DishwasherMgr().PostCommand(DishwasherCommand::kResume);
     err.Set(to_underlying(ErrorStateEnum::kNoError));
     // err.Set(to_underlying(ErrorStateEnum::kUnableToCompleteOperation));
 }
@@ -77,7 +87,7 @@ void OperationalStateDelegate::HandleStartStateCallback(GenericOperationalError
 {
     ESP_LOGI(TAG, "HandleStartStateCallback");
 
-    DishwasherMgr().StartProgram();
+    DishwasherMgr().PostCommand(DishwasherCommand::kStart);
     err.Set(to_underlying(ErrorStateEnum::kNoError));
 }
 
@@ -85,7 +95,7 @@ void OperationalStateDelegate::HandleStopStateCallback(GenericOperationalError &
 {
     ESP_LOGI(TAG, "HandleStopStateCallback");
 
-    DishwasherMgr().StopProgram();
+    DishwasherMgr().PostCommand(DishwasherCommand::kStop);
     err.Set(to_underlying(ErrorStateEnum::kNoError));
 }
 
@@ -132,14 +142,18 @@ void emberAfOperationalStateClusterInitCallback(chip::EndpointId endpointId)
     EndpointId operationalStateEndpoint = 0x01;
     gOperationalStateInstance = new OperationalState::Instance(gOperationalStateDelegate, operationalStateEndpoint);
 
-    gOperationalStateInstance->SetOperationalState(to_underlying(OperationalState::OperationalStateEnum::kStopped));
-    gOperationalStateInstance->SetCurrentPhase(0);
+    // Start from whatever program was restored after a power cut (stopped otherwise).
+    //
+    uint8_t value = to_underlying(DishwasherMgr().GetPublishedOperationalState());
+    uint8_t phase = DishwasherMgr().GetPublishedPhase();
+
+    gOperationalStateInstance->SetOperationalState(value);
+    gOperationalStateInstance->SetCurrentPhase(phase);
 
     gOperationalStateInstance->Init();
 
-    uint8_t value = to_underlying(OperationalStateEnum::kStopped);
     gOperationalStateDelegate->PostAttributeChangeCallback(chip::app::Clusters::OperationalState::Attributes::OperationalState::Id, ZCL_INT8U_ATTRIBUTE_TYPE, sizeof(uint8_t), &value);
-    gOperationalStateDelegate->PostAttributeChangeCallback(chip::app::Clusters::OperationalState::Attributes::CurrentPhase::Id, ZCL_INT8U_ATTRIBUTE_TYPE, sizeof(uint8_t), 0);
+    gOperationalStateDelegate->PostAttributeChangeCallback(chip::app::Clusters::OperationalState::Attributes::CurrentPhase::Id, ZCL_INT8U_ATTRIBUTE_TYPE, sizeof(uint8_t), &phase);
 }
 
 //****************************
@@ -166,31 +180,31 @@ CHIP_ERROR DishwasherModeDelegate::Init()
 void DishwasherModeDelegate::HandleChangeToMode(uint8_t NewMode, ModeBase::Commands::ChangeToModeResponse::Type &response)
 {
     ESP_LOGI(TAG, "DishwasherModeDelegate::HandleChangeToMode()");
-    DishwasherMgr().UpdateMode(NewMode);
+    DishwasherMgr().PostCommand(DishwasherCommand::kChangeMode, NewMode);
     response.status = to_underlying(ModeBase::StatusCode::kSuccess);
 }
 
 CHIP_ERROR DishwasherModeDelegate::GetModeLabelByIndex(uint8_t modeIndex, chip::MutableCharSpan &label)
 {
     ESP_LOGI(TAG, "DishwasherModeDelegate::GetModeLabelByIndex()");
-    if (modeIndex >= MATTER_ARRAY_SIZE(kModeOptions))
+    if (modeIndex >= GetProgramCount())
     {
         ESP_LOGI(TAG, "CHIP_ERROR_PROVIDER_LIST_EXHAUSTED");
         return CHIP_ERROR_PROVIDER_LIST_EXHAUSTED;
     }
-    return chip::CopyCharSpanToMutableCharSpan(kModeOptions[modeIndex].label, label);
+    return chip::CopyCharSpanToMutableCharSpan(chip::CharSpan::fromCharString(GetProgram(modeIndex).label), label);
 }
 
 CHIP_ERROR DishwasherModeDelegate::GetModeValueByIndex(uint8_t modeIndex, uint8_t &value)
 {
     ESP_LOGI(TAG, "DishwasherModeDelegate::GetModeValueByIndex(%d)", modeIndex);
 
-    if (modeIndex >= MATTER_ARRAY_SIZE(kModeOptions))
+    if (modeIndex >= GetProgramCount())
     {
         ESP_LOGI(TAG, "CHIP_ERROR_PROVIDER_LIST_EXHAUSTED");
         return CHIP_ERROR_PROVIDER_LIST_EXHAUSTED;
     }
-    value = kModeOptions[modeIndex].mode;
+    value = GetProgram(modeIndex).mode;
 
     ESP_LOGI(TAG, "DishwasherModeDelegate::GetModeValueByIndex - Returning value %d for modeIndex: %d", value, modeIndex);
 
@@ -200,18 +214,25 @@ CHIP_ERROR DishwasherModeDelegate::GetModeValueByIndex(uint8_t modeIndex, uint8_
 CHIP_ERROR DishwasherModeDelegate::GetModeTagsByIndex(uint8_t modeIndex, List<ModeTagStructType> &tags)
 {
     ESP_LOGI(TAG, "DishwasherModeDelegate::GetModeTagsByIndex()");
-    if (modeIndex >= MATTER_ARRAY_SIZE(kModeOptions))
+    if (modeIndex >= GetProgramCount())
     {
         return CHIP_ERROR_PROVIDER_LIST_EXHAUSTED;
     }
 
-    if (tags.size() < kModeOptions[modeIndex].modeTags.size())
+    const ProgramDefinition &program = GetProgram(modeIndex);
+
+    if (tags.size() < program.tagCount)
     {
         return CHIP_ERROR_INVALID_ARGUMENT;
     }
 
-    std::copy(kModeOptions[modeIndex].modeTags.begin(), kModeOptions[modeIndex].modeTags.end(), tags.begin());
-    tags.reduce_size(kModeOptions[modeIndex].modeTags.size());
+    for (uint8_t i = 0; i < program.tagCount; i++)
+    {
+        tags[i].mfgCode.ClearValue();
+        tags[i].value = program.tags[i];
+    }
+
+    tags.reduce_size(program.tagCount);
 
     return CHIP_NO_ERROR;
 }
@@ -282,6 +303,10 @@ void emberAfDishwasherModeClusterInitCallback(chip::EndpointId endpointId)
     gDishwasherModeInstance = new ModeBase::Instance(gDishwasherModeDelegate, endpointId, DishwasherMode::Id, 0);
     gDishwasherModeInstance->Init();
 
+    // Keep the cluster in step with the program the manager restored.
+    //
+    gDishwasherModeInstance->UpdateCurrentMode(DishwasherMgr().GetPublishedMode());
+
     uint8_t currentMode = gDishwasherModeInstance->GetCurrentMode();
 
     ESP_LOGI(TAG, "CurrentMode: %d", currentMode);
@@ -307,7 +332,7 @@ Status DeviceEnergyManagementDelegate::StartTimeAdjustRequest(const uint32_t req
 {
     ESP_LOGI(TAG, "StartTime Adjustment received: New start time: %lu", requestedStartTime);
 
-    DishwasherMgr().AdjustStartTime(requestedStartTime);
+    DishwasherMgr().PostCommand(DishwasherCommand::kAdjustStartTime, requestedStartTime);
 
     return Status::Success;
 }
@@ -449,67 +474,35 @@ void emberAfDeviceEnergyManagementClusterInitCallback(chip::EndpointId endpointI
 //* BUTTONS *
 //***********
 
-static void onoff_button_single_click_cb(void *args, void *user_data)
+static void onoff_button_single_click_cb()
 {
     ESP_LOGI(TAG, "OnOff Clicked");
-    DishwasherMgr().HandleOnOffClicked();
+    DishwasherMgr().PostCommand(DishwasherCommand::kOnOffClicked);
 }
 
-static void onoff_button_long_press_start_cb(void *args, void *user_data)
+static void onoff_button_long_press_start_cb()
 {
     ESP_LOGI(TAG, "OnOff Long Press Start");
-    DishwasherMgr().PresentReset();
+    DishwasherMgr().PostCommand(DishwasherCommand::kResetRequested);
 }
 
-static void start_button_single_click_cb(void *args, void *user_data)
+static void start_button_single_click_cb()
 {
     ESP_LOGI(TAG, "Start Clicked");
-    DishwasherMgr().HandleStartClicked();
+    DishwasherMgr().PostCommand(DishwasherCommand::kStartClicked);
 }
 
-static void rotary_button_single_click_cb(void *args, void *user_data)
+static void rotary_button_single_click_cb()
 {
     ESP_LOGI(TAG, "Rotary Clicked");
-    DishwasherMgr().HandleWheelClicked();
+    DishwasherMgr().PostCommand(DishwasherCommand::kWheelClicked);
 }
 
 esp_err_t app_driver_init()
 {
-    esp_err_t err = ESP_OK;
+    ESP_ERROR_CHECK(PushButtonsMgr().Add(GPIO_NUM_0, 1, onoff_button_single_click_cb, onoff_button_long_press_start_cb));
+    ESP_ERROR_CHECK(PushButtonsMgr().Add(GPIO_NUM_1, 1, start_button_single_click_cb));
+    ESP_ERROR_CHECK(PushButtonsMgr().Add(GPIO_NUM_2, 0, rotary_button_single_click_cb));
 
-    button_config_t onoff_config;
-    memset(&onoff_config, 0, sizeof(button_config_t));
-
-    onoff_config.type = BUTTON_TYPE_GPIO;
-    onoff_config.gpio_button_config.gpio_num = GPIO_NUM_0;
-    onoff_config.gpio_button_config.active_level = 1;
-
-    button_handle_t onoff_handle = iot_button_create(&onoff_config);
-
-    ESP_ERROR_CHECK(iot_button_register_cb(onoff_handle, BUTTON_LONG_PRESS_START, onoff_button_long_press_start_cb, NULL));
-    ESP_ERROR_CHECK(iot_button_register_cb(onoff_handle, BUTTON_SINGLE_CLICK, onoff_button_single_click_cb, NULL));
-
-    button_config_t start_config;
-    memset(&start_config, 0, sizeof(button_config_t));
-
-    start_config.type = BUTTON_TYPE_GPIO;
-    start_config.gpio_button_config.gpio_num = GPIO_NUM_1;
-    start_config.gpio_button_config.active_level = 1;
-
-    button_handle_t start_handle = iot_button_create(&start_config);
-
-    ESP_ERROR_CHECK(iot_button_register_cb(start_handle, BUTTON_SINGLE_CLICK, start_button_single_click_cb, NULL));
-
-    button_config_t rotary_config;
-    memset(&rotary_config, 0, sizeof(button_config_t));
-
-    rotary_config.type = BUTTON_TYPE_GPIO;
-    rotary_config.gpio_button_config.gpio_num = GPIO_NUM_2;
-    rotary_config.gpio_button_config.active_level = 0;
-
-    button_handle_t rotary_handle = iot_button_create(&rotary_config);
-
-    ESP_ERROR_CHECK(iot_button_register_cb(rotary_handle, BUTTON_SINGLE_CLICK, rotary_button_single_click_cb, NULL));
-
-    return err;
-}
\ No newline at end of file
+    return PushButtonsMgr().Init();
+}
@@ -19,6 +19,12 @@
 #include <app-common/zap-generated/ids/Attributes.h> // For Attribute IDs
 
 #include "dishwasher_manager.h"
+#include "dishwasher_console.h"
+#include "commissioning_code.h"
+#include "status_display.h"
+
+#include <app/server/Server.h>
+#include <platform/PlatformManager.h>
 
 #include "esp_netif_sntp.h"
 
@@ -51,6 +57,7 @@ static void app_event_cb(const ChipDeviceEvent *event, intptr_t arg)
 
     case chip::DeviceLayer::DeviceEventType::kCommissioningComplete:
         ESP_LOGI(TAG, "Commissioning complete");
+        StatusDisplayMgr().HideCommissioningCode();
         break;
 
     case chip::DeviceLayer::DeviceEventType::kFailSafeTimerExpired:
@@ -67,7 +74,14 @@ static void app_event_cb(const ChipDeviceEvent *event, intptr_t arg)
 
     case chip::DeviceLayer::DeviceEventType::kCommissioningWindowOpened:
         ESP_LOGI(TAG, "Commissioning window opened");
-        // chip::RendezvousInformationFlag(chip::RendezvousInformationFlag::kBLE);
+
+        // Offer the QR code again if every fabric has been removed. Until the code has
+        // been loaded at startup, app_main shows it.
+        //
+        if (CommissioningCodeMgr().IsReady() && chip::Server::GetInstance().GetFabricTable().FabricCount() == 0)
+        {
+            StatusDisplayMgr().ShowCommissioningCode();
+        }
         break;
 
     case chip::DeviceLayer::DeviceEventType::kCommissioningWindowClosed:
@@ -114,11 +128,11 @@ static esp_err_t app_attribute_update_cb(callback_type_t type, uint16_t endpoint
 
                     if (val->val.b)
                     {
-                        DishwasherMgr().TurnOnPower();
+                        DishwasherMgr().PostCommand(DishwasherCommand::kPowerOn);
                     }
                     else
                     {
-                        DishwasherMgr().TurnOffPower();
+                        DishwasherMgr().PostCommand(DishwasherCommand::kPowerOff);
                     }
                 }
             }
@@ -131,6 +145,10 @@ static esp_err_t app_attribute_update_cb(callback_type_t type, uint16_t endpoint
 static void esp_sntp_time_cb(struct timeval *tv) 
 {
     ESP_LOGI(TAG, "TIME SET!");
+
+    // Scheduled runs are kept in UTC, so they can only be timed now.
+    //
+    RunScheduleMgr().Rearm();
 }
 
 extern "C" void app_main()
@@ -140,6 +158,10 @@ extern "C" void app_main()
     /* Initialize the ESP NVS layer */
     nvs_flash_init();
 
+    /* Initialize the dishwasher first, so the clusters below start from any program restored after a power cut */
+    err = DishwasherMgr().Init();
+    ABORT_APP_ON_FAILURE(err == ESP_OK, ESP_LOGE(TAG, "DishwasherMgr::Init() failed, err:%d", err));
+
     /* Create a Matter node and add the mandatory Root Node device type on endpoint 0 */
     node::config_t node_config;
     node_t *node = node::create(&node_config, app_attribute_update_cb, app_identification_cb);
@@ -188,7 +210,7 @@ extern "C" void app_main()
     // Add the On/Off cluster to the dishwasher endpoint and mark it with the dead front behavior feature.
     //
     esp_matter::cluster::on_off::config_t on_off_config;
-    on_off_config.on_off = false; // Initial state of the On/Off cluster
+    on_off_config.on_off = DishwasherMgr().GetPublishedPowerState(); // Initial state of the On/Off cluster
     esp_matter::cluster::on_off::create(endpoint, &on_off_config, CLUSTER_FLAG_SERVER, esp_matter::cluster::on_off::feature::dead_front_behavior::get_id());
 
     dish_washer_endpoint_id = endpoint::get_id(endpoint);
@@ -207,9 +229,6 @@ extern "C" void app_main()
     // device_energy_manager_endpoint_id = endpoint::get_id(device_energy_management_endpoint);
     // ESP_LOGI(TAG, "Device Energy Manager created with endpoint_id %d", device_energy_manager_endpoint_id);
 
-    err = DishwasherMgr().Init();
-    ABORT_APP_ON_FAILURE(err == ESP_OK, ESP_LOGE(TAG, "DishwasherMgr::Init() failed, err:%d", err));
-
     app_driver_init();
 
 #if CHIP_DEVICE_CONFIG_ENABLE_THREAD
@@ -230,9 +249,22 @@ extern "C" void app_main()
     err = esp_matter::start(app_event_cb);
     ABORT_APP_ON_FAILURE(err == ESP_OK, ESP_LOGE(TAG, "Failed to start Matter, err:%d", err));
 
+    // Loading the QR code needs the onboarding payload, which is only there once Matter has
+    // started. It is only shown until the device has been commissioned.
+    //
+    chip::DeviceLayer::PlatformMgr().LockChipStack();
+
+    if (CommissioningCodeMgr().Load() == ESP_OK && chip::Server::GetInstance().GetFabricTable().FabricCount() == 0)
+    {
+        StatusDisplayMgr().ShowCommissioningCode();
+    }
+
+    chip::DeviceLayer::PlatformMgr().UnlockChipStack();
+
 #if CONFIG_ENABLE_CHIP_SHELL
     esp_matter::console::diagnostics_register_commands();
     esp_matter::console::wifi_register_commands();
+    dishwasher_console_register_commands();
     esp_matter::console::init();
 #endif
 }
@@ -19,6 +19,8 @@
 #include <app/clusters/device-energy-management-server/device-energy-management-server.h>
 #include <protocols/interaction_model/StatusCode.h>
 
+#include "program_catalog.h"
+
 typedef void *app_driver_handle_t;
 
 using namespace chip;
@@ -91,9 +93,6 @@ namespace chip
                         GenericOperationalState(to_underlying(OperationalStateEnum::kError)),
                     };
                     app::DataModel::List<const GenericOperationalState> mOperationalStateList = Span<const GenericOperationalState>(opStateList);
-
-                    const CharSpan phaseList[5] = {"pre-soak"_span, "main-wash"_span, "rinse"_span, "final-rinse"_span, "drying"_span};
-                    Span<const CharSpan> mOperationalPhaseList = Span<const CharSpan>(phaseList);
                 };
 
                 OperationalState::Instance *GetInstance();
@@ -114,44 +113,15 @@ namespace chip
         {
             namespace DishwasherMode
             {
-                const uint8_t ModeNormal = 0;
-                const uint8_t ModeHeavy = 1;
-                const uint8_t ModeLight = 2;
-
                 class DishwasherModeDelegate : public ModeBase::Delegate
                 {
                 private:
                     using ModeTagStructType = detail::Structs::ModeTagStruct::Type;
-                    ModeTagStructType modeTagsNormal[1] = {{.value = to_underlying(ModeTag::kNormal)}};
-                    ModeTagStructType modeTagsHeavy[2] = {{.value = to_underlying(ModeBase::ModeTag::kMax)},
-                                                          {.value = to_underlying(ModeTag::kHeavy)}};
-                    ModeTagStructType modeTagsLight[3] = {{.value = to_underlying(ModeTag::kLight)},
-                                                          {.value = to_underlying(ModeBase::ModeTag::kNight)},
-                                                          {.value = to_underlying(ModeBase::ModeTag::kQuiet)}};
-
-                    // These are the modes on my dishwasher.
-                    // TODO Implement these with the appropriate ModeTags.
+
+                    // The modes are the programs in the ProgramCatalog, which are served
+                    // straight from the "programs" partition when it has been flashed.
+                    // tools/programs.json has all the modes on my dishwasher.
                     //
-                    // Eco 50°
-                    // Chef 70°
-                    // Auto 45° - 65°
-                    // Glass 40°
-                    // Silence 50°
-                    // Pre Rinse
-                    // Quick 45°
-                    // Short 60°
-                    // Machine Care
-
-                    const detail::Structs::ModeOptionStruct::Type kModeOptions[3] = {
-                        detail::Structs::ModeOptionStruct::Type{.label = CharSpan::fromCharString("Eco 50°"),
-                                                                .mode = ModeNormal,
-                                                                .modeTags = DataModel::List<const ModeTagStructType>(modeTagsNormal)},
-                        detail::Structs::ModeOptionStruct::Type{.label = CharSpan::fromCharString("Chef 70°"),
-                                                                .mode = ModeHeavy,
-                                                                .modeTags = DataModel::List<const ModeTagStructType>(modeTagsHeavy)},
-                        detail::Structs::ModeOptionStruct::Type{.label = CharSpan::fromCharString("Quick 45°"),
-                                                                .mode = ModeLight,
-                                                                .modeTags = DataModel::List<const ModeTagStructType>(modeTagsLight)}};
 
                     CHIP_ERROR Init() override;
                     void HandleChangeToMode(uint8_t mode, ModeBase::Commands::ChangeToModeResponse::Type &response) override;
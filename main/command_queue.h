@@ -0,0 +1,100 @@
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+// A bounded, lock-free, multi-producer single-consumer queue.
+//
+// Each cell carries a sequence number that tells producers whether the cell is free
+// and the consumer whether it has been filled (Dmitry Vyukov's bounded queue). Push()
+// never blocks: if the queue is full the item is dropped and counted, so a burst of
+// input can never stall the producer, be that a button callback or the Matter thread.
+//
+template <typename T, size_t Capacity>
+class CommandQueue
+{
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+    CommandQueue()
+    {
+        for (size_t i = 0; i < Capacity; i++)
+        {
+            mCells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    // Safe to call from any task.
+    //
+    bool Push(const T &item)
+    {
+        size_t position = mEnqueuePosition.load(std::memory_order_relaxed);
+        Cell *cell;
+
+        while (true)
+        {
+            cell = &mCells[position & (Capacity - 1)];
+            size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            intptr_t difference = (intptr_t)sequence - (intptr_t)position;
+
+            if (difference == 0)
+            {
+                if (mEnqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                {
+                    break;
+                }
+            }
+            else if (difference < 0)
+            {
+                mDropped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            else
+            {
+                position = mEnqueuePosition.load(std::memory_order_relaxed);
+            }
+        }
+
+        cell->item = item;
+        cell->sequence.store(position + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    // Must only be called by the single consumer.
+    //
+    bool Pop(T &item)
+    {
+        Cell &cell = mCells[mDequeuePosition & (Capacity - 1)];
+        size_t sequence = cell.sequence.load(std::memory_order_acquire);
+
+        if ((intptr_t)sequence - (intptr_t)(mDequeuePosition + 1) < 0)
+        {
+            return false;
+        }
+
+        item = cell.item;
+        cell.sequence.store(mDequeuePosition + Capacity, std::memory_order_release);
+        mDequeuePosition++;
+
+        return true;
+    }
+
+    uint32_t GetDroppedCount() const
+    {
+        return mDropped.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct Cell
+    {
+        std::atomic<size_t> sequence;
+        T item;
+    };
+
+    Cell mCells[Capacity];
+    std::atomic<size_t> mEnqueuePosition{0};
+    size_t mDequeuePosition = 0;
+    std::atomic<uint32_t> mDropped{0};
+};
@@ -0,0 +1,208 @@
+#include "commissioning_code.h"
+
+#include <esp_log.h>
+#include <esp_rom_crc.h>
+#include <esp_timer.h>
+#include <nvs.h>
+#include <string.h>
+
+#include <app/server/OnboardingCodesUtil.h>
+
+// LVGL's copy of Nayuki's QR code generator, built with CONFIG_LV_USE_QRCODE. Only the
+// encoder is used, not the widget.
+//
+#include "src/extra/libs/qrcode/qrcodegen.h"
+
+static const char *TAG = "commissioning_code";
+
+#define QR_NVS_NAMESPACE "dishwasher"
+#define QR_NVS_KEY "qr"
+
+// Matter's payloads fit in version 2, the largest that still fits the screen at two
+// pixels a module.
+//
+#define QR_MAX_VERSION 2
+
+CommissioningCode CommissioningCode::sCommissioningCode;
+
+// Too big for the caller's stack, and only used once.
+//
+static uint8_t sBlob[sizeof(uint64_t) + (CommissioningCode::kSize * CommissioningCode::kStride)];
+
+esp_err_t CommissioningCode::Load()
+{
+    ESP_LOGI(TAG, "CommissioningCode::Load()");
+
+    char payload[64];
+    chip::MutableCharSpan span(payload, sizeof(payload) - 1);
+
+    CHIP_ERROR err = GetQRCode(span, chip::RendezvousInformationFlags(chip::RendezvousInformationFlag::kBLE));
+
+    if (err != CHIP_NO_ERROR)
+    {
+        ESP_LOGE(TAG, "Failed to get the onboarding payload: %" CHIP_ERROR_FORMAT, err.Format());
+        return ESP_FAIL;
+    }
+
+    payload[span.size()] = '\0';
+
+    uint32_t crc = esp_rom_crc32_le(0, (const uint8_t *)payload, span.size());
+    int64_t started = esp_timer_get_time();
+
+    if (Restore(crc))
+    {
+        ESP_LOGI(TAG, "Loaded the QR code in %lldus", esp_timer_get_time() - started);
+    }
+    else
+    {
+        esp_err_t result = Encode(payload);
+
+        if (result != ESP_OK)
+        {
+            return result;
+        }
+
+        ESP_LOGI(TAG, "Encoded the QR code in %lldus", esp_timer_get_time() - started);
+
+        Save(crc);
+    }
+
+    mReady = true;
+
+    return ESP_OK;
+}
+
+bool CommissioningCode::Restore(uint32_t payload)
+{
+    nvs_handle_t handle;
+
+    if (nvs_open(QR_NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK)
+    {
+        return false;
+    }
+
+    static_assert(sizeof(sBlob) == sizeof(Header) + sizeof(mBitmap), "sBlob must hold the header and the bitmap");
+
+    bool restored = false;
+    size_t length = sizeof(sBlob);
+
+    if (nvs_get_blob(handle, QR_NVS_KEY, sBlob, &length) == ESP_OK && length == sizeof(sBlob))
+    {
+        Header header;
+        memcpy(&header, sBlob, sizeof(header));
+
+        if (header.version == kVersion && header.payload == payload)
+        {
+            memcpy(mBitmap, sBlob + sizeof(Header), sizeof(mBitmap));
+            mModules = header.modules;
+            restored = true;
+        }
+        else
+        {
+            ESP_LOGI(TAG, "Onboarding payload has changed, discarding the saved QR code");
+        }
+    }
+
+    nvs_close(handle);
+
+    return restored;
+}
+
+esp_err_t CommissioningCode::Encode(const char *payload)
+{
+    static uint8_t sCode[qrcodegen_BUFFER_LEN_FOR_VERSION(QR_MAX_VERSION)];
+    static uint8_t sTemp[qrcodegen_BUFFER_LEN_FOR_VERSION(QR_MAX_VERSION)];
+
+    if (!qrcodegen_encodeText(payload, sTemp, sCode, qrcodegen_Ecc_LOW, qrcodegen_VERSION_MIN, QR_MAX_VERSION, qrcodegen_Mask_AUTO, true))
+    {
+        ESP_LOGE(TAG, "Onboarding payload is too long for a version %d QR code", QR_MAX_VERSION);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    mModules = qrcodegen_getSize(sCode);
+
+    // Each module is drawn as a square of scale pixels, with the code centred.
+    //
+    int scale = kSize / (mModules + (2 * kQuietZone));
+
+    if (scale < 1)
+    {
+        scale = 1;
+    }
+
+    int offset = (kSize - (mModules * scale)) / 2;
+
+    // Everything is light, the quiet zone around the code included, except the dark
+    // modules.
+    //
+    memset(mBitmap, 0xFF, sizeof(mBitmap));
+
+    for (int y = 0; y < mModules * scale; y++)
+    {
+        for (int x = 0; x < mModules * scale; x++)
+        {
+            if (qrcodegen_getModule(sCode, x / scale, y / scale))
+            {
+                int px = offset + x;
+                int py = offset + y;
+
+                mBitmap[(py * kStride) + (px / 8)] &= ~(0x80 >> (px % 8));
+            }
+        }
+    }
+
+    ESP_LOGI(TAG, "%s is a %dx%d QR code, drawn at %dx", payload, mModules, mModules, scale);
+
+    return ESP_OK;
+}
+
+void CommissioningCode::Save(uint32_t payload)
+{
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(QR_NVS_NAMESPACE, NVS_READWRITE, &handle);
+
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to open NVS: %s", esp_err_to_name(err));
+        return;
+    }
+
+    Header header = {};
+    header.version = kVersion;
+    header.modules = mModules;
+    header.payload = payload;
+
+    memcpy(sBlob, &header, sizeof(header));
+    memcpy(sBlob + sizeof(Header), mBitmap, sizeof(mBitmap));
+
+    err = nvs_set_blob(handle, QR_NVS_KEY, sBlob, sizeof(sBlob));
+
+    if (err == ESP_OK)
+    {
+        err = nvs_commit(handle);
+    }
+
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to save the QR code: %s", esp_err_to_name(err));
+    }
+
+    nvs_close(handle);
+}
+
+void CommissioningCode::Erase()
+{
+    nvs_handle_t handle;
+
+    if (nvs_open(QR_NVS_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK)
+    {
+        return;
+    }
+
+    if (nvs_erase_key(handle, QR_NVS_KEY) == ESP_OK)
+    {
+        nvs_commit(handle);
+    }
+
+    nvs_close(handle);
+}
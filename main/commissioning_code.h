@@ -0,0 +1,70 @@
+#pragma once
+
+#include <stdio.h>
+#include <esp_err.h>
+
+#include <inttypes.h>
+
+// The QR code a commissioner scans to pair with the dishwasher, as a ready to draw 1bpp
+// bitmap.
+//
+// Encoding the onboarding payload is only done once. The bitmap is saved to NVS along with
+// a CRC of the payload it was made from, and later boots load it back as it is, unless the
+// payload has changed. Drawing it is then a copy, with no encoding and nothing allocated.
+// The saved bitmap is erased on factory reset.
+//
+// Load must be called once Matter has started, with the CHIP stack locked. The bitmap
+// doesn't change after that, so it can be read from any task once IsReady is true.
+//
+class CommissioningCode
+{
+public:
+    // The bitmap is kSize pixels square, no taller than the SSD1306. Matter's payloads fit
+    // a version 1 or 2 code, drawn two pixels to a module.
+    //
+    static constexpr uint8_t kSize = 64;
+    static constexpr uint8_t kStride = kSize / 8;
+
+    esp_err_t Load();
+
+    // Erases the saved bitmap, so the next boot encodes the payload afresh.
+    //
+    void Erase();
+
+    bool IsReady() { return mReady; }
+
+    // Row by row, kStride bytes per row with the most significant bit leftmost, and the
+    // code centred. This is LVGL's LV_IMG_CF_ALPHA_1BIT layout. A set bit is light, so the
+    // quiet zone and the light modules are set and only the dark modules are clear, which
+    // lets an OLED draw it by lighting set bits over its dark background.
+    //
+    const uint8_t *GetBitmap() { return mBitmap; }
+
+private:
+    friend CommissioningCode &CommissioningCodeMgr(void);
+    static CommissioningCode sCommissioningCode;
+
+    static constexpr uint8_t kVersion = 2; // 1 set a bit for each dark module
+    static constexpr uint8_t kQuietZone = 2; // Modules of blank margin
+
+    struct Header
+    {
+        uint8_t version;
+        uint8_t modules; // Per side
+        uint16_t reserved;
+        uint32_t payload; // CRC32 of the onboarding payload the bitmap encodes
+    };
+
+    bool Restore(uint32_t payload);
+    esp_err_t Encode(const char *payload);
+    void Save(uint32_t payload);
+
+    uint8_t mBitmap[kSize * kStride] = {};
+    uint8_t mModules = 0;
+    volatile bool mReady = false;
+};
+
+inline CommissioningCode &CommissioningCodeMgr(void)
+{
+    return CommissioningCode::sCommissioningCode;
+}
@@ -0,0 +1,340 @@
+#include "cycle_history.h"
+
+#include <esp_log.h>
+#include <esp_rom_crc.h>
+#include <spi_flash_mmap.h>
+#include <string.h>
+
+#include <algorithm>
+
+static const char *TAG = "cycle_history";
+
+#define HISTORY_PARTITION_LABEL "history"
+
+#define RECORD_FLAG_ABSOLUTE (1 << 5)      // The start time is absolute, not a delta
+#define RECORD_FLAG_UNKNOWN_START (1 << 6) // There is no start time, the clock wasn't synced
+
+CycleHistory CycleHistory::sCycleHistory;
+
+static size_t PutVarint(uint8_t *buffer, uint32_t value)
+{
+    size_t length = 0;
+
+    while (value >= 0x80)
+    {
+        buffer[length++] = (value & 0x7F) | 0x80;
+        value >>= 7;
+    }
+
+    buffer[length++] = value;
+
+    return length;
+}
+
+static bool GetVarint(const uint8_t *buffer, size_t length, size_t &offset, uint32_t &value)
+{
+    value = 0;
+
+    for (uint8_t shift = 0; offset < length && shift < 35; shift += 7)
+    {
+        uint8_t byte = buffer[offset++];
+        value |= (uint32_t)(byte & 0x7F) << shift;
+
+        if ((byte & 0x80) == 0)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+size_t CycleHistory::Encode(const CycleRecord &record, uint32_t previousEnd, bool absolute, uint8_t *buffer)
+{
+    // [length] [mode] [flags] [start] [duration] [paused] [forecast delta] [crc8]
+    //
+    uint8_t *payload = buffer + 1;
+    size_t length = 0;
+
+    uint8_t flags = (record.endReason & 0x03) | ((record.phasesReached & 0x07) << 2);
+
+    // A delta only works forwards from a known end. Otherwise store the time in full.
+    //
+    if (absolute || previousEnd == 0 || record.startTime < previousEnd)
+    {
+        flags |= RECORD_FLAG_ABSOLUTE;
+    }
+
+    if (record.startTime == 0)
+    {
+        flags |= RECORD_FLAG_UNKNOWN_START;
+    }
+
+    payload[length++] = record.mode;
+    payload[length++] = flags;
+
+    if (record.startTime != 0)
+    {
+        length += PutVarint(payload + length, (flags & RECORD_FLAG_ABSOLUTE) ? record.startTime : record.startTime - previousEnd);
+    }
+
+    length += PutVarint(payload + length, record.duration);
+    length += PutVarint(payload + length, record.pausedTime);
+    length += PutVarint(payload + length, ((uint32_t)record.forecastDelta << 1) ^ (uint32_t)(record.forecastDelta >> 31)); // Zigzag
+
+    buffer[0] = length;
+    buffer[length + 1] = esp_rom_crc8_le(0, buffer, length + 1);
+
+    return length + 2;
+}
+
+bool CycleHistory::Decode(const uint8_t *payload, size_t length, uint32_t &previousEnd, CycleRecord &record)
+{
+    size_t offset = 2;
+    uint32_t start = 0;
+    uint32_t forecastDelta;
+
+    if (length < 5)
+    {
+        return false;
+    }
+
+    uint8_t flags = payload[1];
+
+    record.mode = payload[0];
+    record.endReason = flags & 0x03;
+    record.phasesReached = (flags >> 2) & 0x07;
+
+    if (!(flags & RECORD_FLAG_UNKNOWN_START) && !GetVarint(payload, length, offset, start))
+    {
+        return false;
+    }
+
+    if (!GetVarint(payload, length, offset, record.duration) || !GetVarint(payload, length, offset, record.pausedTime) ||
+        !GetVarint(payload, length, offset, forecastDelta))
+    {
+        return false;
+    }
+
+    record.forecastDelta = (int32_t)(forecastDelta >> 1) ^ -(int32_t)(forecastDelta & 1);
+    record.startTime = 0;
+
+    if (!(flags & RECORD_FLAG_UNKNOWN_START))
+    {
+        record.startTime = (flags & RECORD_FLAG_ABSOLUTE) ? start : previousEnd + start;
+        previousEnd = record.startTime + record.duration;
+    }
+
+    return true;
+}
+
+uint32_t CycleHistory::ReadSequence(uint32_t sector)
+{
+    uint32_t sequence = kBlankSequence;
+    esp_partition_read(mPartition, sector * SPI_FLASH_SEC_SIZE, &sequence, sizeof(sequence));
+    return sequence;
+}
+
+// Walks the records in a sector, up to limit, calling back with each one that is intact.
+// Returns where the next record would be written.
+//
+uint32_t CycleHistory::ReadSector(uint32_t sector, uint32_t limit, uint32_t &previousEnd, RecordCallback callback, void *context)
+{
+    uint32_t base = sector * SPI_FLASH_SEC_SIZE;
+    uint32_t offset = sizeof(uint32_t);
+
+    while (offset < limit)
+    {
+        uint8_t buffer[kMaxRecordLength + 2];
+
+        if (esp_partition_read(mPartition, base + offset, buffer, 1) != ESP_OK || buffer[0] == 0xFF)
+        {
+            break;
+        }
+
+        // Not a length we ever write, so the rest of this sector can't be trusted.
+        //
+        if (buffer[0] == 0 || buffer[0] > kMaxRecordLength || offset + buffer[0] + 2 > SPI_FLASH_SEC_SIZE)
+        {
+            return SPI_FLASH_SEC_SIZE;
+        }
+
+        uint32_t length = buffer[0] + 2;
+
+        if (esp_partition_read(mPartition, base + offset + 1, buffer + 1, length - 1) != ESP_OK)
+        {
+            break;
+        }
+
+        // A record torn by a power cut fails its CRC and is stepped over.
+        //
+        CycleRecord record;
+
+        if (esp_rom_crc8_le(0, buffer, length - 1) == buffer[length - 1] && Decode(buffer + 1, buffer[0], previousEnd, record) && callback != nullptr)
+        {
+            callback(record, context);
+        }
+
+        offset += length;
+    }
+
+    return offset;
+}
+
+esp_err_t CycleHistory::Init()
+{
+    ESP_LOGI(TAG, "CycleHistory::Init()");
+
+    mPartition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, HISTORY_PARTITION_LABEL);
+
+    if (mPartition == nullptr)
+    {
+        ESP_LOGW(TAG, "No %s partition, cycles will not be logged", HISTORY_PARTITION_LABEL);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    mSectorCount = mPartition->size / SPI_FLASH_SEC_SIZE;
+    mStatistics.bytesTotal = mSectorCount * SPI_FLASH_SEC_SIZE;
+
+    // The head is the sector with the highest sequence number.
+    //
+    for (uint32_t sector = 0; sector < mSectorCount; sector++)
+    {
+        uint32_t sequence = ReadSequence(sector);
+
+        if (sequence != kBlankSequence && sequence >= mHeadSequence)
+        {
+            mHeadSector = sector;
+            mHeadSequence = sequence;
+        }
+    }
+
+    if (mHeadSequence > 0)
+    {
+        mHeadOffset = ReadSector(mHeadSector, SPI_FLASH_SEC_SIZE, mPreviousEnd, nullptr, nullptr);
+    }
+
+    ESP_LOGI(TAG, "History head is sector %lu (sequence %lu) at offset %lu", mHeadSector, mHeadSequence, mHeadOffset);
+
+    return ESP_OK;
+}
+
+esp_err_t CycleHistory::Append(const CycleRecord &record)
+{
+    if (mPartition == nullptr)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    uint32_t sector = mHeadSector;
+    uint32_t offset = mHeadOffset;
+    uint32_t sequence = mHeadSequence;
+    uint32_t previousEnd = mPreviousEnd;
+
+    // Room for a new sector's sequence number as well as the record, so it is all one write.
+    //
+    uint8_t buffer[sizeof(uint32_t) + kMaxRecordLength + 2];
+    size_t length = Encode(record, previousEnd, offset == 0, buffer + sizeof(uint32_t));
+
+    if (offset != 0 && offset + length > SPI_FLASH_SEC_SIZE)
+    {
+        sector = (sector + 1) % mSectorCount;
+        offset = 0;
+        length = Encode(record, previousEnd, true, buffer + sizeof(uint32_t));
+    }
+
+    uint8_t *data = buffer + sizeof(uint32_t);
+
+    if (offset == 0)
+    {
+        // Starting a sector, which throws away the oldest records once the ring is full.
+        //
+        esp_err_t err = esp_partition_erase_range(mPartition, sector * SPI_FLASH_SEC_SIZE, SPI_FLASH_SEC_SIZE);
+
+        if (err != ESP_OK)
+        {
+            ESP_LOGE(TAG, "Failed to erase history sector: %s", esp_err_to_name(err));
+            return err;
+        }
+
+        mStatistics.sectorErases++;
+
+        sequence++;
+        memcpy(buffer, &sequence, sizeof(sequence));
+
+        data = buffer;
+        length += sizeof(uint32_t);
+    }
+
+    esp_err_t err = esp_partition_write(mPartition, (sector * SPI_FLASH_SEC_SIZE) + offset, data, length);
+
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to write history record: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    if (record.startTime != 0)
+    {
+        previousEnd = record.startTime + record.duration;
+    }
+
+    portENTER_CRITICAL(&mLock);
+    mHeadSector = sector;
+    mHeadOffset = offset + length;
+    mHeadSequence = sequence;
+    mPreviousEnd = previousEnd;
+    mStatistics.recordsWritten++;
+    mStatistics.bytesWritten += length;
+    portEXIT_CRITICAL(&mLock);
+
+    ESP_LOGI(TAG, "Logged cycle: mode %d, %lus, reason %d (%d bytes)", record.mode, record.duration, record.endReason, length);
+
+    return ESP_OK;
+}
+
+void CycleHistory::ForEach(RecordCallback callback, void *context)
+{
+    if (mPartition == nullptr)
+    {
+        return;
+    }
+
+    portENTER_CRITICAL(&mLock);
+    uint32_t headSector = mHeadSector;
+    uint32_t headOffset = mHeadOffset;
+    portEXIT_CRITICAL(&mLock);
+
+    if (headOffset == 0)
+    {
+        return;
+    }
+
+    // The sectors are filled in turn, so the oldest is the one after the head.
+    //
+    for (uint32_t i = 1; i <= mSectorCount; i++)
+    {
+        uint32_t sector = (headSector + i) % mSectorCount;
+
+        if (ReadSequence(sector) == kBlankSequence)
+        {
+            continue;
+        }
+
+        // Each sector starts with an absolute record, so it decodes on its own.
+        //
+        uint32_t previousEnd = 0;
+        ReadSector(sector, sector == headSector ? headOffset : SPI_FLASH_SEC_SIZE, previousEnd, callback, context);
+    }
+}
+
+CycleHistory::Statistics CycleHistory::GetStatistics()
+{
+    portENTER_CRITICAL(&mLock);
+    Statistics statistics = mStatistics;
+    uint32_t sectorsUsed = std::min(mHeadSequence, mSectorCount);
+    statistics.bytesUsed = sectorsUsed > 0 ? ((sectorsUsed - 1) * SPI_FLASH_SEC_SIZE) + mHeadOffset : 0;
+    portEXIT_CRITICAL(&mLock);
+
+    return statistics;
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <stdio.h>
+#include <esp_err.h>
+#include <esp_partition.h>
+#include <freertos/FreeRTOS.h>
+
+#include <inttypes.h>
+
+enum CycleEndReason : uint8_t
+{
+    kCycleCompleted = 0, // EndProgram
+    kCycleStopped,       // StopProgram, from the wheel or a Stop command
+    kCyclePoweredOff,    // Turned off mid-cycle
+};
+
+struct CycleRecord
+{
+    uint32_t startTime;    // UTC when the program started running, or 0 if not known
+    uint32_t duration;     // Seconds from starting to run until the end, including pauses
+    uint32_t pausedTime;   // Seconds spent paused
+    int32_t forecastDelta; // Actual start less the forecast start, in seconds
+    uint8_t mode;
+    uint8_t phasesReached;
+    uint8_t endReason; // CycleEndReason
+};
+
+// A log of every cycle, kept in a ring of flash sectors in the "history" partition.
+//
+// Each record is delta-encoded against the previous one (its start time is stored as the
+// gap since the previous cycle ended) using varints, so a typical cycle takes about ten
+// bytes and appending it is a single small write. Each sector starts with a sequence
+// number and its first record is stored in full, so when the ring wraps round the oldest
+// sector is simply erased.
+//
+// Append is called by the DishwasherManager. ForEach reads straight from flash and never
+// waits on the manager, so it may be called from the shell at any time.
+//
+class CycleHistory
+{
+public:
+    struct Statistics
+    {
+        uint32_t recordsWritten; // Since boot
+        uint32_t bytesWritten;   // Since boot
+        uint32_t sectorErases;   // Since boot
+        uint32_t bytesUsed;
+        uint32_t bytesTotal;
+    };
+
+    typedef void (*RecordCallback)(const CycleRecord &record, void *context);
+
+    esp_err_t Init();
+
+    esp_err_t Append(const CycleRecord &record);
+
+    // Calls back with every record in the log, oldest first.
+    //
+    void ForEach(RecordCallback callback, void *context);
+
+    Statistics GetStatistics();
+
+private:
+    friend CycleHistory &CycleHistoryMgr(void);
+    static CycleHistory sCycleHistory;
+
+    static constexpr uint32_t kBlankSequence = 0xFFFFFFFF;
+    static constexpr uint8_t kMaxRecordLength = 32;
+
+    static size_t Encode(const CycleRecord &record, uint32_t previousEnd, bool absolute, uint8_t *buffer);
+    static bool Decode(const uint8_t *payload, size_t length, uint32_t &previousEnd, CycleRecord &record);
+
+    uint32_t ReadSequence(uint32_t sector);
+    uint32_t ReadSector(uint32_t sector, uint32_t limit, uint32_t &previousEnd, RecordCallback callback, void *context);
+
+    const esp_partition_t *mPartition = nullptr;
+    uint32_t mSectorCount = 0;
+
+    // Only changed by Append. Guarded by mLock so readers get a consistent view.
+    //
+    portMUX_TYPE mLock = portMUX_INITIALIZER_UNLOCKED;
+    uint32_t mHeadSector = 0;
+    uint32_t mHeadOffset = 0; // 0 means the head sector hasn't been started
+    uint32_t mHeadSequence = 0;
+    uint32_t mPreviousEnd = 0;
+
+    Statistics mStatistics = {};
+};
+
+inline CycleHistory &CycleHistoryMgr(void)
+{
+    return CycleHistory::sCycleHistory;
+}
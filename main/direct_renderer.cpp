@@ -0,0 +1,391 @@
+#include "direct_renderer.h"
+
+#if CONFIG_DISHWASHER_DISPLAY_DIRECT
+
+#include "esp_log.h"
+#include <string.h>
+
+#include <algorithm>
+
+#include "commissioning_code.h"
+#include "display_backend.h"
+#include "status_display.h"
+
+static const char *TAG = "direct_renderer";
+
+DirectRenderer DirectRenderer::sDirectRenderer;
+
+static constexpr int kWidth = DirectRenderer::kWidth;
+static constexpr int kHeight = DirectRenderer::kHeight;
+static constexpr int kPages = DirectRenderer::kPages;
+
+// 5x7 glyphs for ' ' to '~', then '°'. Each byte is a column, least significant bit at
+// the top, just as the panel stores them.
+//
+static constexpr uint8_t kGlyphWidth = 5;
+static constexpr uint8_t kGlyphAdvance = kGlyphWidth + 1;
+static constexpr uint8_t kDegreeGlyph = 95;
+
+static const uint8_t kFont[][kGlyphWidth] = {
+    {0x00, 0x00, 0x00, 0x00, 0x00}, {0x00, 0x00, 0x5F, 0x00, 0x00}, {0x00, 0x07, 0x00, 0x07, 0x00}, {0x14, 0x7F, 0x14, 0x7F, 0x14}, // ' ' ! " #
+    {0x24, 0x2A, 0x7F, 0x2A, 0x12}, {0x23, 0x13, 0x08, 0x64, 0x62}, {0x36, 0x49, 0x55, 0x22, 0x50}, {0x00, 0x05, 0x03, 0x00, 0x00}, // $ % & '
+    {0x00, 0x1C, 0x22, 0x41, 0x00}, {0x00, 0x41, 0x22, 0x1C, 0x00}, {0x14, 0x08, 0x3E, 0x08, 0x14}, {0x08, 0x08, 0x3E, 0x08, 0x08}, // ( ) * +
+    {0x00, 0x50, 0x30, 0x00, 0x00}, {0x08, 0x08, 0x08, 0x08, 0x08}, {0x00, 0x60, 0x60, 0x00, 0x00}, {0x20, 0x10, 0x08, 0x04, 0x02}, // , - . /
+    {0x3E, 0x51, 0x49, 0x45, 0x3E}, {0x00, 0x42, 0x7F, 0x40, 0x00}, {0x42, 0x61, 0x51, 0x49, 0x46}, {0x21, 0x41, 0x45, 0x4B, 0x31}, // 0 1 2 3
+    {0x18, 0x14, 0x12, 0x7F, 0x10}, {0x27, 0x45, 0x45, 0x45, 0x39}, {0x3C, 0x4A, 0x49, 0x49, 0x30}, {0x01, 0x71, 0x09, 0x05, 0x03}, // 4 5 6 7
+    {0x36, 0x49, 0x49, 0x49, 0x36}, {0x06, 0x49, 0x49, 0x29, 0x1E}, {0x00, 0x36, 0x36, 0x00, 0x00}, {0x00, 0x56, 0x36, 0x00, 0x00}, // 8 9 : ;
+    {0x08, 0x14, 0x22, 0x41, 0x00}, {0x14, 0x14, 0x14, 0x14, 0x14}, {0x00, 0x41, 0x22, 0x14, 0x08}, {0x02, 0x01, 0x51, 0x09, 0x06}, // < = > ?
+    {0x32, 0x49, 0x79, 0x41, 0x3E}, {0x7E, 0x11, 0x11, 0x11, 0x7E}, {0x7F, 0x49, 0x49, 0x49, 0x36}, {0x3E, 0x41, 0x41, 0x41, 0x22}, // @ A B C
+    {0x7F, 0x41, 0x41, 0x22, 0x1C}, {0x7F, 0x49, 0x49, 0x49, 0x41}, {0x7F, 0x09, 0x09, 0x09, 0x01}, {0x3E, 0x41, 0x49, 0x49, 0x7A}, // D E F G
+    {0x7F, 0x08, 0x08, 0x08, 0x7F}, {0x00, 0x41, 0x7F, 0x41, 0x00}, {0x20, 0x40, 0x41, 0x3F, 0x01}, {0x7F, 0x08, 0x14, 0x22, 0x41}, // H I J K
+    {0x7F, 0x40, 0x40, 0x40, 0x40}, {0x7F, 0x02, 0x0C, 0x02, 0x7F}, {0x7F, 0x04, 0x08, 0x10, 0x7F}, {0x3E, 0x41, 0x41, 0x41, 0x3E}, // L M N O
+    {0x7F, 0x09, 0x09, 0x09, 0x06}, {0x3E, 0x41, 0x51, 0x21, 0x5E}, {0x7F, 0x09, 0x19, 0x29, 0x46}, {0x46, 0x49, 0x49, 0x49, 0x31}, // P Q R S
+    {0x01, 0x01, 0x7F, 0x01, 0x01}, {0x3F, 0x40, 0x40, 0x40, 0x3F}, {0x1F, 0x20, 0x40, 0x20, 0x1F}, {0x3F, 0x40, 0x38, 0x40, 0x3F}, // T U V W
+    {0x63, 0x14, 0x08, 0x14, 0x63}, {0x07, 0x08, 0x70, 0x08, 0x07}, {0x61, 0x51, 0x49, 0x45, 0x43}, {0x00, 0x7F, 0x41, 0x41, 0x00}, // X Y Z [
+    {0x02, 0x04, 0x08, 0x10, 0x20}, {0x00, 0x41, 0x41, 0x7F, 0x00}, {0x04, 0x02, 0x01, 0x02, 0x04}, {0x40, 0x40, 0x40, 0x40, 0x40}, // \ ] ^ _
+    {0x00, 0x01, 0x02, 0x04, 0x00}, {0x20, 0x54, 0x54, 0x54, 0x78}, {0x7F, 0x48, 0x44, 0x44, 0x38}, {0x38, 0x44, 0x44, 0x44, 0x20}, // ` a b c
+    {0x38, 0x44, 0x44, 0x48, 0x7F}, {0x38, 0x54, 0x54, 0x54, 0x18}, {0x08, 0x7E, 0x09, 0x01, 0x02}, {0x0C, 0x52, 0x52, 0x52, 0x3E}, // d e f g
+    {0x7F, 0x08, 0x04, 0x04, 0x78}, {0x00, 0x44, 0x7D, 0x40, 0x00}, {0x20, 0x40, 0x44, 0x3D, 0x00}, {0x7F, 0x10, 0x28, 0x44, 0x00}, // h i j k
+    {0x00, 0x41, 0x7F, 0x40, 0x00}, {0x7C, 0x04, 0x18, 0x04, 0x78}, {0x7C, 0x08, 0x04, 0x04, 0x78}, {0x38, 0x44, 0x44, 0x44, 0x38}, // l m n o
+    {0x7C, 0x14, 0x14, 0x14, 0x08}, {0x08, 0x14, 0x14, 0x18, 0x7C}, {0x7C, 0x08, 0x04, 0x04, 0x08}, {0x48, 0x54, 0x54, 0x54, 0x20}, // p q r s
+    {0x04, 0x3F, 0x44, 0x40, 0x20}, {0x3C, 0x40, 0x40, 0x20, 0x7C}, {0x1C, 0x20, 0x40, 0x20, 0x1C}, {0x3C, 0x40, 0x30, 0x40, 0x3C}, // t u v w
+    {0x44, 0x28, 0x10, 0x28, 0x44}, {0x0C, 0x50, 0x50, 0x50, 0x3C}, {0x44, 0x64, 0x54, 0x4C, 0x44}, {0x00, 0x08, 0x36, 0x41, 0x00}, // x y z {
+    {0x00, 0x00, 0x7F, 0x00, 0x00}, {0x00, 0x41, 0x36, 0x08, 0x00}, {0x08, 0x04, 0x08, 0x10, 0x08}, {0x00, 0x06, 0x09, 0x09, 0x06}, // | } ~ °
+};
+
+static_assert(sizeof(kFont) / sizeof(kFont[0]) == kDegreeGlyph + 1, "The font runs from ' ' to '~', then '°'");
+
+// Text laid out as columns of eight pixels. At double size, a second strip holds the
+// bottom half.
+//
+struct Strip
+{
+    uint8_t top[kWidth];
+    uint8_t bottom[kWidth];
+    int width;
+};
+
+// Doubles each bit of a glyph column, for double size text.
+//
+static uint16_t Stretch(uint8_t column)
+{
+    uint16_t stretched = 0;
+
+    for (uint8_t bit = 0; bit < 8; bit++)
+    {
+        if (column & (1 << bit))
+        {
+            stretched |= 3 << (bit * 2);
+        }
+    }
+
+    return stretched;
+}
+
+// Lays out UTF-8 text, clipped to the width of the screen. Anything the font doesn't have
+// is shown as '?'.
+//
+static void Layout(const char *text, int scale, Strip &strip)
+{
+    strip.width = 0;
+
+    for (const uint8_t *c = (const uint8_t *)text; *c != '\0'; c++)
+    {
+        uint8_t glyph = '?' - ' ';
+
+        if (*c >= ' ' && *c <= '~')
+        {
+            glyph = *c - ' ';
+        }
+        else if (c[0] == 0xC2 && c[1] == 0xB0) // U+00B0
+        {
+            glyph = kDegreeGlyph;
+            c++;
+        }
+        else if (*c >= 0x80)
+        {
+            // Skip the rest of the sequence.
+            //
+            while ((c[1] & 0xC0) == 0x80)
+            {
+                c++;
+            }
+        }
+
+        if (strip.width + (kGlyphWidth * scale) > kWidth)
+        {
+            break;
+        }
+
+        for (uint8_t i = 0; i < kGlyphAdvance && strip.width < kWidth; i++)
+        {
+            uint8_t column = i < kGlyphWidth ? kFont[glyph][i] : 0;
+
+            if (scale == 1)
+            {
+                strip.top[strip.width++] = column;
+                continue;
+            }
+
+            uint16_t stretched = Stretch(column);
+
+            for (int repeat = 0; repeat < 2 && strip.width < kWidth; repeat++)
+            {
+                strip.top[strip.width] = stretched & 0xFF;
+                strip.bottom[strip.width] = stretched >> 8;
+                strip.width++;
+            }
+        }
+    }
+
+    // The gap after the last character isn't part of the text.
+    //
+    strip.width = std::max(strip.width - scale, 0);
+}
+
+static inline void Merge(uint8_t *destination, uint32_t bits, bool invert)
+{
+    uint32_t word;
+
+    memcpy(&word, destination, sizeof(word));
+    word = invert ? word ^ bits : word | bits;
+    memcpy(destination, &word, sizeof(word));
+}
+
+// Merges a strip of columns into the frame with its top row at y, either lighting its
+// pixels or, when invert is set, flipping them.
+//
+// Four columns are handled per step. Shifting the four bytes together moves each column
+// down by shift rows, and the bits that crossed into a neighbouring byte are masked off;
+// what falls off the bottom of each column goes into the page below the same way.
+//
+static void Blit(uint8_t *frame, int x, int y, const uint8_t *strip, int width, bool invert)
+{
+    width = std::min(width, kWidth - x);
+
+    if (width <= 0 || y < 0 || y >= kHeight)
+    {
+        return;
+    }
+
+    int page = y / 8;
+    int shift = y % 8;
+
+    uint8_t *upper = frame + (page * kWidth) + x;
+    uint8_t *lower = (shift != 0 && page + 1 < kPages) ? upper + kWidth : nullptr;
+
+    const uint32_t upperMask = 0x01010101u * (uint8_t)(0xFF << shift);
+    const uint32_t lowerMask = 0x01010101u * (uint8_t)(0xFF >> (8 - shift));
+
+    int i = 0;
+
+    for (; i + 4 <= width; i += 4)
+    {
+        uint32_t columns;
+        memcpy(&columns, strip + i, sizeof(columns));
+
+        Merge(upper + i, (columns << shift) & upperMask, invert);
+
+        if (lower != nullptr)
+        {
+            Merge(lower + i, (columns >> (8 - shift)) & lowerMask, invert);
+        }
+    }
+
+    for (; i < width; i++)
+    {
+        uint8_t high = strip[i] << shift;
+        uint8_t low = shift != 0 ? strip[i] >> (8 - shift) : 0;
+
+        upper[i] = invert ? upper[i] ^ high : upper[i] | high;
+
+        if (lower != nullptr)
+        {
+            lower[i] = invert ? lower[i] ^ low : lower[i] | low;
+        }
+    }
+}
+
+// Lights every pixel from (x1, y1) to (x2, y2) inclusive.
+//
+static void Fill(uint8_t *frame, int x1, int y1, int x2, int y2)
+{
+    x1 = std::max(x1, 0);
+    y1 = std::max(y1, 0);
+    x2 = std::min(x2, kWidth - 1);
+    y2 = std::min(y2, kHeight - 1);
+
+    for (int page = y1 / 8; page <= y2 / 8; page++)
+    {
+        int top = std::max(y1 - (page * 8), 0);
+        int bottom = std::min(y2 - (page * 8), 7);
+        uint8_t mask = (0xFF << top) & (0xFF >> (7 - bottom));
+
+        uint8_t *row = frame + (page * kWidth);
+        int x = x1;
+
+        for (; x + 4 <= x2 + 1; x += 4)
+        {
+            Merge(row + x, 0x01010101u * mask, false);
+        }
+
+        for (; x <= x2; x++)
+        {
+            row[x] |= mask;
+        }
+    }
+}
+
+// Copies a bitmap in LVGL's 1bpp layout, rows of bits with the leftmost most significant,
+// into the frame with its top left corner at (x, y). Set bits are lit.
+//
+static void Image(uint8_t *frame, int x, int y, const uint8_t *bitmap, int width, int height, int stride)
+{
+    for (int row = 0; row < height && y + row < kHeight; row++)
+    {
+        uint8_t *page = frame + (((y + row) / 8) * kWidth);
+        uint8_t bit = 1 << ((y + row) % 8);
+
+        for (int column = 0; column < width && x + column < kWidth; column++)
+        {
+            if (bitmap[(row * stride) + (column / 8)] & (0x80 >> (column % 8)))
+            {
+                page[x + column] |= bit;
+            }
+        }
+    }
+}
+
+enum Align : uint8_t
+{
+    kAlignLeft,
+    kAlignCenter,
+    kAlignRight,
+};
+
+// Draws a line of text. Highlighted text is drawn dark on a lit box.
+//
+static void Text(uint8_t *frame, const char *text, Align align, int y, int scale = 1, bool highlighted = false)
+{
+    static Strip strip; // Only used by the render task, and too big for its stack
+
+    Layout(text, scale, strip);
+
+    int x = 0;
+
+    if (align == kAlignCenter)
+    {
+        x = (kWidth - strip.width) / 2;
+    }
+    else if (align == kAlignRight)
+    {
+        x = kWidth - strip.width;
+    }
+
+    if (highlighted)
+    {
+        Fill(frame, x - 1, y - 1, x + strip.width, y + (8 * scale) - 1);
+    }
+
+    Blit(frame, x, y, strip.top, strip.width, highlighted);
+
+    if (scale == 2)
+    {
+        Blit(frame, x, y + 8, strip.bottom, strip.width, highlighted);
+    }
+}
+
+esp_err_t DirectRenderer::Init()
+{
+    ESP_LOGI(TAG, "DirectRenderer::Init()");
+
+    for (uint8_t i = 0; i < 2; i++)
+    {
+        mReleased[i] = xSemaphoreCreateBinary();
+
+        if (mReleased[i] == nullptr)
+        {
+            return ESP_ERR_NO_MEM;
+        }
+
+        xSemaphoreGive(mReleased[i]);
+    }
+
+    return ESP_OK;
+}
+
+size_t DirectRenderer::GetRamUsed()
+{
+    return sizeof(mFrames) + sizeof(Strip);
+}
+
+void DirectRenderer::Render(const StatusView &view)
+{
+    uint8_t *frame = mFrames[mNext];
+
+    // Frames are sent in turn, so this one is free once the one before last has gone.
+    //
+    xSemaphoreTake(mReleased[mNext], portMAX_DELAY);
+
+    Draw(view, frame);
+
+    GetDisplayBackend().Present(frame, mReleased[mNext]);
+
+    mNext ^= 1;
+}
+
+void DirectRenderer::Draw(const StatusView &view, uint8_t *frame)
+{
+    static constexpr int kBottom = kHeight - 8;
+    static constexpr int kMiddle = (kHeight - 8) / 2;
+
+    memset(frame, 0, kPages * kWidth);
+
+    switch (view.screen)
+    {
+    case StatusView::kMainScreen:
+        // The state is shown in a lit bar across the top.
+        //
+        Fill(frame, 0, 0, kWidth - 1, 9);
+        Text(frame, view.state, kAlignLeft, 1, 1, true);
+        Text(frame, view.mode, kAlignLeft, kMiddle - 4, 2);
+        Text(frame, view.status, kAlignLeft, kBottom);
+
+        if (view.menuButton)
+        {
+            Text(frame, "MENU", kAlignCenter, kBottom);
+        }
+        break;
+
+    case StatusView::kMenuScreen:
+        Text(frame, "Energy Mgr", kAlignLeft, 0);
+        Text(frame, "Opt Out", kAlignLeft, kMiddle, 1, !view.optedIn);
+        Text(frame, "Opt In", kAlignRight, kMiddle, 1, view.optedIn);
+        Text(frame, "EXIT", kAlignCenter, kBottom);
+        break;
+
+    case StatusView::kDelayedStartScreen:
+        Text(frame, view.startsIn, kAlignCenter, kMiddle);
+        Text(frame, "CANCEL", kAlignCenter, kBottom);
+        break;
+
+    case StatusView::kCommissioningScreen:
+        if (CommissioningCodeMgr().IsReady())
+        {
+            Image(frame, (kWidth - CommissioningCode::kSize) / 2, (kHeight - CommissioningCode::kSize) / 2, CommissioningCodeMgr().GetBitmap(),
+                  CommissioningCode::kSize, CommissioningCode::kSize, CommissioningCode::kStride);
+        }
+        break;
+
+    case StatusView::kResetScreen:
+        Text(frame, "Reset the device?", kAlignLeft, 0);
+        Text(frame, "No", kAlignLeft, kBottom);
+        Text(frame, "Yes", kAlignRight, kBottom);
+        break;
+
+    default:
+        break;
+    }
+}
+
+#endif // CONFIG_DISHWASHER_DISPLAY_DIRECT
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stdio.h>
+#include <esp_err.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include <inttypes.h>
+
+struct StatusView;
+
+// Draws the StatusDisplay's screens straight into a 128x64 1bpp frame, without LVGL, for
+// CONFIG_DISHWASHER_DISPLAY_DIRECT.
+//
+// The frame is in the SSD1306's own layout: eight rows (pages) of 128 bytes, each byte a
+// column of eight pixels. Text is set in a 5x7 font, whose glyphs are stored the same way,
+// so laying out a line is copying glyph columns into a strip. The strip is then merged
+// into the frame 32 bits (four columns) at a time, shifted to any row. Every frame is
+// redrawn in full, which takes microseconds, and the backend only sends the bytes that
+// changed.
+//
+// Two frames are kept, so one can be drawn whilst the other is still being sent. Only
+// used by the StatusDisplay's render task.
+//
+class DirectRenderer
+{
+public:
+    static constexpr uint16_t kWidth = 128;
+    static constexpr uint16_t kHeight = 64;
+    static constexpr uint16_t kPages = kHeight / 8;
+
+    esp_err_t Init();
+
+    // Draws the view and hands it to the display backend.
+    //
+    void Render(const StatusView &view);
+
+    // Bytes of RAM the frames and layout reserve statically.
+    //
+    size_t GetRamUsed();
+
+private:
+    friend DirectRenderer &DirectRendererMgr(void);
+    static DirectRenderer sDirectRenderer;
+
+    void Draw(const StatusView &view, uint8_t *frame);
+
+    uint8_t mFrames[2][kPages * kWidth];
+    SemaphoreHandle_t mReleased[2] = {}; // Given once each frame has been sent
+    uint8_t mNext = 0;
+};
+
+inline DirectRenderer &DirectRendererMgr(void)
+{
+    return DirectRenderer::sDirectRenderer;
+}
@@ -0,0 +1,404 @@
+#include "dishwasher_console.h"
+
+#include <esp_log.h>
+#include <esp_timer.h>
+#include <esp_matter_console.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "program_catalog.h"
+#include "run_schedule.h"
+#include "cycle_history.h"
+#include "status_display.h"
+#include "display_backend.h"
+#include "screen_capture.h"
+#include "mode_selector.h"
+#include "push_buttons.h"
+
+#if CONFIG_ENABLE_CHIP_SHELL
+
+static esp_matter::console::engine sDishwasherConsole;
+static esp_matter::console::engine sScheduleConsole;
+static esp_matter::console::engine sHistoryConsole;
+
+static const char *kRepeatNames[] = {"once", "daily", "weekly"};
+static const char *kEndReasonNames[] = {"completed", "stopped", "powered off", "?"};
+
+static esp_err_t schedule_list_handler(int argc, char **argv)
+{
+    ScheduledRun runs[RunSchedule::kCapacity];
+    uint8_t count = RunScheduleMgr().List(runs, RunSchedule::kCapacity);
+
+    if (count == 0)
+    {
+        printf("No scheduled runs\r\n");
+    }
+
+    for (uint8_t i = 0; i < count; i++)
+    {
+        time_t startTime = runs[i].startTime;
+        struct tm calendarTime;
+        char buffer[32];
+
+        gmtime_r(&startTime, &calendarTime);
+        strftime(buffer, sizeof(buffer), "%a %Y-%m-%d %H:%M UTC", &calendarTime);
+
+        printf("%d: %s at %s (%lu), %s\r\n", runs[i].id, GetProgram(runs[i].mode).label, buffer, runs[i].startTime, kRepeatNames[runs[i].repeat]);
+    }
+
+    return ESP_OK;
+}
+
+static esp_err_t schedule_add_handler(int argc, char **argv)
+{
+    if (argc < 2 || argc > 3)
+    {
+        printf("Usage: dishwasher schedule add <mode> <utc-seconds> [once|daily|weekly]\r\n");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    uint8_t mode = strtoul(argv[0], NULL, 10);
+    uint32_t startTime = strtoul(argv[1], NULL, 10);
+    ScheduledRun::Repeat repeat = ScheduledRun::kOnce;
+
+    if (argc == 3)
+    {
+        if (strcmp(argv[2], "daily") == 0)
+        {
+            repeat = ScheduledRun::kDaily;
+        }
+        else if (strcmp(argv[2], "weekly") == 0)
+        {
+            repeat = ScheduledRun::kWeekly;
+        }
+        else if (strcmp(argv[2], "once") != 0)
+        {
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+
+    uint8_t id;
+    esp_err_t err = RunScheduleMgr().Add(mode, startTime, repeat, id);
+
+    if (err == ESP_OK)
+    {
+        printf("Scheduled run %d\r\n", id);
+    }
+
+    return err;
+}
+
+static esp_err_t schedule_cancel_handler(int argc, char **argv)
+{
+    if (argc != 1)
+    {
+        printf("Usage: dishwasher schedule cancel <id>\r\n");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    return RunScheduleMgr().Cancel(strtoul(argv[0], NULL, 10));
+}
+
+static void history_dump_record(const CycleRecord &record, void *context)
+{
+    char buffer[32] = "unknown start";
+
+    if (record.startTime != 0)
+    {
+        time_t startTime = record.startTime;
+        struct tm calendarTime;
+
+        gmtime_r(&startTime, &calendarTime);
+        strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M UTC", &calendarTime);
+    }
+
+    printf("%s: %s, %lus (%lus paused), %d phases, %s, %+lds from forecast\r\n", buffer,
+           record.mode < GetProgramCount() ? GetProgram(record.mode).label : "?", record.duration, record.pausedTime,
+           record.phasesReached, kEndReasonNames[record.endReason & 0x03], record.forecastDelta);
+}
+
+static esp_err_t history_dump_handler(int argc, char **argv)
+{
+    CycleHistoryMgr().ForEach(history_dump_record, NULL);
+    return ESP_OK;
+}
+
+struct HistorySummary
+{
+    uint32_t cycles;
+    uint32_t modes[kMaxPrograms];
+    uint32_t reasons[4];
+    uint64_t duration;
+    uint64_t paused;
+    int64_t forecastDelta;
+    uint32_t forecastCount;
+};
+
+static void history_summarise_record(const CycleRecord &record, void *context)
+{
+    HistorySummary &summary = *(HistorySummary *)context;
+
+    summary.cycles++;
+    summary.modes[record.mode % kMaxPrograms]++;
+    summary.reasons[record.endReason & 0x03]++;
+    summary.duration += record.duration;
+    summary.paused += record.pausedTime;
+
+    if (record.startTime != 0)
+    {
+        summary.forecastDelta += record.forecastDelta;
+        summary.forecastCount++;
+    }
+}
+
+static esp_err_t history_summary_handler(int argc, char **argv)
+{
+    HistorySummary summary = {};
+    CycleHistoryMgr().ForEach(history_summarise_record, &summary);
+
+    CycleHistory::Statistics statistics = CycleHistoryMgr().GetStatistics();
+
+    printf("%lu cycles, %lu of %lu bytes used\r\n", summary.cycles, statistics.bytesUsed, statistics.bytesTotal);
+
+    if (summary.cycles == 0)
+    {
+        return ESP_OK;
+    }
+
+    for (uint8_t mode = 0; mode < GetProgramCount(); mode++)
+    {
+        if (summary.modes[mode] > 0)
+        {
+            printf("  %s: %lu\r\n", GetProgram(mode).label, summary.modes[mode]);
+        }
+    }
+
+    printf("  Completed %lu, stopped %lu, powered off %lu\r\n", summary.reasons[kCycleCompleted], summary.reasons[kCycleStopped], summary.reasons[kCyclePoweredOff]);
+    printf("  Average duration %llus, paused %llus\r\n", summary.duration / summary.cycles, summary.paused / summary.cycles);
+
+    if (summary.forecastCount > 0)
+    {
+        printf("  Average start %+llds from forecast\r\n", summary.forecastDelta / summary.forecastCount);
+    }
+
+    printf("  Since boot: %lu records, %lu bytes written, %lu sector erases\r\n", statistics.recordsWritten, statistics.bytesWritten, statistics.sectorErases);
+
+    return ESP_OK;
+}
+
+static esp_err_t display_handler(int argc, char **argv)
+{
+    StatusDisplay::Statistics statistics = StatusDisplayMgr().GetStatistics();
+
+    printf("%lu requests, drawn in %lu frames, %lu with nothing to change\r\n", statistics.requests, statistics.updates, statistics.unchanged);
+    printf("%lu screen changes, %lu text changes, %lu labels shown or hidden, %lu highlight changes\r\n", statistics.screenChanges, statistics.textChanges, statistics.flagChanges,
+           statistics.styleChanges);
+    printf("%lu refreshes, %lu pixels redrawn\r\n", statistics.refreshes, statistics.pixelsFlushed);
+
+    static const char *const kPowerStateNames[] = { "off", "idle", "rendering" };
+    uint64_t uptime = esp_timer_get_time();
+
+    printf("Display %s, %lu requests whilst off\r\n", kPowerStateNames[StatusDisplayMgr().GetPowerState()], statistics.whileOff);
+    printf("LVGL resumed %lu times, its task woken %lu times (%lu while suspended)\r\n", statistics.lvglResumes, statistics.lvglWakeups, statistics.lvglIdleWakeups);
+    printf("LVGL task used %llums of CPU in %llums (%llu.%02llu%%)\r\n", statistics.lvglTime / 1000, uptime / 1000, (statistics.lvglTime * 100) / uptime,
+           ((statistics.lvglTime * 10000) / uptime) % 100);
+
+    if (statistics.updates > 0)
+    {
+        printf("%llu cycles per frame, renderer using %lu bytes of RAM\r\n", statistics.renderCycles / statistics.updates, statistics.rendererRam);
+    }
+
+    DisplayBackend &backend = GetDisplayBackend();
+    DisplayBackend::Statistics flush = backend.GetStatistics();
+
+    if (flush.flushes > 0)
+    {
+        printf("%s: %lu flushes, %lu bytes asked for, %lu sent in %lu transfers (%lu vs %lu bytes per flush)\r\n", backend.GetName(), flush.flushes, flush.bytesRequested,
+               flush.bytesSent, flush.transfers, flush.bytesRequested / flush.flushes, flush.bytesSent / flush.flushes);
+    }
+
+    if (flush.fullRefreshes + flush.partialRefreshes > 0)
+    {
+        printf("%lu full and %lu partial refreshes\r\n", flush.fullRefreshes, flush.partialRefreshes);
+    }
+
+    if (flush.queueFull + flush.failures > 0)
+    {
+        printf("%lu waits for the panel, %lu failed writes\r\n", flush.queueFull, flush.failures);
+    }
+
+    return ESP_OK;
+}
+
+static esp_err_t encoder_handler(int argc, char **argv)
+{
+    ModeSelector::Statistics statistics = ModeSelectorMgr().GetStatistics();
+    uint64_t uptime = esp_timer_get_time();
+
+    printf("%lu detent interrupts, count %ld\r\n", statistics.interrupts, statistics.count);
+    printf("%lu detents moved %lu entries in %lu commands, %lu accelerated\r\n", statistics.detents, statistics.entries, statistics.commands, statistics.accelerated);
+    printf("Task woken %lu times in %llus, %lu with nothing to do\r\n", statistics.wakeups, uptime / 1000000, statistics.idleWakeups);
+
+    if (statistics.wakeups > statistics.idleWakeups)
+    {
+        printf("Interrupt to command %lluus on average, %luus at most\r\n", statistics.latencyTotal / (statistics.wakeups - statistics.idleWakeups),
+               statistics.latencyMax);
+    }
+
+    return ESP_OK;
+}
+
+static esp_err_t buttons_handler(int argc, char **argv)
+{
+    PushButtons::Statistics statistics = PushButtonsMgr().GetStatistics();
+    uint64_t uptime = esp_timer_get_time();
+
+    printf("%lu interrupts, %lu clicks, %lu long presses, %lu bounces\r\n", statistics.interrupts, statistics.clicks, statistics.longPresses, statistics.bounces);
+    printf("Task woken %lu times in %llus, where scanning every 20ms would have run %llu times\r\n", statistics.wakeups, uptime / 1000000, uptime / 20000);
+
+    if (statistics.clicks + statistics.longPresses > 0)
+    {
+        printf("Button to callback %lluus on average, %luus at most\r\n", statistics.latencyTotal / (statistics.clicks + statistics.longPresses), statistics.latencyMax);
+    }
+
+    return ESP_OK;
+}
+
+#if CONFIG_DISHWASHER_DISPLAY_CAPTURE
+static esp_err_t capture_handler(int argc, char **argv)
+{
+    if (argc > 2)
+    {
+        printf("Usage: dishwasher capture [frames] [interval-ms]\r\n");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    uint32_t frames = argc > 0 ? strtoul(argv[0], NULL, 10) : 1;
+    uint32_t interval = argc > 1 ? strtoul(argv[1], NULL, 10) : 1000;
+
+    if (frames == 0)
+    {
+        printf("Usage: dishwasher capture [frames] [interval-ms]\r\n");
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    return ScreenCaptureMgr().Stream(frames, interval);
+}
+#endif
+
+static esp_err_t history_dispatch(int argc, char **argv)
+{
+    if (argc <= 0)
+    {
+        sHistoryConsole.for_each_command(esp_matter::console::print_description, NULL);
+        return ESP_OK;
+    }
+
+    return sHistoryConsole.exec_command(argc, argv);
+}
+
+static esp_err_t schedule_dispatch(int argc, char **argv)
+{
+    if (argc <= 0)
+    {
+        sScheduleConsole.for_each_command(esp_matter::console::print_description, NULL);
+        return ESP_OK;
+    }
+
+    return sScheduleConsole.exec_command(argc, argv);
+}
+
+static esp_err_t dishwasher_dispatch(int argc, char **argv)
+{
+    if (argc <= 0)
+    {
+        sDishwasherConsole.for_each_command(esp_matter::console::print_description, NULL);
+        return ESP_OK;
+    }
+
+    return sDishwasherConsole.exec_command(argc, argv);
+}
+
+esp_err_t dishwasher_console_register_commands()
+{
+    static const esp_matter::console::command_t command = {
+        .name = "dishwasher",
+        .description = "Dishwasher commands. Usage: matter esp dishwasher <command>.",
+        .handler = dishwasher_dispatch,
+    };
+
+    static const esp_matter::console::command_t dishwasher_commands[] = {
+        {
+            .name = "schedule",
+            .description = "Scheduled runs. Usage: matter esp dishwasher schedule <list|add|cancel>.",
+            .handler = schedule_dispatch,
+        },
+        {
+            .name = "history",
+            .description = "Cycle history. Usage: matter esp dishwasher history <dump|summary>.",
+            .handler = history_dispatch,
+        },
+        {
+            .name = "display",
+            .description = "Display rendering counters. Usage: matter esp dishwasher display.",
+            .handler = display_handler,
+        },
+        {
+            .name = "encoder",
+            .description = "Mode wheel counters. Usage: matter esp dishwasher encoder.",
+            .handler = encoder_handler,
+        },
+        {
+            .name = "buttons",
+            .description = "Push button counters. Usage: matter esp dishwasher buttons.",
+            .handler = buttons_handler,
+        },
+#if CONFIG_DISHWASHER_DISPLAY_CAPTURE
+        {
+            .name = "capture",
+            .description = "Stream what the display shows, for tools/screen_capture.py. Usage: matter esp dishwasher capture [frames] [interval-ms].",
+            .handler = capture_handler,
+        },
+#endif
+    };
+
+    static const esp_matter::console::command_t schedule_commands[] = {
+        {
+            .name = "list",
+            .description = "List the scheduled runs, earliest first.",
+            .handler = schedule_list_handler,
+        },
+        {
+            .name = "add",
+            .description = "Schedule a run. Usage: matter esp dishwasher schedule add <mode> <utc-seconds> [once|daily|weekly].",
+            .handler = schedule_add_handler,
+        },
+        {
+            .name = "cancel",
+            .description = "Cancel a scheduled run. Usage: matter esp dishwasher schedule cancel <id>.",
+            .handler = schedule_cancel_handler,
+        },
+    };
+
+    static const esp_matter::console::command_t history_commands[] = {
+        {
+            .name = "dump",
+            .description = "Print every logged cycle, oldest first.",
+            .handler = history_dump_handler,
+        },
+        {
+            .name = "summary",
+            .description = "Summarise the logged cycles.",
+            .handler = history_summary_handler,
+        },
+    };
+
+    sScheduleConsole.register_commands(schedule_commands, sizeof(schedule_commands) / sizeof(esp_matter::console::command_t));
+    sHistoryConsole.register_commands(history_commands, sizeof(history_commands) / sizeof(esp_matter::console::command_t));
+    sDishwasherConsole.register_commands(dishwasher_commands, sizeof(dishwasher_commands) / sizeof(esp_matter::console::command_t));
+
+    return esp_matter::console::add_commands(&command, 1);
+}
+
+#endif // CONFIG_ENABLE_CHIP_SHELL
@@ -0,0 +1,7 @@
+#pragma once
+
+#include <esp_err.h>
+
+// Registers the "dishwasher" chip shell command. Only built with CONFIG_ENABLE_CHIP_SHELL.
+//
+esp_err_t dishwasher_console_register_commands();
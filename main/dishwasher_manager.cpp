@@ -1,6 +1,8 @@
 #include "dishwasher_manager.h"
 
 #include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/semphr.h"
 
 #include <app/clusters/operational-state-server/operational-state-server.h>
 #include <app/clusters/mode-base-server/mode-base-server.h>
@@ -8,8 +10,17 @@
 #include "status_display.h"
 #include "mode_selector.h"
 #include "app_priv.h"
+#include "program_catalog.h"
+#include "command_queue.h"
+#include "program_journal.h"
+#include "cycle_history.h"
+#include "program_estimates.h"
+#include "heap_guard.h"
+#include "utc_time.h"
+#include "commissioning_code.h"
 
 #include <inttypes.h>
+#include <algorithm>
 
 static const char *TAG = "dishwasher_manager";
 
@@ -18,82 +29,399 @@ using namespace chip::app;
 using namespace chip::app::Clusters;
 using namespace chip::app::Clusters::OperationalState;
 
+#define US_PER_SECOND 1000000LL
+
 DishwasherManager DishwasherManager::sDishwasher;
 
-static void ProgramTick(void *arg)
+// All of the manager's state is owned by ManagerTask. Buttons, the mode selector and the
+// Matter delegates only ever push commands onto this queue.
+//
+static CommandQueue<DishwasherCommand, 32> sCommandQueue;
+
+// The program timer is only ever armed for the next real deadline (delayed start expiring,
+// phase ending or the countdown on the display ticking over), so there are no wakeups
+// whilst the dishwasher is idle.
+//
+void DishwasherManager::ProgramTimerCallback(void *arg)
+{
+    DishwasherManager &manager = DishwasherMgr();
+
+    manager.mDeadlineExpired.store(true);
+    xTaskNotifyGive(manager.mTask);
+}
+
+void DishwasherManager::ManagerTask(void *arg)
 {
+    DishwasherManager &manager = DishwasherMgr();
+    DishwasherCommand command;
+
+    // Arm the timer for any program restored by Init().
+    //
+    manager.ScheduleNextDeadline();
+
     while (1)
     {
-        DishwasherMgr().ProgressProgram();
-        vTaskDelay(1000 / portTICK_PERIOD_MS);
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        while (sCommandQueue.Pop(command))
+        {
+            manager.HandleCommand(command);
+        }
+
+        if (manager.mDeadlineExpired.exchange(false))
+        {
+            manager.ProgressProgram();
+        }
+
+        manager.PublishChanges();
     }
 }
 
 esp_err_t DishwasherManager::Init()
 {
     ESP_LOGI(TAG, "Initializing DishwasherManager");
+
+    sPublishMutex = xSemaphoreCreateMutex();
+
     StatusDisplayMgr().Init();
     ModeSelectorMgr().Init();
 
-    xTaskCreate(ProgramTick, "ProgramTick", 4096, NULL, tskIDLE_PRIORITY, NULL);
+    const esp_timer_create_args_t timer_args = {
+        .callback = ProgramTimerCallback,
+        .arg = NULL,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "program",
+        .skip_unhandled_events = true,
+    };
+
+    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &mProgramTimer));
+
+    // The programs must be known before a checkpoint can be restored against them.
+    //
+    ProgramCatalogMgr().Init();
+    ProgramEstimatesMgr().Init();
+
+    // Pick up where we left off if the power was cut mid-program. This happens before
+    // Matter starts, so the first reports already reflect the restored program.
+    //
+    ProgramJournalMgr().Init();
+    RestoreCheckpoint();
+
+    CycleHistoryMgr().Init();
+
+    xTaskCreate(ManagerTask, "DishwasherManager", 4096, NULL, tskIDLE_PRIORITY + 1, &mTask);
+
+    // Scheduled runs are posted to us, so this needs the task.
+    //
+    RunScheduleMgr().Init();
 
     return ESP_OK;
 }
 
-void DishwasherManager::PresentReset()
+bool DishwasherManager::PostCommand(DishwasherCommand::Type type, uint32_t value)
 {
-    mIsShowingReset = true;
-    StatusDisplayMgr().ShowResetOptions();
+    if (!sCommandQueue.Push(DishwasherCommand{type, value}))
+    {
+        ESP_LOGW(TAG, "Command queue full, dropped command %d (%lu dropped so far)", type, sCommandQueue.GetDroppedCount());
+        return false;
+    }
+
+    if (mTask != nullptr)
+    {
+        xTaskNotifyGive(mTask);
+    }
+
+    return true;
 }
 
-void DishwasherManager::HandleOnOffClicked()
+void DishwasherManager::HandleCommand(const DishwasherCommand &command)
 {
-    if (mIsShowingReset)
+    switch (command.type)
     {
-        StatusDisplayMgr().HideResetOptions();
-        mIsShowingReset = false;
+    case DishwasherCommand::kOnOffClicked:
+        Dispatch(kUiOnOffClicked);
+        break;
+    case DishwasherCommand::kStartClicked:
+        Dispatch(kUiStartClicked);
+        break;
+    case DishwasherCommand::kWheelClicked:
+        Dispatch(kUiWheelClicked);
+        break;
+    case DishwasherCommand::kResetRequested:
+        Dispatch(kUiResetRequested);
+        break;
+    case DishwasherCommand::kMoveSelection:
+        mSelectionMove = (int32_t)command.value;
+
+        if (mSelectionMove != 0)
+        {
+            Dispatch(mSelectionMove > 0 ? kUiSelectNext : kUiSelectPrevious);
+        }
+        break;
+    case DishwasherCommand::kStart:
+        Dispatch(kUiStartRequested);
+        break;
+    case DishwasherCommand::kStop:
+        Dispatch(kUiStopRequested);
+        break;
+    case DishwasherCommand::kPause:
+        PauseProgram();
+        break;
+    case DishwasherCommand::kResume:
+        ResumeProgram();
+        break;
+    case DishwasherCommand::kChangeMode:
+        UpdateMode(command.value);
+        break;
+    case DishwasherCommand::kAdjustStartTime:
+        AdjustStartTime(command.value);
+        break;
+    case DishwasherCommand::kPowerOn:
+        Dispatch(kUiPowerOn);
+        break;
+    case DishwasherCommand::kPowerOff:
+        Dispatch(kUiPowerOff);
+        break;
+    case DishwasherCommand::kRunScheduled:
+        while (RunScheduleMgr().TakeDue(mScheduledRun))
+        {
+            ESP_LOGI(TAG, "Scheduled run %d is due at %lu", mScheduledRun.id, mScheduledRun.startTime);
+            Dispatch(kUiRunScheduled);
+        }
+        break;
+    default:
+        ESP_LOGW(TAG, "Unknown command %d", command.type);
+        break;
     }
-    else
+}
+
+void DishwasherManager::Dispatch(UiEvent event)
+{
+    const UiTransition &transition = kUiTransitions[mUiState][event];
+
+    UiScreen from = kUiStates[mUiState].screen;
+    UiScreen to = kUiStates[transition.next].screen;
+
+    if (transition.next != mUiState)
+    {
+        ESP_LOGI(TAG, "UI state %d -> %d on event %d", mUiState, transition.next, event);
+    }
+
+    // The state changes before the action runs, so the action sees whether the
+    // dishwasher is now powered and has a program selected.
+    //
+    if (from != to)
     {
-        TogglePower();
+        ExitScreen(from);
+    }
+
+    mUiState = transition.next;
+
+    RunAction(transition.action);
+
+    if (from != to)
+    {
+        EnterScreen(to);
     }
 }
 
-void DishwasherManager::HandleStartClicked()
+void DishwasherManager::RunAction(UiAction action)
 {
-    if (!mIsPoweredOn)
+    switch (action)
     {
-        ESP_LOGI(TAG, "Dishwasher is off, cannot handle start");
-        return;
+    case kActionNone:
+        break;
+    case kActionSwitchOn:
+        TurnOnPower();
+        ReportPowerState();
+        break;
+    case kActionSwitchOff:
+        TurnOffPower();
+        ReportPowerState();
+        break;
+    case kActionPowerOn:
+        TurnOnPower();
+        break;
+    case kActionPowerOff:
+        TurnOffPower();
+        break;
+    case kActionStartProgram:
+        StartProgram();
+        break;
+    case kActionStopProgram:
+        StopProgram();
+        break;
+    case kActionToggleProgram:
+        ToggleProgram();
+        break;
+    case kActionToggleOptIn:
+        ToggleOptIn();
+        break;
+    case kActionMoveMode:
+        MoveMode(mSelectionMove);
+        break;
+    case kActionFactoryReset:
+        // Matter only erases its own settings, so the QR code is erased here.
+        //
+        CommissioningCodeMgr().Erase();
+        esp_matter::factory_reset();
+        break;
+    case kActionStartScheduledRun:
+        StartScheduledRun();
+        break;
+    case kActionSwitchOnScheduledRun:
+        TurnOnPower();
+        ReportPowerState();
+        StartScheduledRun();
+        break;
     }
+}
 
-    if (mIsShowingReset)
+void DishwasherManager::EnterScreen(UiScreen screen)
+{
+    switch (screen)
     {
-        esp_matter::factory_reset();
-        mIsShowingReset = false;
+    case kScreenOff:
+        StatusDisplayMgr().TurnOff();
+        break;
+    case kScreenReset:
+        StatusDisplayMgr().ShowResetOptions();
+        break;
+    default:
+        MarkDirty(kDirtyDisplay);
+        break;
     }
-    else
+}
+
+void DishwasherManager::ExitScreen(UiScreen screen)
+{
+    switch (screen)
     {
-        ToggleProgram();
+    case kScreenOff:
+        StatusDisplayMgr().TurnOn();
+        break;
+    case kScreenReset:
+        StatusDisplayMgr().HideResetOptions();
+        break;
+    default:
+        break;
     }
 }
 
+int64_t DishwasherManager::GetElapsedRunningTime(int64_t now)
+{
+    if (mState == OperationalStateEnum::kPaused)
+    {
+        now = mPausedAt;
+    }
+
+    return now - mRunStartedAt - mPausedTotal;
+}
+
 uint32_t DishwasherManager::GetTimeRemaining()
 {
-    return mRunningTimeRemaining;
+    if (!IsProgramSelected())
+    {
+        return 0;
+    }
+
+    ProgramEstimates &estimates = ProgramEstimatesMgr();
+    int64_t remaining = estimates.GetDuration(mMode) * US_PER_SECOND;
+
+    if (mState != OperationalStateEnum::kStopped)
+    {
+        if (mPhase >= GetProgram(mMode).phaseCount)
+        {
+            return 0;
+        }
+
+        // What's left of this phase, going by how long it usually takes, plus the phases after it.
+        // The estimates are of running time, the same as is taken off here, so the countdown
+        // holds while paused.
+        //
+        int64_t inPhase = GetElapsedRunningTime(esp_timer_get_time()) - mPhaseStartedAt;
+
+        remaining = std::max(estimates.GetPhaseDuration(mMode, mPhase) * US_PER_SECOND - inPhase, (int64_t)0);
+        remaining += estimates.GetDurationFrom(mMode, mPhase + 1) * US_PER_SECOND;
+    }
+
+    if (remaining <= 0)
+    {
+        return 0;
+    }
+
+    // Round up, so the countdown reads 1s until the program actually ends.
+    //
+    return (remaining + US_PER_SECOND - 1) / US_PER_SECOND;
 }
 
-void DishwasherManager::TogglePower()
+uint32_t DishwasherManager::GetDelayedStartRemaining()
 {
-    if (mIsPoweredOn)
+    if (mDelayedStartAt == 0)
     {
-        TurnOffPower();
+        return 0;
     }
-    else
+
+    int64_t remaining = mDelayedStartAt - esp_timer_get_time();
+
+    if (remaining <= 0)
     {
-        TurnOnPower();
+        return 0;
+    }
+
+    return (remaining + US_PER_SECOND - 1) / US_PER_SECOND;
+}
+
+void DishwasherManager::ScheduleNextDeadline()
+{
+    int64_t now = esp_timer_get_time();
+    int64_t next = INT64_MAX;
+
+    if (IsProgramSelected())
+    {
+        if (mDelayedStartAt != 0)
+        {
+            next = mDelayedStartAt;
+
+            if (IsPoweredOn())
+            {
+                // Refresh the "Starting in" countdown when it next changes.
+                //
+                int64_t remaining = mDelayedStartAt - now;
+                int64_t fraction = remaining % US_PER_SECOND;
+                next = std::min(next, now + (fraction > 0 ? fraction : US_PER_SECOND));
+            }
+        }
+        else if (mState == OperationalStateEnum::kStopped)
+        {
+            // Nothing to wait for, so start straight away.
+            //
+            next = now;
+        }
+        else if (mState == OperationalStateEnum::kRunning)
+        {
+            int64_t base = mRunStartedAt + mPausedTotal;
+
+            next = base + mPhaseEndsAt;
+
+            if (IsPoweredOn())
+            {
+                int64_t elapsed = now - base;
+                next = std::min(next, base + ((elapsed / US_PER_SECOND) + 1) * US_PER_SECOND);
+            }
+        }
     }
 
+    esp_timer_stop(mProgramTimer);
+
+    if (next != INT64_MAX)
+    {
+        esp_timer_start_once(mProgramTimer, std::max(next - now, (int64_t)0));
+    }
+}
+
+void DishwasherManager::ReportPowerState()
+{
     // We can update the OnOff attribute directly as its managed by esp-matter.
     //
     uint16_t endpoint_id = 0x01;
@@ -104,27 +432,22 @@ void DishwasherManager::TogglePower()
 
     esp_matter_attr_val_t val = esp_matter_invalid(NULL);
     esp_matter::attribute::get_val(attribute, &val);
-    val.val.b = mIsPoweredOn;
+    val.val.b = IsPoweredOn();
     esp_matter::attribute::update(endpoint_id, cluster_id, attribute_id, &val);
 }
 
 void DishwasherManager::TurnOnPower()
 {
-    mIsPoweredOn = true;
-    StatusDisplayMgr().TurnOn();
-    UpdateDishwasherDisplay();
+    MarkDirty(kDirtyDisplay | kDirtyCheckpoint);
+    ScheduleNextDeadline();
+    PublishChanges();
 }
 
 void DishwasherManager::TurnOffPower()
 {
-    mIsPoweredOn = false;
+    mCycleEndReason = kCyclePoweredOff;
+    MarkDirty(kDirtyCheckpoint);
     StopProgram();
-    StatusDisplayMgr().TurnOff();
-}
-
-bool DishwasherManager::IsPoweredOn()
-{
-    return mIsPoweredOn;
 }
 
 void DishwasherManager::ToggleProgram()
@@ -145,18 +468,27 @@ void DishwasherManager::ToggleProgram()
 
 // Track this separately as we need to set some values in the forecast struct.
 //
-chip::app::Clusters::DeviceEnergyManagement::Structs::SlotStruct::Type sSlots[10];
+chip::app::Clusters::DeviceEnergyManagement::Structs::SlotStruct::Type sSlots[kMaxProgramPhases];
 chip::app::Clusters::DeviceEnergyManagement::Structs::ForecastStruct::Type sForecastStruct;
 
-void DishwasherManager::StartProgram()
+void DishwasherManager::StartScheduledRun()
 {
-    mIsProgramSelected = true;
+    UpdateMode(mScheduledRun.mode);
+    StartProgram(mScheduledRun.startTime);
+}
+
+void DishwasherManager::StartProgram(uint32_t startTime)
+{
+    const ProgramDefinition &program = GetProgram(mMode);
+
+    ProgramEstimates &estimates = ProgramEstimatesMgr();
+    uint32_t duration = estimates.GetDuration(mMode);
 
-    // 30 minutes in seconds = 1800
-    // 60 minutes in seconds = 3600
-    // 90 minutes in seconds = 5400
-    mRunningTimeRemaining = 1800 + (mMode * 1800);
     mPhase = 0;
+    mPhaseEndsAt = program.phaseEnds[0] * US_PER_SECOND;
+    mPhaseStartedAt = 0;
+    mRunStartedAt = 0;
+    mPausedTotal = 0;
 
     // UpdateCurrentPhase(mPhase);
     // UpdateOperationState(OperationalStateEnum::kRunning);
@@ -185,18 +517,22 @@ void DishwasherManager::StartProgram()
     // localtime_r(&unixEpoch, &calendarTime);
     // ESP_LOGI(TAG, "The date and time is %s", asctime_r(&calendarTime, buf));
 
-    if (mOptedIntoEnergyManagement)
+    uint32_t delay = 0; // Start immediately.
+
+    if (startTime > unixEpoch)
     {
-        mDelayedStartTimeRemaining = 60; // Start in one minute to allow for optimisation
+        delay = startTime - unixEpoch; // A scheduled run, handed to us ahead of time so the forecast is published in advance
     }
-    else
+    else if (mOptedIntoEnergyManagement)
     {
-        mDelayedStartTimeRemaining = 0; // Start immediately.
+        delay = 60; // Start in one minute to allow for optimisation
     }
 
+    mDelayedStartAt = delay > 0 ? esp_timer_get_time() + (delay * US_PER_SECOND) : 0;
+
     sForecastStruct.forecastID = 0; // TODO This should change each time the forecast changes.
-    sForecastStruct.startTime = unixEpoch + mDelayedStartTimeRemaining;
-    sForecastStruct.endTime = unixEpoch + mDelayedStartTimeRemaining + mRunningTimeRemaining;
+    sForecastStruct.startTime = unixEpoch + delay;
+    sForecastStruct.endTime = unixEpoch + delay + duration;
 
     if (mOptedIntoEnergyManagement)
     {
@@ -212,50 +548,31 @@ void DishwasherManager::StartProgram()
     sForecastStruct.isPausable = false;         // We cannot pause any of the slots in this forecast.
     sForecastStruct.activeSlotNumber.SetNull(); // TODO Change this accordingly as the program progresses.
 
-    int32_t slot_count = 1;
-
-    sSlots[0].minDuration = 1800;
-    sSlots[0].maxDuration = 1800;
-    sSlots[0].defaultDuration = 1800;
-
-    // slots[0].elapsedSlotTime = 0;
-    // slots[0].remainingSlotTime = 0;
-
-    // slots[0].slotIsPausable.SetValue(true);
-    // slots[0].minPauseDuration.SetValue(10);
-    // slots[0].maxPauseDuration.SetValue(60);
-
-    sSlots[0].nominalPower.SetValue(3000000);
-    sSlots[0].minPower.SetValue(3000000);
-    sSlots[0].maxPower.SetValue(3000000);
-
-    if (mMode >= 1)
+    // One forecast slot per phase of the program, sized by how long the phase has really
+    // taken in the past, with its nominal energy spread over that time.
+    //
+    for (uint8_t i = 0; i < program.phaseCount; i++)
     {
-        sSlots[1].minDuration = 30 * 60;
-        sSlots[1].maxDuration = 30 * 60;
-        sSlots[1].defaultDuration = 30 * 60;
-        sSlots[1].nominalPower.SetValue(3000000);
-        sSlots[1].minPower.SetValue(3000000);
-        sSlots[1].maxPower.SetValue(3000000);
+        const ProgramPhase &phase = program.phases[i];
 
-        slot_count = 2;
-    }
-
-    if (mMode >= 2)
-    {
-        sSlots[2].minDuration = 30 * 60;
-        sSlots[2].maxDuration = 30 * 60;
-        sSlots[2].defaultDuration = 30 * 60;
-        sSlots[2].nominalPower.SetValue(3000000);
-        sSlots[2].minPower.SetValue(3000000);
-        sSlots[2].maxPower.SetValue(3000000);
+        uint32_t phaseDuration = estimates.GetPhaseDuration(mMode, i);
+        int64_t power = (estimates.GetPhaseEnergy(mMode, i) * 3600) / phaseDuration; // mWh over seconds, in mW
 
-        slot_count = 3;
+        sSlots[i].minDuration = std::min(phase.duration, phaseDuration);
+        sSlots[i].maxDuration = std::max(phase.duration, phaseDuration);
+        sSlots[i].defaultDuration = phaseDuration;
+        sSlots[i].nominalPower.SetValue(power);
+        sSlots[i].minPower.SetValue(std::min(phase.power, power));
+        sSlots[i].maxPower.SetValue(std::max(phase.power, power));
     }
 
-    sForecastStruct.slots = DataModel::List<DeviceEnergyManagement::Structs::SlotStruct::Type>(sSlots, slot_count);
+    sForecastStruct.slots = DataModel::List<DeviceEnergyManagement::Structs::SlotStruct::Type>(sSlots, program.phaseCount);
 
     SetForecast();
+    MarkDirty(kDirtyCheckpoint);
+
+    ScheduleNextDeadline();
+    PublishChanges();
 }
 
 void DishwasherManager::AdjustStartTime(uint32_t new_start_time)
@@ -265,7 +582,7 @@ void DishwasherManager::AdjustStartTime(uint32_t new_start_time)
         // TODO If the program has started, we can't adjust the start time.
         //
         sForecastStruct.startTime = new_start_time;
-        sForecastStruct.endTime = new_start_time + ((30 + (mMode * 30)) * 60);
+        sForecastStruct.endTime = new_start_time + ProgramEstimatesMgr().GetDuration(mMode);
         sForecastStruct.forecastUpdateReason = DeviceEnergyManagement::ForecastUpdateReasonEnum::kGridOptimization;
 
         // Update the delay.
@@ -275,59 +592,107 @@ void DishwasherManager::AdjustStartTime(uint32_t new_start_time)
 
         time_t unixEpoch = std::chrono::duration_cast<chip::System::Clock::Seconds32>(utcTime).count();
 
-        mDelayedStartTimeRemaining = new_start_time - unixEpoch;
+        int64_t delay = (int64_t)new_start_time - unixEpoch;
+        mDelayedStartAt = esp_timer_get_time() + (std::max(delay, (int64_t)0) * US_PER_SECOND);
 
-        UpdateDishwasherDisplay();
+        MarkDirty(kDirtyDisplay | kDirtyCheckpoint);
 
         SetForecast();
+
+        ScheduleNextDeadline();
+        PublishChanges();
     }
 }
 
-void DishwasherManager::PauseProgram()
+bool DishwasherManager::PauseProgram()
 {
+    if (IsProgramSelected() && !GetProgram(mMode).phases[mPhase].pausable)
+    {
+        ESP_LOGI(TAG, "Phase %d cannot be paused", mPhase);
+        return false;
+    }
+
+    if (mState == OperationalStateEnum::kRunning)
+    {
+        mPausedAt = esp_timer_get_time();
+    }
+
     UpdateOperationState(OperationalStateEnum::kPaused);
+    ScheduleNextDeadline();
+    PublishChanges();
+    return true;
 }
 
 void DishwasherManager::ResumeProgram()
 {
+    if (mState == OperationalStateEnum::kPaused)
+    {
+        mPausedTotal += esp_timer_get_time() - mPausedAt;
+    }
+
     UpdateOperationState(OperationalStateEnum::kRunning);
+    ScheduleNextDeadline();
+    PublishChanges();
 }
 
 void DishwasherManager::StopProgram()
 {
-    mIsProgramSelected = false;
-    mDelayedStartTimeRemaining = 0;
-    mRunningTimeRemaining = 0;
-    UpdateCurrentPhase(0);
+    if (mCycleInProgress)
+    {
+        LogCycle();
+    }
+
+    mCycleInProgress = false;
+    mCycleEndReason = kCycleStopped;
+
+    // Once per program, rather than every phase, to spare the flash.
+    //
+    ProgramEstimatesMgr().Save();
+
+    mDelayedStartAt = 0;
+    mPhase = 0;
+    MarkDirty(kDirtyPhase);
     UpdateMode(0);
     UpdateOperationState(OperationalStateEnum::kStopped);
     ClearForecast();
+    ScheduleNextDeadline();
+    PublishChanges();
 }
 
 void DishwasherManager::EndProgram()
 {
     // TODO We might want to do other stuff here, like raise a Matter event that the program has ended.
     //
-    StopProgram();
+    mCycleEndReason = kCycleCompleted;
+    Dispatch(kUiStopRequested);
 }
 
-OperationalStateEnum DishwasherManager::GetOperationalState()
+void DishwasherManager::LogCycle()
 {
-    return mState;
-}
+    int64_t now = esp_timer_get_time();
+    int64_t paused = mPausedTotal + (mState == OperationalStateEnum::kPaused ? now - mPausedAt : 0);
 
-uint8_t DishwasherManager::GetCurrentMode()
-{
-    return mMode;
+    CycleRecord record = {};
+
+    record.startTime = mCycleStartTime;
+    record.duration = (now - mRunStartedAt) / US_PER_SECOND;
+    record.pausedTime = paused / US_PER_SECOND;
+    record.forecastDelta = mCycleForecastDelta;
+    record.mode = mMode;
+    record.phasesReached = std::min<uint8_t>(mPhase + 1, GetProgram(mMode).phaseCount);
+    record.endReason = mCycleEndReason;
+
+    CycleHistoryMgr().Append(record);
 }
 
 void DishwasherManager::UpdateDishwasherDisplay()
 {
-    ESP_LOGI(TAG, "UpdateDishwasherDisplay called!");
+    // Runs on every countdown tick, so everything here works in fixed buffers.
+    //
+    NoHeapScope noHeap;
 
-    char *state_text = "";
-    char *mode_text = "";
-    char *status_text = "";
+    const char *state_text = "";
+    const char *mode_text = GetProgram(mMode).label;
 
     switch (mState)
     {
@@ -348,328 +713,428 @@ void DishwasherManager::UpdateDishwasherDisplay()
         break;
     }
 
-    ESP_LOGI(TAG, "Time Remaining: %lu", mRunningTimeRemaining);
-
-    char time_buffer[30] = "";
-
-    if (mRunningTimeRemaining > 0)
-    {
-        sprintf(time_buffer, "%lus", mRunningTimeRemaining);
-    }
-
-    char mode_buffer[64];
+    uint32_t time_remaining = GetTimeRemaining();
 
-    DishwasherModeDelegate *delegate = (DishwasherModeDelegate *)DishwasherMode::GetDelegate();
+    ESP_LOGD(TAG, "Time Remaining: %lu", time_remaining);
 
-    if (delegate != nullptr)
-    {
-        MutableCharSpan label(mode_buffer);
-
-        delegate->GetModeLabelByIndex(mMode, label);
-
-        mode_text = mode_buffer;
-    }
-
-    char status_buffer[64];
-    char *status_formatted_buffer = NULL;
+    char status_text[sizeof(StatusView::status)] = "";
 
-    if (mState == OperationalStateEnum::kRunning || mState == OperationalStateEnum::kPaused)
+    if (IsProgramSelected() && (mState == OperationalStateEnum::kRunning || mState == OperationalStateEnum::kPaused))
     {
-        OperationalStateDelegate *operational_state_delegate = (OperationalStateDelegate *)OperationalState::GetDelegate();
+        const char *phase_text = kOperationalPhaseNames[GetProgram(mMode).phases[mPhase % kMaxProgramPhases].phase];
 
-        if (operational_state_delegate != nullptr)
+        if (time_remaining > 0)
         {
-            MutableCharSpan label(status_buffer);
-
-            operational_state_delegate->GetOperationalPhaseAtIndex(mPhase, label);
-
-            int length = snprintf((char *)NULL, 0, "%s (%s)", time_buffer, status_buffer) + 1; /* +1 for the null terminator */
-            status_formatted_buffer = (char *)malloc(length);
-            snprintf(status_formatted_buffer, length, "%s (%s)", time_buffer, status_buffer);
-
-            status_text = status_formatted_buffer;
+            snprintf(status_text, sizeof(status_text), "%lus (%s)", time_remaining, phase_text);
+        }
+        else
+        {
+            snprintf(status_text, sizeof(status_text), " (%s)", phase_text);
         }
     }
 
-    StatusDisplayMgr().UpdateDisplay(mIsShowingMenu, mOptedIntoEnergyManagement, mIsProgramSelected, mDelayedStartTimeRemaining, state_text, mode_text, status_text);
-
-    if (status_formatted_buffer != NULL)
-    {
-        free(status_formatted_buffer);
-    }
+    StatusDisplayMgr().UpdateDisplay(kUiStates[mUiState].screen == kScreenMenu, mOptedIntoEnergyManagement, IsProgramSelected(), GetDelayedStartRemaining(), state_text, mode_text, status_text);
 }
 
 void DishwasherManager::ProgressProgram()
 {
     // If there is no program selected, we do nothing.
     //
-    if (!mIsProgramSelected)
+    if (!IsProgramSelected())
     {
         return;
     }
 
-    // We might be on a delayed start, so tick down if required.
+    int64_t now = esp_timer_get_time();
+
+    // We might be on a delayed start, in which case we just need to refresh the countdown.
     //
-    if (mDelayedStartTimeRemaining > 0)
-    {
-        mDelayedStartTimeRemaining--;
-        UpdateDishwasherDisplay();
-    }
-    else
+    if (mDelayedStartAt != 0)
     {
-        // If we are stopped, we should start running.
-        //
-        if (mState == OperationalStateEnum::kStopped)
+        if (now < mDelayedStartAt)
         {
-            mState = OperationalStateEnum::kRunning;
-            UpdateOperationState(mState);
+            MarkDirty(kDirtyDisplay);
+            ScheduleNextDeadline();
+            PublishChanges();
+            return;
         }
 
-        if (mState == OperationalStateEnum::kRunning)
-        {
-            mRunningTimeRemaining--;
+        mDelayedStartAt = 0;
+    }
 
-            uint8_t current_phase = 0;
+    // If we are stopped, we should start running.
+    //
+    if (mState == OperationalStateEnum::kStopped)
+    {
+        mRunStartedAt = now;
+        mPausedTotal = 0;
 
-            if (mRunningTimeRemaining <= 0)
-            {
-                current_phase = 0;
-                EndProgram();
-            }
-            else if (mRunningTimeRemaining < 5)
-            {
-                current_phase = 4;
-            }
-            else if (mRunningTimeRemaining < 10)
-            {
-                current_phase = 3;
-            }
-            else if (mRunningTimeRemaining < 15)
-            {
-                current_phase = 2;
-            }
-            else if (mRunningTimeRemaining < 20)
-            {
-                current_phase = 1;
-            }
+        // How far the actual start was from the forecast start, for the cycle history.
+        //
+        mCycleInProgress = true;
+        mCycleStartTime = GetUtcTime();
+        mCycleForecastDelta = (mCycleStartTime != 0 && sForecastStruct.startTime != 0) ? (int32_t)(mCycleStartTime - sForecastStruct.startTime) : 0;
+
+        mState = OperationalStateEnum::kRunning;
+        UpdateOperationState(mState);
+        MarkDirty(kDirtyPhase);
+    }
 
-            UpdateCurrentPhase(current_phase);
+    if (mState == OperationalStateEnum::kRunning)
+    {
+        // mPhaseEndsAt is taken from the program table when the phase is entered,
+        // so working out whether the phase is over is a single comparison.
+        //
+        if (GetElapsedRunningTime(now) >= mPhaseEndsAt)
+        {
+            AdvancePhase();
+        }
+        else
+        {
+            // Just the countdown on the display, nothing for Matter.
+            //
+            MarkDirty(kDirtyDisplay);
         }
     }
-}
 
-static void UpdateOperationalStatePhaseWorkHandler(intptr_t context)
-{
-    ESP_LOGI(TAG, "UpdateOperationalStatePhaseWorkHandler()");
-    DataModel::Nullable<uint8_t> phase = (DataModel::Nullable<uint8_t>)context;
-    OperationalState::GetInstance()->SetCurrentPhase(phase);
-    DishwasherMgr().UpdateDishwasherDisplay();
+    ScheduleNextDeadline();
+    PublishChanges();
 }
 
-void DishwasherManager::UpdateCurrentPhase(uint8_t phase)
+void DishwasherManager::AdvancePhase()
 {
-    mPhase = phase;
+    const ProgramDefinition &program = GetProgram(mMode);
 
-    // This is one way to perform safe changes to the Matter stack.
+    // Learn how long the phase just completed really ran for. Pauses are left out, the same
+    // as the countdown leaves them out, so a long pause can't skew the estimate.
     //
-    chip::DeviceLayer::PlatformMgr().ScheduleWork(UpdateOperationalStatePhaseWorkHandler, mPhase);
+    int64_t elapsed = GetElapsedRunningTime(esp_timer_get_time());
 
-    // This is another.
-    //
-    // chip::DeviceLayer::PlatformMgr().LockChipStack();
-    // chip::DeviceLayer::PlatformMgr().UnlockChipStack();
-}
+    ProgramEstimatesMgr().RecordPhase(mMode, mPhase, (elapsed - mPhaseStartedAt) / US_PER_SECOND);
 
-static void UpdateOperationalStateWorkHandler(intptr_t context)
-{
-    ESP_LOGI(TAG, "UpdateOperationalStateWorkHandler()");
-    OperationalState::OperationalStateEnum state = (OperationalState::OperationalStateEnum)context;
-    OperationalState::GetInstance()->SetOperationalState(to_underlying(state));
-    OperationalState::GetInstance()->UpdateCountdownTimeFromDelegate();
-    DishwasherMgr().UpdateDishwasherDisplay();
+    mPhaseStartedAt = elapsed;
+    mPhase++;
+
+    if (mPhase >= program.phaseCount)
+    {
+        EndProgram();
+        return;
+    }
+
+    mPhaseEndsAt = program.phaseEnds[mPhase] * US_PER_SECOND;
+
+    ESP_LOGI(TAG, "Entering phase %d (%s)", mPhase, kOperationalPhaseNames[program.phases[mPhase].phase]);
+
+    MarkDirty(kDirtyPhase | kDirtyCountdown | kDirtyDisplay | kDirtyCheckpoint);
 }
 
 void DishwasherManager::UpdateOperationState(OperationalStateEnum state)
 {
     mState = state;
-    chip::DeviceLayer::PlatformMgr().ScheduleWork(UpdateOperationalStateWorkHandler, (uint8_t)mState);
+    MarkDirty(kDirtyState | kDirtyCountdown | kDirtyDisplay | kDirtyCheckpoint);
 }
 
 void DishwasherManager::UpdateMode(uint8_t mode)
 {
     mMode = mode;
-    UpdateDishwasherDisplay();
+    MarkDirty(kDirtyMode | kDirtyDisplay);
+    PublishChanges();
 }
 
-static void UpdateDishwasherCurrentModeWorkHandler(intptr_t context)
+// A consistent copy of everything the Matter data model reflects. The manager fills in
+// sPendingState and the Matter thread copies it into sPublishedState, so one work item
+// covers any number of changes made since the last one ran.
+//
+struct PublishedState
 {
-    ESP_LOGI(TAG, "UpdateOperationalStatePhaseWorkHandler()");
-    uint8_t mode = (uint8_t)context;
-    DishwasherMode::GetInstance()->UpdateCurrentMode(mode);
-    DishwasherMgr().UpdateDishwasherDisplay();
-}
+    OperationalStateEnum state;
+    uint8_t phase;
+    uint8_t mode;
+    bool pausable;
+    bool optedIn;
+    bool poweredOn;
+    uint32_t countdown;
+    int64_t countdownAt;
+    DeviceEnergyManagement::Structs::ForecastStruct::Type forecast;
+    DeviceEnergyManagement::Structs::SlotStruct::Type slots[kMaxProgramPhases];
+};
+
+// A mutex rather than a critical section: the state, forecast included, is a few hundred
+// bytes to build and copy, too long to hold off interrupts and the other tasks for.
+//
+static SemaphoreHandle_t sPublishMutex;
+static PublishedState sPendingState;
+static uint32_t sPendingDirty = 0;
+static bool sPublishScheduled = false;
 
-void DishwasherManager::SelectNext()
+static PublishedState sPublishedState; // Only accessed on the Matter thread
+
+static void PublishWorkHandler(intptr_t context)
 {
-    if (!mIsPoweredOn)
-    {
-        ESP_LOGI(TAG, "Dishwasher is off, cannot handle start");
-        return;
-    }
+    xSemaphoreTake(sPublishMutex, portMAX_DELAY);
+    uint32_t dirty = sPendingDirty;
+    sPendingDirty = 0;
+    sPublishScheduled = false;
+    sPublishedState = sPendingState;
+    xSemaphoreGive(sPublishMutex);
+
+    // The forecast's slot list must point at our copy of the slots, not the manager's.
+    //
+    sPublishedState.forecast.slots = DataModel::List<DeviceEnergyManagement::Structs::SlotStruct::Type>(sPublishedState.slots, sPublishedState.forecast.slots.size());
 
-    if (mIsShowingMenu)
-    {
-        mOptedIntoEnergyManagement = !mOptedIntoEnergyManagement;
+    ESP_LOGI(TAG, "PublishWorkHandler(0x%02lx)", dirty);
 
-        chip::DeviceLayer::PlatformMgr().LockChipStack();
+    OperationalState::Instance *operational_state = OperationalState::GetInstance();
 
-        if (mOptedIntoEnergyManagement)
+    if (operational_state != nullptr)
+    {
+        if (dirty & DishwasherManager::kDirtyState)
         {
-            device_energy_management_delegate.SetOptOutState(OptOutStateEnum::kNoOptOut);
+            operational_state->SetOperationalState(to_underlying(sPublishedState.state));
         }
-        else
+
+        if (dirty & DishwasherManager::kDirtyPhase)
         {
-            device_energy_management_delegate.SetOptOutState(OptOutStateEnum::kOptOut);
+            operational_state->SetCurrentPhase(DataModel::MakeNullable(sPublishedState.phase));
         }
 
-        chip::DeviceLayer::PlatformMgr().UnlockChipStack();
-
-        ESP_LOGI(TAG, "Opted into energy management: %d", mOptedIntoEnergyManagement);
-        UpdateDishwasherDisplay();
+        if (dirty & DishwasherManager::kDirtyCountdown)
+        {
+            operational_state->UpdateCountdownTimeFromDelegate();
+        }
     }
-    else
+
+    if ((dirty & DishwasherManager::kDirtyMode) && DishwasherMode::GetInstance() != nullptr)
     {
-        SelectNextMode();
+        DishwasherMode::GetInstance()->UpdateCurrentMode(sPublishedState.mode);
     }
-}
 
-void DishwasherManager::SelectPrevious()
-{
-    if (!mIsPoweredOn)
+    if (dirty & DishwasherManager::kDirtyOptOut)
     {
-        ESP_LOGI(TAG, "Dishwasher is off, cannot handle start");
-        return;
+        device_energy_management_delegate.SetOptOutState(sPublishedState.optedIn ? OptOutStateEnum::kNoOptOut : OptOutStateEnum::kOptOut);
     }
 
-    if (mIsShowingMenu)
+    if (dirty & DishwasherManager::kDirtyForecast)
     {
-        mOptedIntoEnergyManagement = !mOptedIntoEnergyManagement;
-
-        chip::DeviceLayer::PlatformMgr().LockChipStack();
-
-        if (mOptedIntoEnergyManagement)
-        {
-            device_energy_management_delegate.SetOptOutState(OptOutStateEnum::kNoOptOut);
-        }
-        else
-        {
-            device_energy_management_delegate.SetOptOutState(OptOutStateEnum::kOptOut);
-        }
-
-        chip::DeviceLayer::PlatformMgr().UnlockChipStack();
+        device_energy_management_delegate.SetForecast(DataModel::MakeNullable(sPublishedState.forecast));
+    }
+}
 
-        ESP_LOGI(TAG, "Opted into energy management: %d", mOptedIntoEnergyManagement);
-        UpdateDishwasherDisplay();
+// Fills in sPendingState. Must be called with sPublishMutex held.
+//
+void DishwasherManager::CaptureState(bool includeForecast)
+{
+    sPendingState.state = mState;
+    sPendingState.phase = 0;
+    sPendingState.mode = mMode;
+    sPendingState.pausable = true;
+    sPendingState.optedIn = mOptedIntoEnergyManagement;
+    sPendingState.poweredOn = IsPoweredOn();
+    sPendingState.countdown = GetTimeRemaining();
+    sPendingState.countdownAt = esp_timer_get_time();
+
+    if (IsProgramSelected())
+    {
+        sPendingState.phase = GetProgram(mMode).phases[mPhase].phase;
+        sPendingState.pausable = GetProgram(mMode).phases[mPhase].pausable;
     }
-    else
+
+    if (includeForecast)
     {
-        SelectPreviousMode();
+        sPendingState.forecast = sForecastStruct;
+        std::copy(sSlots, sSlots + sForecastStruct.slots.size(), sPendingState.slots);
     }
 }
 
-void DishwasherManager::HandleWheelClicked()
+void DishwasherManager::PublishChanges()
 {
-    if (!mIsPoweredOn)
+    uint32_t dirty = mDirty;
+
+    if (dirty == 0)
     {
-        ESP_LOGI(TAG, "Dishwasher is off, cannot handle wheel click");
         return;
     }
 
-    if (mIsProgramSelected)
+    mDirty = 0;
+
+    if (dirty & kDirtyDisplay)
     {
-        StopProgram();
         UpdateDishwasherDisplay();
     }
-    else
+
+    // Checkpoints are only requested at phase boundaries and state changes, and however
+    // many of those happened since the last publish, they cost a single journal write.
+    //
+    if (dirty & kDirtyCheckpoint)
     {
-        mIsShowingMenu = !mIsShowingMenu;
-        UpdateDishwasherDisplay();
+        WriteCheckpoint();
     }
-}
 
-void DishwasherManager::SelectNextMode()
-{
-    if (!mIsPoweredOn)
+    // Anything else needs to reach the Matter data model.
+    //
+    dirty &= ~(kDirtyDisplay | kDirtyCheckpoint);
+
+    if (dirty == 0)
     {
-        ESP_LOGI(TAG, "Dishwasher is off, cannot change mode");
         return;
     }
 
-    ESP_LOGI(TAG, "SelectNextMode called!");
+    xSemaphoreTake(sPublishMutex, portMAX_DELAY);
 
-    if (mState != OperationalStateEnum::kStopped)
+    CaptureState(dirty & kDirtyForecast);
+    sPendingDirty |= dirty;
+
+    bool schedule = !sPublishScheduled;
+    sPublishScheduled = true;
+
+    xSemaphoreGive(sPublishMutex);
+
+    if (schedule)
     {
-        ESP_LOGI(TAG, "Mode can only be changed when dishwasher is stopped!");
-        return;
+        chip::DeviceLayer::PlatformMgr().ScheduleWork(PublishWorkHandler, 0);
     }
+}
 
-    mMode++;
+uint32_t DishwasherManager::GetPublishedTimeRemaining()
+{
+    uint32_t countdown = sPublishedState.countdown;
 
-    // Roll over if we reach the end
-    //
-    if (mMode > 2)
+    if (sPublishedState.state == OperationalStateEnum::kRunning)
     {
-        mMode = 0;
+        int64_t elapsed = (esp_timer_get_time() - sPublishedState.countdownAt) / US_PER_SECOND;
+        countdown = elapsed >= countdown ? 0 : countdown - elapsed;
     }
 
-    ESP_LOGI(TAG, "Selected Mode: %d", mMode);
+    return countdown;
+}
+
+bool DishwasherManager::IsPublishedPhasePausable()
+{
+    return sPublishedState.pausable;
+}
+
+OperationalStateEnum DishwasherManager::GetPublishedOperationalState()
+{
+    return sPublishedState.state;
+}
+
+uint8_t DishwasherManager::GetPublishedPhase()
+{
+    return sPublishedState.phase;
+}
+
+uint8_t DishwasherManager::GetPublishedMode()
+{
+    return sPublishedState.mode;
+}
 
-    chip::DeviceLayer::PlatformMgr().ScheduleWork(UpdateDishwasherCurrentModeWorkHandler, mMode);
+bool DishwasherManager::GetPublishedPowerState()
+{
+    return sPublishedState.poweredOn;
 }
 
-void DishwasherManager::SelectPreviousMode()
+void DishwasherManager::WriteCheckpoint()
 {
-    if (!mIsPoweredOn)
+    ProgramCheckpoint checkpoint = {};
+
+    checkpoint.state = to_underlying(mState);
+    checkpoint.mode = mMode;
+    checkpoint.phase = mPhase;
+    checkpoint.flags = (IsProgramSelected() ? ProgramCheckpoint::kProgramSelected : 0) |
+                       (mOptedIntoEnergyManagement ? ProgramCheckpoint::kOptedIn : 0) |
+                       (IsPoweredOn() ? ProgramCheckpoint::kPoweredOn : 0);
+    checkpoint.delayedStart = GetDelayedStartRemaining();
+
+    if (IsProgramSelected() && mState != OperationalStateEnum::kStopped)
     {
-        ESP_LOGI(TAG, "Dishwasher is off, cannot change mode");
-        return;
+        checkpoint.elapsed = GetElapsedRunningTime(esp_timer_get_time()) / US_PER_SECOND;
     }
 
-    uint8_t current_mode = DishwasherMode::GetInstance()->GetCurrentMode();
+    ProgramJournalMgr().Append(checkpoint);
+}
 
-    ESP_LOGI(TAG, "Current Mode: %d", current_mode);
+void DishwasherManager::RestoreCheckpoint()
+{
+    ProgramCheckpoint checkpoint;
 
-    // Roll over if we reach the start
-    //
-    if (mMode == 0)
+    if (ProgramJournalMgr().GetLatest(checkpoint))
     {
-        mMode = 2;
+        int64_t now = esp_timer_get_time();
+
+        mOptedIntoEnergyManagement = checkpoint.flags & ProgramCheckpoint::kOptedIn;
+
+        if (checkpoint.flags & ProgramCheckpoint::kPoweredOn)
+        {
+            mUiState = (checkpoint.flags & ProgramCheckpoint::kProgramSelected) ? kUiProgram : kUiIdle;
+        }
+
+        if (IsProgramSelected())
+        {
+            mMode = checkpoint.mode < GetProgramCount() ? checkpoint.mode : 0;
+
+            const ProgramDefinition &program = GetProgram(mMode);
+
+            mState = (OperationalStateEnum)checkpoint.state;
+            mPhase = std::min<uint8_t>(checkpoint.phase, program.phaseCount - 1);
+            mPhaseEndsAt = program.phaseEnds[mPhase] * US_PER_SECOND;
+            mPhaseStartedAt = (mPhase > 0 ? program.phaseEnds[mPhase - 1] : 0) * US_PER_SECOND;
+
+            // Rebuild the timestamps as if the elapsed time had just been run.
+            //
+            mRunStartedAt = now - (checkpoint.elapsed * US_PER_SECOND);
+            mPausedAt = now;
+            mPausedTotal = 0;
+            mDelayedStartAt = checkpoint.delayedStart > 0 ? now + (checkpoint.delayedStart * US_PER_SECOND) : 0;
+
+            // The cycle carries on, but its start time and forecast were lost with the power.
+            //
+            mCycleInProgress = mState != OperationalStateEnum::kStopped;
+
+            ESP_LOGI(TAG, "Restored program: state %d, mode %d, phase %d, elapsed %lus, delayed start %lus", checkpoint.state, mMode, mPhase, checkpoint.elapsed, checkpoint.delayedStart);
+        }
     }
-    else
+
+    // Matter hasn't started yet, so there is no thread to post to. Seed the published
+    // state directly so the cluster init callbacks report the restored program.
+    //
+    CaptureState(false);
+    sPublishedState = sPendingState;
+
+    if (IsPoweredOn())
     {
-        mMode--;
+        StatusDisplayMgr().TurnOn();
+        UpdateDishwasherDisplay();
     }
+}
 
-    ESP_LOGI(TAG, "Selected Mode: %d", mMode);
+void DishwasherManager::ToggleOptIn()
+{
+    mOptedIntoEnergyManagement = !mOptedIntoEnergyManagement;
 
-    chip::DeviceLayer::PlatformMgr().ScheduleWork(UpdateDishwasherCurrentModeWorkHandler, mMode);
+    ESP_LOGI(TAG, "Opted into energy management: %d", mOptedIntoEnergyManagement);
+    MarkDirty(kDirtyOptOut | kDirtyDisplay | kDirtyCheckpoint);
 }
 
-static void UpdateForecastWorkHandler(intptr_t context)
+void DishwasherManager::MoveMode(int32_t entries)
 {
-    ESP_LOGI(TAG, "UpdateForecastWorkHandler()");
-    device_energy_management_delegate.SetForecast(DataModel::MakeNullable(sForecastStruct));
+    // Only reachable from kUiIdle, where the dishwasher is on and stopped. However far
+    // the wheel moved, the mode changes once and the display is redrawn once.
+    //
+    int32_t count = GetProgramCount();
+
+    // Roll over at either end
+    //
+    mMode = (((mMode + entries) % count) + count) % count;
+
+    ESP_LOGI(TAG, "Moved %ld, selected Mode: %d", entries, mMode);
+
+    MarkDirty(kDirtyMode | kDirtyDisplay);
 }
 
 void DishwasherManager::SetForecast()
 {
     ESP_LOGI(TAG, "DishwasherManager::SetForecast()");
-
-    chip::DeviceLayer::PlatformMgr().ScheduleWork(UpdateForecastWorkHandler, mMode);
-
-    // chip::DeviceLayer::PlatformMgr().LockChipStack();
-    // device_energy_management_delegate.SetForecast(DataModel::MakeNullable(sForecastStruct));
-    // chip::DeviceLayer::PlatformMgr().UnlockChipStack();
+    MarkDirty(kDirtyForecast);
 }
 
 void DishwasherManager::ClearForecast()
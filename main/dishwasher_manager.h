@@ -1,78 +1,177 @@
 #include <lib/core/CHIPError.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <atomic>
 #include <app/clusters/operational-state-server/operational-state-server.h>
 
+#include "ui_state_machine.h"
+#include "run_schedule.h"
+#include "cycle_history.h"
+
 using namespace chip;
 using namespace chip::app;
 using namespace chip::app::Clusters;
 using namespace chip::app::Clusters::OperationalState;
 
+// Everything that can happen to the dishwasher from outside the manager. These are
+// queued by whichever task they originate on and handled by the manager's own task.
+//
+struct DishwasherCommand
+{
+    enum Type : uint8_t
+    {
+        kOnOffClicked,
+        kStartClicked,
+        kWheelClicked,
+        kResetRequested,
+        kMoveSelection, // value is an int32_t, the entries to move by. Positive is forwards.
+        kStart,
+        kStop,
+        kPause,
+        kResume,
+        kChangeMode,
+        kAdjustStartTime,
+        kPowerOn,
+        kPowerOff,
+        kRunScheduled,
+    };
+
+    Type type;
+    uint32_t value;
+};
+
 class DishwasherManager
 {
 public:
+    // Changes that still need to be published by PublishChanges().
+    //
+    enum DirtyFlag : uint32_t
+    {
+        kDirtyState = 1 << 0,
+        kDirtyPhase = 1 << 1,
+        kDirtyMode = 1 << 2,
+        kDirtyCountdown = 1 << 3,
+        kDirtyForecast = 1 << 4,
+        kDirtyOptOut = 1 << 5,
+        kDirtyDisplay = 1 << 6,
+        kDirtyCheckpoint = 1 << 7,
+    };
+
     esp_err_t Init();
+
+    // Safe to call from any task; never blocks. Returns false if the queue was full.
+    //
+    bool PostCommand(DishwasherCommand::Type type, uint32_t value = 0);
+
+    // Only to be called on the Matter thread, these read the last published state.
+    //
+    uint32_t GetPublishedTimeRemaining();
+    bool IsPublishedPhasePausable();
+    OperationalStateEnum GetPublishedOperationalState();
+    uint8_t GetPublishedPhase();
+    uint8_t GetPublishedMode();
+    bool GetPublishedPowerState();
+
+private:
+    friend DishwasherManager &DishwasherMgr(void);
+
+    static DishwasherManager sDishwasher;
+
+    static void ManagerTask(void *arg);
+    static void ProgramTimerCallback(void *arg);
+
+    void HandleCommand(const DishwasherCommand &command);
+
     void UpdateDishwasherDisplay();
 
     void UpdateOperationState(OperationalStateEnum state);
 
-    void StartProgram();
+    // startTime is when, in UTC, the program should start running. Zero starts it
+    // straight away, or after a short delay if opted into energy management.
+    //
+    void StartProgram(uint32_t startTime = 0);
+    void StartScheduledRun();
     void StopProgram();
-    void PauseProgram();
+    bool PauseProgram();
     void ResumeProgram();
 
-    void HandleOnOffClicked();
-    void HandleStartClicked();
-    void PresentReset();
-
-    void SelectNext();
-    void SelectPrevious();
-    void HandleWheelClicked();
+    // Every UI event goes through the transition table in ui_state_machine.h.
+    //
+    void Dispatch(UiEvent event);
+    void RunAction(UiAction action);
+    void EnterScreen(UiScreen screen);
+    void ExitScreen(UiScreen screen);
 
-    OperationalStateEnum GetOperationalState();
+    bool IsPoweredOn() { return kUiStates[mUiState].poweredOn; }
+    bool IsProgramSelected() { return kUiStates[mUiState].programSelected; }
 
     uint32_t GetTimeRemaining();
+    uint32_t GetDelayedStartRemaining();
 
     void UpdateMode(uint8_t mode);
 
-    void SelectNextMode();
-    void SelectPreviousMode();
+    void MoveMode(int32_t entries);
 
-    uint8_t GetCurrentMode();
-
-    void TogglePower();
     void TurnOnPower();
     void TurnOffPower();
-    bool IsPoweredOn();
+    void ReportPowerState();
+    void ToggleOptIn();
 
     void ToggleProgram();
     void EndProgram();
     void ProgressProgram();
+    void LogCycle();
 
     void SetForecast();
     void ClearForecast();
     void AdjustStartTime(uint32_t new_start_time);
 
-private:
-    friend DishwasherManager &DishwasherMgr(void);
+    void AdvancePhase();
 
-    static DishwasherManager sDishwasher;
+    void RestoreCheckpoint();
+    void WriteCheckpoint();
+    void CaptureState(bool includeForecast);
+    void ScheduleNextDeadline();
 
-    void UpdateCurrentPhase(uint8_t phase);
+    void MarkDirty(uint32_t flags) { mDirty |= flags; }
+    void PublishChanges();
+    int64_t GetElapsedRunningTime(int64_t now);
 
     OperationalState::OperationalStateEnum mState;
     uint8_t mMode;
     uint8_t mPhase;
-    uint32_t mRunningTimeRemaining;
-    uint32_t mDelayedStartTimeRemaining;
+
+    // All times are esp_timer_get_time() microseconds, so the countdown is derived from
+    // a monotonic clock rather than counted down by a tick.
+    //
+    int64_t mDelayedStartAt = 0; // When the delayed start expires, or 0 if there isn't one
+    int64_t mRunStartedAt = 0;   // When the program started running
+    int64_t mPausedAt = 0;       // When the program was last paused
+    int64_t mPausedTotal = 0;    // Time spent paused, excluding any current pause
+    int64_t mPhaseEndsAt = 0;    // Running time at which the current phase ends
+    int64_t mPhaseStartedAt = 0; // Running time at which the current phase started
+
+    esp_timer_handle_t mProgramTimer = nullptr;
+    TaskHandle_t mTask = nullptr;
+    std::atomic<bool> mDeadlineExpired{false};
+
+    uint32_t mDirty = 0;
     bool mOptedIntoEnergyManagement = false;
 
     uint32_t mCurrentForecastId = 0;
     uint32_t mForecastStartTime = 0;
 
-    bool mIsShowingMenu = false;
-    bool mIsProgramSelected = false;
+    UiState mUiState = kUiOff;
+    ScheduledRun mScheduledRun = {};
+    int32_t mSelectionMove = 0; // What the last kMoveSelection moved by, for kActionMoveMode
 
-    bool mIsPoweredOn = false;
-    bool mIsShowingReset = false;
+    // The cycle that is running, logged to the CycleHistory when it stops.
+    //
+    bool mCycleInProgress = false;
+    CycleEndReason mCycleEndReason = kCycleStopped;
+    uint32_t mCycleStartTime = 0; // UTC, or 0 if not known
+    int32_t mCycleForecastDelta = 0;
 };
 
 inline DishwasherManager &DishwasherMgr(void)
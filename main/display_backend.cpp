@@ -0,0 +1,22 @@
+#include "display_backend.h"
+
+#if CONFIG_DISHWASHER_DISPLAY_EINK
+#include "eink_backend.h"
+#elif CONFIG_DISHWASHER_DISPLAY_FRAMEBUFFER
+#include "framebuffer_backend.h"
+#else
+#include "ssd1306_backend.h"
+#endif
+
+DisplayBackend &GetDisplayBackend()
+{
+#if CONFIG_DISHWASHER_DISPLAY_EINK
+    static EinkBackend sBackend;
+#elif CONFIG_DISHWASHER_DISPLAY_FRAMEBUFFER
+    static FramebufferBackend sBackend;
+#else
+    static Ssd1306Backend sBackend;
+#endif
+
+    return sBackend;
+}
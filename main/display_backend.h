@@ -0,0 +1,97 @@
+#pragma once
+
+#include <stdio.h>
+#include <esp_err.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "lvgl.h"
+
+#include <inttypes.h>
+
+// The hardware behind the StatusDisplay. Each backend brings up its panel and registers
+// it with LVGL, after which the StatusDisplay only ever talks to LVGL. The backend is
+// chosen with CONFIG_DISHWASHER_DISPLAY_BACKEND.
+//
+// Apart from Init and InitDirect, every method is called by the StatusDisplay's render
+// task, with lvgl_port_lock held unless LVGL isn't in use.
+//
+class DisplayBackend
+{
+public:
+    // How a captured frame is laid out. In both, a set bit is a light pixel.
+    //
+    enum CaptureLayout : uint8_t
+    {
+        kCaptureNone,  // The backend can't be captured
+        kCapturePages, // The SSD1306's pages: rows of bytes, each a column of eight pixels, LSB at the top
+        kCaptureRows,  // Rows of pixels, eight to a byte, MSB leftmost
+    };
+
+    struct CaptureFormat
+    {
+        CaptureLayout layout;
+        uint16_t width;
+        uint16_t height;
+    };
+
+    // The most any backend captures.
+    //
+#if CONFIG_DISHWASHER_DISPLAY_EINK
+    static constexpr size_t kMaxCaptureSize = 400 * 300 / 8;
+#else
+    static constexpr size_t kMaxCaptureSize = 128 * 64 / 8;
+#endif
+
+    struct Statistics
+    {
+        uint32_t flushes;          // Areas flushed by LVGL
+        uint32_t bytesRequested;   // Bytes of 1bpp image LVGL asked to send
+        uint32_t bytesSent;        // Bytes actually sent to the panel
+        uint32_t transfers;        // Separate writes to the panel
+        uint32_t fullRefreshes;    // E-ink only
+        uint32_t partialRefreshes; // E-ink only
+        uint32_t queueFull;        // Times a flush waited for the backend to catch up
+        uint32_t failures;         // Writes the panel didn't accept
+    };
+
+    virtual ~DisplayBackend() = default;
+
+    virtual const char *GetName() = 0;
+
+    // Called once lvgl_port_init has started LVGL, with lvgl_port_lock held. Returns the
+    // registered display, or nullptr if the panel couldn't be brought up.
+    //
+    virtual lv_disp_t *Init() = 0;
+
+    // With CONFIG_DISHWASHER_DISPLAY_DIRECT, LVGL isn't used at all. InitDirect brings
+    // the panel up instead, and Present shows whole 128x64 frames in the SSD1306's page
+    // layout, giving released once the frame may be drawn into again. Only backends with
+    // such a panel support it.
+    //
+    virtual esp_err_t InitDirect() { return ESP_ERR_NOT_SUPPORTED; }
+    virtual void Present(const uint8_t *frame, SemaphoreHandle_t released) { xSemaphoreGive(released); }
+
+    virtual void SetPower(bool on) = 0;
+
+    // The LVGL colour the panel shows as light. Monochrome OLEDs light black pixels, as
+    // esp_lvgl_port does, while e-ink leaves white ones as bare paper.
+    //
+    virtual lv_color_t GetLightColor() { return lv_color_black(); }
+
+    // True, once, if the panel may no longer show what LVGL thinks it does, in which
+    // case the whole screen should be invalidated.
+    //
+    virtual bool TakeResync() { return false; }
+
+    virtual Statistics GetStatistics() = 0;
+
+    // Copies what the panel shows, or will once pending transfers are done, into frame,
+    // which holds kMaxCaptureSize bytes. Nothing is kept for this, so it costs flushes
+    // nothing.
+    //
+    virtual CaptureFormat Capture(uint8_t *frame) { return {}; }
+};
+
+// Returns the backend selected in Kconfig. It is statically allocated.
+//
+DisplayBackend &GetDisplayBackend();
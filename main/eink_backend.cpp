@@ -0,0 +1,471 @@
+#include "eink_backend.h"
+
+#if CONFIG_DISHWASHER_DISPLAY_EINK
+
+#include "driver/gpio.h"
+#include "driver/spi_master.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include <string.h>
+
+#include <algorithm>
+
+static const char *TAG = "eink_backend";
+
+#define EINK_SPI_HOST SPI2_HOST
+#define EINK_PIXEL_CLOCK_HZ (10 * 1000 * 1000)
+
+// SSD1683 commands
+//
+#define SSD1683_DRIVER_OUTPUT 0x01
+#define SSD1683_DEEP_SLEEP 0x10
+#define SSD1683_DATA_ENTRY_MODE 0x11
+#define SSD1683_SW_RESET 0x12
+#define SSD1683_TEMPERATURE_SENSOR 0x18
+#define SSD1683_MASTER_ACTIVATION 0x20
+#define SSD1683_UPDATE_CONTROL_1 0x21
+#define SSD1683_UPDATE_CONTROL_2 0x22
+#define SSD1683_WRITE_RAM_BW 0x24
+#define SSD1683_WRITE_RAM_OLD 0x26
+#define SSD1683_BORDER_WAVEFORM 0x3C
+#define SSD1683_RAM_X_RANGE 0x44
+#define SSD1683_RAM_Y_RANGE 0x45
+#define SSD1683_RAM_X_COUNTER 0x4E
+#define SSD1683_RAM_Y_COUNTER 0x4F
+#define SSD1683_NOP 0x7F
+
+// Update sequences. The full one loads the waveform and drives every pixel through
+// black and white, which clears ghosting but flashes. The partial one only drives the
+// pixels that differ between the BW RAM and the old image in the RED RAM.
+//
+#define SSD1683_SEQUENCE_FULL 0xF7
+#define SSD1683_SEQUENCE_PARTIAL 0xFC
+
+lv_disp_t *EinkBackend::Init()
+{
+    ESP_LOGI(TAG, "Initialize SPI bus");
+
+    if (CONFIG_DISHWASHER_EINK_POWER_PIN >= 0)
+    {
+        gpio_set_direction((gpio_num_t)CONFIG_DISHWASHER_EINK_POWER_PIN, GPIO_MODE_OUTPUT);
+        gpio_set_level((gpio_num_t)CONFIG_DISHWASHER_EINK_POWER_PIN, 1);
+    }
+
+    gpio_set_direction((gpio_num_t)CONFIG_DISHWASHER_EINK_RST_PIN, GPIO_MODE_OUTPUT);
+    gpio_set_level((gpio_num_t)CONFIG_DISHWASHER_EINK_RST_PIN, 1);
+    gpio_set_direction((gpio_num_t)CONFIG_DISHWASHER_EINK_BUSY_PIN, GPIO_MODE_INPUT);
+
+    spi_bus_config_t bus_config = {};
+    bus_config.mosi_io_num = CONFIG_DISHWASHER_EINK_MOSI_PIN;
+    bus_config.miso_io_num = -1;
+    bus_config.sclk_io_num = CONFIG_DISHWASHER_EINK_SCK_PIN;
+    bus_config.quadwp_io_num = -1;
+    bus_config.quadhd_io_num = -1;
+    bus_config.max_transfer_sz = sizeof(mTransmit);
+
+    if (spi_bus_initialize(EINK_SPI_HOST, &bus_config, SPI_DMA_CH_AUTO) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to initialize SPI bus");
+        return nullptr;
+    }
+
+    ESP_LOGI(TAG, "Install panel IO");
+    esp_lcd_panel_io_spi_config_t io_config = {};
+    io_config.cs_gpio_num = CONFIG_DISHWASHER_EINK_CS_PIN;
+    io_config.dc_gpio_num = CONFIG_DISHWASHER_EINK_DC_PIN;
+    io_config.spi_mode = 0;
+    io_config.pclk_hz = EINK_PIXEL_CLOCK_HZ;
+    io_config.trans_queue_depth = 4;
+    io_config.lcd_cmd_bits = 8;
+    io_config.lcd_param_bits = 8;
+
+    if (esp_lcd_new_panel_io_spi((esp_lcd_spi_bus_handle_t)EINK_SPI_HOST, &io_config, &mIo) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to install panel IO");
+        return nullptr;
+    }
+
+    // Blank until LVGL draws something. A set bit is white.
+    //
+    memset(mFramebuffer, 0xFF, sizeof(mFramebuffer));
+    mLock = xSemaphoreCreateMutex();
+
+    // LVGL renders a strip at a time. The framebuffer is what holds the whole screen.
+    //
+    lv_color_t *buffer = (lv_color_t *)heap_caps_malloc(kEinkWidth * kDrawLines * sizeof(lv_color_t), MALLOC_CAP_DEFAULT);
+
+    if (mLock == nullptr || buffer == nullptr)
+    {
+        ESP_LOGE(TAG, "Out of memory");
+        return nullptr;
+    }
+
+    lv_disp_draw_buf_init(&mDrawBuffer, buffer, nullptr, kEinkWidth * kDrawLines);
+
+    lv_disp_drv_init(&mDriver);
+    mDriver.hor_res = kEinkWidth;
+    mDriver.ver_res = kEinkHeight;
+    mDriver.flush_cb = FlushCallback;
+    mDriver.draw_buf = &mDrawBuffer;
+    mDriver.user_data = this;
+
+    // Above LVGL's task, so a refresh starts as soon as a batch is complete.
+    //
+    xTaskCreate(RefreshTask, "EinkRefresh", 3072, this, tskIDLE_PRIORITY + 5, &mTask);
+
+    // The panel stays in reset until the display is first turned on.
+    //
+    return lv_disp_drv_register(&mDriver);
+}
+
+void EinkBackend::FlushCallback(lv_disp_drv_t *driver, const lv_area_t *area, lv_color_t *color_map)
+{
+    EinkBackend *backend = (EinkBackend *)driver->user_data;
+
+    backend->Flush(area, color_map);
+
+    // The strip has been copied, so LVGL can carry on with the next one.
+    //
+    lv_disp_flush_ready(driver);
+}
+
+void EinkBackend::Flush(const lv_area_t *area, const lv_color_t *color_map)
+{
+    xSemaphoreTake(mLock, portMAX_DELAY);
+
+    for (int32_t y = area->y1; y <= area->y2; y++)
+    {
+        uint8_t *row = mFramebuffer[y];
+
+        for (int32_t x = area->x1; x <= area->x2; x++, color_map++)
+        {
+            uint8_t bit = 0x80 >> (x & 7);
+
+            if (lv_color_brightness(*color_map) > 127)
+            {
+                row[x >> 3] |= bit;
+            }
+            else
+            {
+                row[x >> 3] &= ~bit;
+            }
+        }
+    }
+
+    mDirtyX1 = std::min<uint16_t>(mDirtyX1, area->x1);
+    mDirtyY1 = std::min<uint16_t>(mDirtyY1, area->y1);
+    mDirtyX2 = std::max<uint16_t>(mDirtyX2, area->x2);
+    mDirtyY2 = std::max<uint16_t>(mDirtyY2, area->y2);
+
+    xSemaphoreGive(mLock);
+
+    portENTER_CRITICAL(&mStatisticsLock);
+    mStatistics.flushes++;
+    mStatistics.bytesRequested += ((area->x2 / 8) - (area->x1 / 8) + 1) * (area->y2 - area->y1 + 1);
+    portEXIT_CRITICAL(&mStatisticsLock);
+
+    xTaskNotifyGive(mTask);
+}
+
+void EinkBackend::SetPower(bool on)
+{
+    xSemaphoreTake(mLock, portMAX_DELAY);
+    mPendingOn = on;
+    xSemaphoreGive(mLock);
+
+    xTaskNotifyGive(mTask);
+}
+
+void EinkBackend::RefreshTask(void *arg)
+{
+    EinkBackend *backend = (EinkBackend *)arg;
+
+    const TickType_t batch = pdMS_TO_TICKS(CONFIG_DISHWASHER_EINK_BATCH_MS);
+
+    while (1)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        // Wait for the changes to settle, so they all go in one refresh. A steady stream
+        // of them only holds the refresh off for so long.
+        //
+        TickType_t started = xTaskGetTickCount();
+
+        while ((xTaskGetTickCount() - started) < (4 * batch) && ulTaskNotifyTake(pdTRUE, batch) > 0)
+        {
+        }
+
+        backend->Refresh();
+    }
+}
+
+void EinkBackend::Refresh()
+{
+    xSemaphoreTake(mLock, portMAX_DELAY);
+    bool on = mPendingOn;
+    xSemaphoreGive(mLock);
+
+    esp_err_t err = ESP_OK;
+
+    if (on && !mOn)
+    {
+        ESP_LOGI(TAG, "Waking panel");
+
+        err = Reset();
+        mOn = true;
+        mNeedsFull = true;
+    }
+    else if (!on && mOn)
+    {
+        // The panel holds its image without power, so it is cleared before it sleeps.
+        // The framebuffer is kept, ready for when it wakes.
+        //
+        ESP_LOGI(TAG, "Clearing panel");
+
+        memset(mTransmit, 0xFF, sizeof(mTransmit));
+
+        err = WriteWindow(SSD1683_WRITE_RAM_BW, 0, 0, kEinkWidth - 1, kEinkHeight - 1);
+        err = err == ESP_OK ? WriteWindow(SSD1683_WRITE_RAM_OLD, 0, 0, kEinkWidth - 1, kEinkHeight - 1) : err;
+        err = err == ESP_OK ? FullRefresh() : err;
+        err = err == ESP_OK ? Sleep() : err;
+
+        mOn = false;
+        mNeedsFull = true;
+    }
+
+    if (!mOn || err != ESP_OK)
+    {
+        // Whatever is dirty stays dirty until the panel is on.
+        //
+        if (err != ESP_OK)
+        {
+            mNeedsFull = true;
+        }
+
+        return;
+    }
+
+    xSemaphoreTake(mLock, portMAX_DELAY);
+
+    if (mDirtyX1 > mDirtyX2 && !mNeedsFull)
+    {
+        xSemaphoreGive(mLock);
+        return;
+    }
+
+    // The panel's RAM is addressed in whole bytes across.
+    //
+    uint16_t x1 = mDirtyX1 & ~7;
+    uint16_t x2 = mDirtyX2 | 7;
+    uint16_t y1 = mDirtyY1;
+    uint16_t y2 = mDirtyY2;
+    uint32_t area = (x2 - x1 + 1) * (y2 - y1 + 1);
+
+    bool full = mNeedsFull || mPartialsSinceFull >= CONFIG_DISHWASHER_EINK_FULL_REFRESH_INTERVAL || (mAreaSinceFull + area) > kGhostingArea;
+
+    if (full)
+    {
+        x1 = 0;
+        y1 = 0;
+        x2 = kEinkWidth - 1;
+        y2 = kEinkHeight - 1;
+    }
+
+    // Copy the window out, so LVGL can carry on drawing whilst it is sent.
+    //
+    uint16_t columns = (x2 - x1 + 1) / 8;
+    uint8_t *out = mTransmit;
+
+    for (uint16_t y = y1; y <= y2; y++, out += columns)
+    {
+        memcpy(out, &mFramebuffer[y][x1 / 8], columns);
+    }
+
+    mDirtyX1 = kEinkWidth;
+    mDirtyY1 = kEinkHeight;
+    mDirtyX2 = 0;
+    mDirtyY2 = 0;
+
+    xSemaphoreGive(mLock);
+
+    if (full)
+    {
+        // Both RAMs get the image, so the next partial refresh has the right old one.
+        //
+        err = WriteWindow(SSD1683_WRITE_RAM_BW, x1, y1, x2, y2);
+        err = err == ESP_OK ? WriteWindow(SSD1683_WRITE_RAM_OLD, x1, y1, x2, y2) : err;
+        err = err == ESP_OK ? FullRefresh() : err;
+
+        mPartialsSinceFull = 0;
+        mAreaSinceFull = 0;
+    }
+    else
+    {
+        err = PartialRefresh(x1, y1, x2, y2);
+
+        mPartialsSinceFull++;
+        mAreaSinceFull += area;
+    }
+
+    mNeedsFull = err != ESP_OK;
+}
+
+esp_err_t EinkBackend::Command(uint8_t command, const uint8_t *data, size_t length)
+{
+    return esp_lcd_panel_io_tx_param(mIo, command, data, length);
+}
+
+esp_err_t EinkBackend::WaitWhileBusy()
+{
+    // BUSY is high whilst the controller is working. A refresh takes up to a few seconds.
+    //
+    for (uint32_t waited = 0; gpio_get_level((gpio_num_t)CONFIG_DISHWASHER_EINK_BUSY_PIN) == 1; waited += 10)
+    {
+        if (waited >= kBusyTimeoutMs)
+        {
+            ESP_LOGW(TAG, "Panel stuck busy");
+            return ESP_ERR_TIMEOUT;
+        }
+
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t EinkBackend::Reset()
+{
+    // A hardware reset is the only way out of deep sleep.
+    //
+    gpio_set_level((gpio_num_t)CONFIG_DISHWASHER_EINK_RST_PIN, 0);
+    vTaskDelay(pdMS_TO_TICKS(10));
+    gpio_set_level((gpio_num_t)CONFIG_DISHWASHER_EINK_RST_PIN, 1);
+    vTaskDelay(pdMS_TO_TICKS(10));
+
+    esp_err_t err = Command(SSD1683_SW_RESET);
+    err = err == ESP_OK ? WaitWhileBusy() : err;
+
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+
+    const uint8_t driverOutput[] = { (kEinkHeight - 1) & 0xFF, (kEinkHeight - 1) >> 8, 0x00 };
+    const uint8_t borderWaveform[] = { 0x05 };
+    const uint8_t temperatureSensor[] = { 0x80 }; // Internal
+
+    err = Command(SSD1683_DRIVER_OUTPUT, driverOutput, sizeof(driverOutput));
+    err = err == ESP_OK ? Command(SSD1683_BORDER_WAVEFORM, borderWaveform, sizeof(borderWaveform)) : err;
+    err = err == ESP_OK ? Command(SSD1683_TEMPERATURE_SENSOR, temperatureSensor, sizeof(temperatureSensor)) : err;
+
+    return err;
+}
+
+esp_err_t EinkBackend::SetWindow(uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2)
+{
+    const uint8_t entryMode[] = { 0x03 }; // X then Y, both incrementing
+    const uint8_t xRange[] = { (uint8_t)(x1 / 8), (uint8_t)(x2 / 8) };
+    const uint8_t yRange[] = { (uint8_t)(y1 & 0xFF), (uint8_t)(y1 >> 8), (uint8_t)(y2 & 0xFF), (uint8_t)(y2 >> 8) };
+    const uint8_t yCounter[] = { (uint8_t)(y1 & 0xFF), (uint8_t)(y1 >> 8) };
+
+    esp_err_t err = Command(SSD1683_DATA_ENTRY_MODE, entryMode, sizeof(entryMode));
+    err = err == ESP_OK ? Command(SSD1683_RAM_X_RANGE, xRange, sizeof(xRange)) : err;
+    err = err == ESP_OK ? Command(SSD1683_RAM_Y_RANGE, yRange, sizeof(yRange)) : err;
+    err = err == ESP_OK ? Command(SSD1683_RAM_X_COUNTER, xRange, 1) : err;
+    err = err == ESP_OK ? Command(SSD1683_RAM_Y_COUNTER, yCounter, sizeof(yCounter)) : err;
+
+    return err;
+}
+
+esp_err_t EinkBackend::WriteWindow(uint8_t command, uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2)
+{
+    size_t length = ((x2 - x1 + 1) / 8) * (y2 - y1 + 1);
+
+    esp_err_t err = SetWindow(x1, y1, x2, y2);
+
+    // Sent by DMA, and only waited for by the next command. Every caller follows it with
+    // one before mTransmit can be touched again.
+    //
+    err = err == ESP_OK ? esp_lcd_panel_io_tx_color(mIo, command, mTransmit, length) : err;
+
+    portENTER_CRITICAL(&mStatisticsLock);
+    mStatistics.transfers++;
+    mStatistics.bytesSent += length;
+    mStatistics.failures += err != ESP_OK;
+    portEXIT_CRITICAL(&mStatisticsLock);
+
+    return err;
+}
+
+esp_err_t EinkBackend::FullRefresh()
+{
+    const uint8_t control[] = { 0x40, 0x00 }; // Treat the old image as all white
+    const uint8_t sequence[] = { SSD1683_SEQUENCE_FULL };
+
+    esp_err_t err = Command(SSD1683_UPDATE_CONTROL_1, control, sizeof(control));
+    err = err == ESP_OK ? Command(SSD1683_UPDATE_CONTROL_2, sequence, sizeof(sequence)) : err;
+    err = err == ESP_OK ? Command(SSD1683_MASTER_ACTIVATION) : err;
+    err = err == ESP_OK ? WaitWhileBusy() : err;
+
+    portENTER_CRITICAL(&mStatisticsLock);
+    mStatistics.fullRefreshes++;
+    portEXIT_CRITICAL(&mStatisticsLock);
+
+    return err;
+}
+
+esp_err_t EinkBackend::PartialRefresh(uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2)
+{
+    const uint8_t control[] = { 0x00, 0x00 }; // Compare against the old image
+    const uint8_t sequence[] = { SSD1683_SEQUENCE_PARTIAL };
+
+    esp_err_t err = WriteWindow(SSD1683_WRITE_RAM_BW, x1, y1, x2, y2);
+    err = err == ESP_OK ? Command(SSD1683_UPDATE_CONTROL_1, control, sizeof(control)) : err;
+    err = err == ESP_OK ? Command(SSD1683_UPDATE_CONTROL_2, sequence, sizeof(sequence)) : err;
+    err = err == ESP_OK ? Command(SSD1683_MASTER_ACTIVATION) : err;
+    err = err == ESP_OK ? WaitWhileBusy() : err;
+
+    // What is showing now becomes the old image for the next partial refresh. The NOP
+    // waits for that write to finish, as the next Refresh refills mTransmit however soon
+    // it comes.
+    //
+    err = err == ESP_OK ? WriteWindow(SSD1683_WRITE_RAM_OLD, x1, y1, x2, y2) : err;
+    err = err == ESP_OK ? Command(SSD1683_NOP) : err;
+
+    portENTER_CRITICAL(&mStatisticsLock);
+    mStatistics.partialRefreshes++;
+    portEXIT_CRITICAL(&mStatisticsLock);
+
+    return err;
+}
+
+esp_err_t EinkBackend::Sleep()
+{
+    const uint8_t mode[] = { 0x01 };
+
+    return Command(SSD1683_DEEP_SLEEP, mode, sizeof(mode));
+}
+
+DisplayBackend::CaptureFormat EinkBackend::Capture(uint8_t *frame)
+{
+    static_assert(sizeof(mFramebuffer) <= kMaxCaptureSize, "kMaxCaptureSize must hold the e-ink framebuffer");
+
+    // The framebuffer already uses the panel's convention, with a set bit white.
+    //
+    xSemaphoreTake(mLock, portMAX_DELAY);
+    memcpy(frame, mFramebuffer, sizeof(mFramebuffer));
+    xSemaphoreGive(mLock);
+
+    return { kCaptureRows, kEinkWidth, kEinkHeight };
+}
+
+DisplayBackend::Statistics EinkBackend::GetStatistics()
+{
+    portENTER_CRITICAL(&mStatisticsLock);
+    Statistics statistics = mStatistics;
+    portEXIT_CRITICAL(&mStatisticsLock);
+
+    return statistics;
+}
+
+#endif // CONFIG_DISHWASHER_DISPLAY_EINK
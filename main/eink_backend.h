@@ -0,0 +1,89 @@
+#pragma once
+
+#include "display_backend.h"
+#include "esp_lcd_panel_io.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+constexpr uint16_t kEinkWidth = 400;
+constexpr uint16_t kEinkHeight = 300;
+
+// A 4.2" 400x300 black and white e-ink panel with an SSD1683 controller on SPI, as fitted
+// to the CrowPanel 4.2".
+//
+// LVGL renders into a small strip buffer, which each flush packs into a 1bpp framebuffer
+// and hands straight back. The panel is only refreshed by a task of its own, once changes
+// have stopped arriving for CONFIG_DISHWASHER_EINK_BATCH_MS, so a burst of flushes costs a
+// single refresh.
+//
+// Refreshes are partial wherever possible: only the window around what changed is sent,
+// and the panel drives just the pixels that differ, which takes a fraction of the time of a
+// full refresh and doesn't flash. Partial refreshes leave a little ghosting behind, so a
+// full refresh is made after CONFIG_DISHWASHER_EINK_FULL_REFRESH_INTERVAL partials, or
+// sooner once the partials have between them covered the screen a few times over.
+//
+class EinkBackend : public DisplayBackend
+{
+public:
+    const char *GetName() override { return "SSD1683 e-ink"; }
+
+    lv_disp_t *Init() override;
+    void SetPower(bool on) override;
+    lv_color_t GetLightColor() override { return lv_color_white(); }
+    Statistics GetStatistics() override;
+    CaptureFormat Capture(uint8_t *frame) override;
+
+private:
+    static constexpr uint16_t kStride = kEinkWidth / 8;
+    static constexpr uint16_t kDrawLines = 20;
+    static constexpr uint32_t kBusyTimeoutMs = 5000;
+
+    // A full refresh is forced once the partial refreshes since the last one have
+    // redrawn this many screens' worth of pixels.
+    //
+    static constexpr uint32_t kGhostingArea = 3 * kEinkWidth * kEinkHeight;
+
+    static void FlushCallback(lv_disp_drv_t *driver, const lv_area_t *area, lv_color_t *color_map);
+    static void RefreshTask(void *arg);
+
+    void Flush(const lv_area_t *area, const lv_color_t *color_map);
+    void Refresh();
+
+    esp_err_t Command(uint8_t command, const uint8_t *data = nullptr, size_t length = 0);
+    esp_err_t WaitWhileBusy();
+    esp_err_t Reset();
+    esp_err_t SetWindow(uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2);
+    esp_err_t WriteWindow(uint8_t command, uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2);
+    esp_err_t FullRefresh();
+    esp_err_t PartialRefresh(uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2);
+    esp_err_t Sleep();
+
+    esp_lcd_panel_io_handle_t mIo = nullptr;
+    TaskHandle_t mTask = nullptr;
+
+    lv_disp_draw_buf_t mDrawBuffer;
+    lv_disp_drv_t mDriver;
+
+    // Written by LVGL's flushes and read by the refresh task, under mLock. The dirty
+    // area is inclusive, and empty when mDirtyX1 > mDirtyX2.
+    //
+    SemaphoreHandle_t mLock = nullptr;
+    uint8_t mFramebuffer[kEinkHeight][kStride];
+    uint16_t mDirtyX1 = kEinkWidth;
+    uint16_t mDirtyY1 = kEinkHeight;
+    uint16_t mDirtyX2 = 0;
+    uint16_t mDirtyY2 = 0;
+    bool mPendingOn = false;
+
+    // Only used by the refresh task.
+    //
+    uint8_t mTransmit[kEinkHeight * kStride]; // The window being sent, as the panel wants it
+    bool mOn = false;
+    bool mNeedsFull = true; // Nothing is known about what the panel shows
+    uint32_t mPartialsSinceFull = 0;
+    uint32_t mAreaSinceFull = 0;
+
+    portMUX_TYPE mStatisticsLock = portMUX_INITIALIZER_UNLOCKED;
+    Statistics mStatistics = {};
+};
@@ -0,0 +1,127 @@
+#include "framebuffer_backend.h"
+
+#if CONFIG_DISHWASHER_DISPLAY_FRAMEBUFFER
+
+#include "esp_log.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+static const char *TAG = "framebuffer_backend";
+
+lv_disp_t *FramebufferBackend::Init()
+{
+#if CONFIG_DISHWASHER_DISPLAY_DIRECT
+    return nullptr;
+#else
+    ESP_LOGI(TAG, "Using an in-memory %dx%d framebuffer", kFramebufferWidth, kFramebufferHeight);
+
+    lv_disp_draw_buf_init(&mDrawBuffer, mDrawPixels, nullptr, kFramebufferWidth * kFramebufferHeight);
+
+    lv_disp_drv_init(&mDriver);
+    mDriver.hor_res = kFramebufferWidth;
+    mDriver.ver_res = kFramebufferHeight;
+    mDriver.flush_cb = FlushCallback;
+    mDriver.draw_buf = &mDrawBuffer;
+    mDriver.user_data = this;
+
+    return lv_disp_drv_register(&mDriver);
+#endif
+}
+
+esp_err_t FramebufferBackend::InitDirect()
+{
+    ESP_LOGI(TAG, "Using an in-memory %dx%d framebuffer, drawn directly", kFramebufferWidth, kFramebufferHeight);
+
+    return ESP_OK;
+}
+
+void FramebufferBackend::Present(const uint8_t *frame, SemaphoreHandle_t released)
+{
+    uint32_t changed = 0;
+    uint8_t *framebuffer = &mFramebuffer[0][0];
+
+    for (size_t i = 0; i < sizeof(mFramebuffer); i++)
+    {
+        changed += framebuffer[i] != frame[i];
+    }
+
+    memcpy(framebuffer, frame, sizeof(mFramebuffer));
+
+    portENTER_CRITICAL(&mStatisticsLock);
+    mStatistics.flushes++;
+    mStatistics.transfers++;
+    mStatistics.bytesRequested += sizeof(mFramebuffer);
+    mStatistics.bytesSent += changed;
+    portEXIT_CRITICAL(&mStatisticsLock);
+
+    xSemaphoreGive(released);
+}
+
+void FramebufferBackend::FlushCallback(lv_disp_drv_t *driver, const lv_area_t *area, lv_color_t *color_map)
+{
+    ((FramebufferBackend *)driver->user_data)->Flush(area, color_map);
+
+    lv_disp_flush_ready(driver);
+}
+
+void FramebufferBackend::Flush(const lv_area_t *area, const lv_color_t *color_map)
+{
+    uint32_t changed = 0;
+
+    // Rebuilt a page at a time, so changes are counted in the panel's own bytes.
+    //
+    for (int32_t page = area->y1 / 8; page <= area->y2 / 8; page++)
+    {
+        for (int32_t x = area->x1; x <= area->x2; x++)
+        {
+            uint8_t byte = mFramebuffer[page][x];
+
+            for (int32_t y = std::max<int32_t>(page * 8, area->y1); y <= std::min<int32_t>((page * 8) + 7, area->y2); y++)
+            {
+                const lv_color_t &color = color_map[((y - area->y1) * lv_area_get_width(area)) + (x - area->x1)];
+                uint8_t bit = 1 << (y & 7);
+
+                // Dark pixels are lit, as esp_lvgl_port does for monochrome panels.
+                //
+                if (lv_color_brightness(color) < 128)
+                {
+                    byte |= bit;
+                }
+                else
+                {
+                    byte &= ~bit;
+                }
+            }
+
+            changed += byte != mFramebuffer[page][x];
+            mFramebuffer[page][x] = byte;
+        }
+    }
+
+    portENTER_CRITICAL(&mStatisticsLock);
+    mStatistics.flushes++;
+    mStatistics.transfers++;
+    mStatistics.bytesRequested += ((area->y2 / 8) - (area->y1 / 8) + 1) * lv_area_get_width(area);
+    mStatistics.bytesSent += changed;
+    portEXIT_CRITICAL(&mStatisticsLock);
+}
+
+DisplayBackend::CaptureFormat FramebufferBackend::Capture(uint8_t *frame)
+{
+    memcpy(frame, mFramebuffer, sizeof(mFramebuffer));
+
+    return { kCapturePages, kFramebufferWidth, kFramebufferHeight };
+}
+
+DisplayBackend::Statistics FramebufferBackend::GetStatistics()
+{
+    portENTER_CRITICAL(&mStatisticsLock);
+    Statistics statistics = mStatistics;
+    portEXIT_CRITICAL(&mStatisticsLock);
+
+    return statistics;
+}
+
+#endif // CONFIG_DISHWASHER_DISPLAY_FRAMEBUFFER
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "display_backend.h"
+
+constexpr uint16_t kFramebufferWidth = 128;
+constexpr uint16_t kFramebufferHeight = 64;
+constexpr uint16_t kFramebufferPages = kFramebufferHeight / 8;
+
+// A display with no hardware behind it, for a board with no panel attached. LVGL renders
+// into an in-memory 1bpp framebuffer the size of the SSD1306, laid out the way the SSD1306's RAM
+// is, so what the device would show can be checked and the cost of rendering measured.
+//
+// bytesSent counts the bytes of the framebuffer each flush actually changed, which is
+// what an SSD1306 behind PanelFlush would be sent.
+//
+class FramebufferBackend : public DisplayBackend
+{
+public:
+    const char *GetName() override { return "Framebuffer"; }
+
+    lv_disp_t *Init() override;
+    esp_err_t InitDirect() override;
+    void Present(const uint8_t *frame, SemaphoreHandle_t released) override;
+    void SetPower(bool on) override { mOn = on; }
+    Statistics GetStatistics() override;
+    CaptureFormat Capture(uint8_t *frame) override;
+
+    // Eight rows (pages) of bytes, each byte a column of eight pixels, least significant
+    // bit at the top. A set bit is lit. Read with lvgl_port_lock held, or from the render
+    // task when drawing directly.
+    //
+    const uint8_t *GetFramebuffer() { return &mFramebuffer[0][0]; }
+    bool IsOn() { return mOn; }
+
+private:
+    static void FlushCallback(lv_disp_drv_t *driver, const lv_area_t *area, lv_color_t *color_map);
+
+    void Flush(const lv_area_t *area, const lv_color_t *color_map);
+
+    lv_disp_draw_buf_t mDrawBuffer;
+    lv_disp_drv_t mDriver;
+    lv_color_t mDrawPixels[kFramebufferWidth * kFramebufferHeight];
+
+    uint8_t mFramebuffer[kFramebufferPages][kFramebufferWidth] = {};
+    bool mOn = false;
+
+    portMUX_TYPE mStatisticsLock = portMUX_INITIALIZER_UNLOCKED;
+    Statistics mStatistics = {};
+};
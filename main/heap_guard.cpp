@@ -0,0 +1,54 @@
+#include "heap_guard.h"
+
+#if CONFIG_DISHWASHER_ASSERT_NO_DISPLAY_ALLOC
+
+#include <esp_attr.h>
+#include <esp_heap_caps.h>
+#include <esp_system.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+// Scopes are open on more than one task at once, such as the render task and the
+// manager's, so each task keeps its own depth in a thread local storage pointer. Index 0
+// is pthread's.
+//
+#define HEAP_GUARD_TLS_INDEX 1
+
+static_assert(CONFIG_FREERTOS_THREAD_LOCAL_STORAGE_POINTERS > HEAP_GUARD_TLS_INDEX,
+              "CONFIG_DISHWASHER_ASSERT_NO_DISPLAY_ALLOC needs CONFIG_FREERTOS_THREAD_LOCAL_STORAGE_POINTERS of at least 2");
+
+static inline uint32_t IRAM_ATTR GetScopeDepth()
+{
+    return (uint32_t)(uintptr_t)pvTaskGetThreadLocalStoragePointer(NULL, HEAP_GUARD_TLS_INDEX);
+}
+
+static inline void SetScopeDepth(uint32_t depth)
+{
+    vTaskSetThreadLocalStoragePointer(NULL, HEAP_GUARD_TLS_INDEX, (void *)(uintptr_t)depth);
+}
+
+NoHeapScope::NoHeapScope()
+{
+    SetScopeDepth(GetScopeDepth() + 1);
+}
+
+NoHeapScope::~NoHeapScope()
+{
+    SetScopeDepth(GetScopeDepth() - 1);
+}
+
+// Called by the heap for every allocation when CONFIG_HEAP_USE_HOOKS is set.
+//
+extern "C" void IRAM_ATTR esp_heap_trace_alloc_hook(void *ptr, size_t size, uint32_t caps)
+{
+    if (!xPortInIsrContext() && xTaskGetSchedulerState() != taskSCHEDULER_NOT_STARTED && GetScopeDepth() > 0)
+    {
+        esp_system_abort("Heap allocation on the display refresh path");
+    }
+}
+
+extern "C" void IRAM_ATTR esp_heap_trace_free_hook(void *ptr)
+{
+}
+
+#endif // CONFIG_DISHWASHER_ASSERT_NO_DISPLAY_ALLOC
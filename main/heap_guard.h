@@ -0,0 +1,26 @@
+#pragma once
+
+#include <sdkconfig.h>
+
+// Marks code that must never touch the heap, such as the display refresh path. With
+// CONFIG_DISHWASHER_ASSERT_NO_DISPLAY_ALLOC, any allocation made by the same task whilst a
+// NoHeapScope is alive aborts with a backtrace pointing at it. Otherwise it costs nothing.
+//
+#if CONFIG_DISHWASHER_ASSERT_NO_DISPLAY_ALLOC
+
+class NoHeapScope
+{
+public:
+    NoHeapScope();
+    ~NoHeapScope();
+};
+
+#else
+
+class NoHeapScope
+{
+public:
+    NoHeapScope() {}
+};
+
+#endif
@@ -1,86 +1,178 @@
 #include "mode_selector.h"
+#include <esp_attr.h>
 #include <esp_err.h>
 #include <esp_log.h>
+#include <esp_timer.h>
+#include <stdlib.h>
 #include <string.h>
 
-#include <driver/pulse_cnt.h>
 #include <driver/gpio.h>
 
-#include <freertos/FreeRTOS.h>
-#include <freertos/task.h>
-#include <freertos/queue.h>
-
 #include "dishwasher_manager.h"
 
-#define EXAMPLE_PCNT_HIGH_LIMIT 100
-#define EXAMPLE_PCNT_LOW_LIMIT -100
+// The unit counts both edges of both channels, so a full quadrature cycle is four.
+//
+#define MODE_SELECTOR_DETENT CONFIG_DISHWASHER_ENCODER_PULSES_PER_DETENT
+#define MODE_SELECTOR_ACCELERATION_SPEED CONFIG_DISHWASHER_ENCODER_ACCELERATION_SPEED
 
 static const char *TAG = "mode_selector";
 
-static pcnt_unit_handle_t pcnt_unit = NULL;
-static QueueHandle_t gpio_pulse_evt_queue = NULL;
+ModeSelector ModeSelector::sModeSelector;
 
-static int current_pulse_count = 0;
-static int pulse_count = 0;
-static int event_count = 0;
+bool IRAM_ATTR ModeSelector::OnReach(pcnt_unit_handle_t unit, const pcnt_watch_event_data_t *event, void *context)
+{
+    ModeSelector *selector = static_cast<ModeSelector *>(context);
+    int64_t now = esp_timer_get_time();
 
-ModeSelector ModeSelector::sModeSelector;
+    portENTER_CRITICAL_ISR(&selector->mStatisticsLock);
+    selector->mStatistics.interrupts++;
+
+    if (selector->mInterruptAt == 0)
+    {
+        selector->mInterruptAt = now;
+    }
 
-#define EXAMPLE_PCNT_HIGH_LIMIT 100
-#define EXAMPLE_PCNT_LOW_LIMIT -100
+    selector->mLatestAt = now;
+    portEXIT_CRITICAL_ISR(&selector->mStatisticsLock);
 
-static void pulse_counter_monitor_task(void *arg)
+    BaseType_t woken = pdFALSE;
+    vTaskNotifyGiveFromISR(selector->mTask, &woken);
+
+    return woken == pdTRUE;
+}
+
+void ModeSelector::MonitorTask(void *arg)
 {
-    while (1)
+    while (true)
     {
-        //ESP_LOGD(TAG, "Waiting for event on pulse_evt_queue");
-
-        if (xQueueReceive(gpio_pulse_evt_queue, &event_count, pdMS_TO_TICKS(200)))
-        {
-            //ESP_LOGD(TAG, "Watch point event, count: %d", event_count);
-        }
-        else
-        {
-            ESP_ERROR_CHECK(pcnt_unit_get_count(pcnt_unit, &pulse_count));
-            //ESP_LOGD(TAG, "Current pulse count: %d", pulse_count);
-
-            if (pulse_count != current_pulse_count)
-            {
-                int pulse_difference = pulse_count - current_pulse_count;
-
-                current_pulse_count = pulse_count;
-
-                // ESP_LOGI(TAG, "Pulse Difference: %d", pulse_difference);
-
-                if (pulse_difference < 0)
-                {
-                    DishwasherMgr().SelectNext();
-                }
-                else
-                {
-                    DishwasherMgr().SelectPrevious();
-                }
-            }
-        }
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        sModeSelector.HandleDetents();
+    }
+}
+
+void ModeSelector::HandleDetents()
+{
+    // The accumulated count, including any part of a detent since the last interrupt.
+    //
+    int count = 0;
+    ESP_ERROR_CHECK(pcnt_unit_get_count(mUnit, &count));
+
+    portENTER_CRITICAL(&mStatisticsLock);
+    int64_t interruptAt = mInterruptAt;
+    int64_t latestAt = mLatestAt;
+    mInterruptAt = 0;
+    portEXIT_CRITICAL(&mStatisticsLock);
+
+    int detents = (count - mReported) / MODE_SELECTOR_DETENT;
+    bool accelerated = false;
+    int32_t entries = Decode(count, latestAt, accelerated);
+
+    // Turning the count down selects the next entry.
+    //
+    if (entries != 0)
+    {
+        DishwasherMgr().PostCommand(DishwasherCommand::kMoveSelection, (uint32_t)-entries);
+    }
+
+    int64_t now = esp_timer_get_time();
+
+    portENTER_CRITICAL(&mStatisticsLock);
+    mStatistics.wakeups++;
+    mStatistics.count = count;
+
+    if (entries == 0)
+    {
+        mStatistics.idleWakeups++;
+    }
+    else
+    {
+        mStatistics.detents += abs(detents);
+        mStatistics.entries += abs(entries);
+        mStatistics.accelerated += accelerated ? 1 : 0;
+        mStatistics.commands++;
+    }
+
+    if (entries != 0 && interruptAt != 0)
+    {
+        uint32_t latency = now - interruptAt;
+
+        mStatistics.latencyTotal += latency;
+        mStatistics.latencyMax = latency > mStatistics.latencyMax ? latency : mStatistics.latencyMax;
     }
+    portEXIT_CRITICAL(&mStatisticsLock);
+}
+
+int32_t ModeSelector::Decode(int count, int64_t at, bool &accelerated)
+{
+    // Only whole detents count, measured from the last one reported, so a wheel that
+    // bounces either side of a detent moves nothing until it reaches the next.
+    //
+    int detents = (count - mReported) / MODE_SELECTOR_DETENT;
+
+    if (detents == 0)
+    {
+        return 0;
+    }
+
+    mReported += detents * MODE_SELECTOR_DETENT;
+
+    int direction = detents > 0 ? 1 : -1;
+    int multiplier = 1;
+
+    // The speed is taken over the detents since the last move, and only while the wheel
+    // keeps turning the same way, so the first detent after a pause or a change of
+    // direction is never accelerated.
+    //
+    if (MODE_SELECTOR_ACCELERATION_SPEED > 0 && direction == mDirection && mDetentAt != 0)
+    {
+        int64_t interval = at - mDetentAt;
+        int64_t speed = interval > 0 ? (abs(detents) * 1000000LL) / interval : INT32_MAX; // Detents per second
+
+        multiplier = speed / MODE_SELECTOR_ACCELERATION_SPEED;
+        multiplier = multiplier < 1 ? 1 : (multiplier > kMaxAcceleration ? kMaxAcceleration : multiplier);
+    }
+
+    mDirection = direction;
+    mDetentAt = at;
+    accelerated = multiplier > 1;
+
+    return detents * multiplier;
+}
+
+ModeSelector::Statistics ModeSelector::GetStatistics()
+{
+    portENTER_CRITICAL(&mStatisticsLock);
+    Statistics statistics = mStatistics;
+    portEXIT_CRITICAL(&mStatisticsLock);
+
+    return statistics;
 }
 
 esp_err_t ModeSelector::Init()
 {
     ESP_LOGI(TAG, "install pcnt unit");
 
+    // The limits are the detent watch points. The count goes back to zero each time it
+    // reaches one, and accum_count has the driver add the limit to the accumulated count
+    // that pcnt_unit_get_count returns.
+    //
     pcnt_unit_config_t unit_config = {
-        .low_limit = EXAMPLE_PCNT_LOW_LIMIT,
-        .high_limit = EXAMPLE_PCNT_HIGH_LIMIT,
-        .intr_priority = 1};
+        .low_limit = -MODE_SELECTOR_DETENT,
+        .high_limit = MODE_SELECTOR_DETENT,
+        .intr_priority = 1,
+        .flags = {
+            .accum_count = 1,
+        },
+    };
 
-    ESP_ERROR_CHECK(pcnt_new_unit(&unit_config, &pcnt_unit));
+    ESP_ERROR_CHECK(pcnt_new_unit(&unit_config, &mUnit));
 
     ESP_LOGI(TAG, "set glitch filter");
     pcnt_glitch_filter_config_t filter_config = {
         .max_glitch_ns = 1000,
     };
-    ESP_ERROR_CHECK(pcnt_unit_set_glitch_filter(pcnt_unit, &filter_config));
+    ESP_ERROR_CHECK(pcnt_unit_set_glitch_filter(mUnit, &filter_config));
 
     ESP_LOGI(TAG, "install pcnt channels");
     pcnt_chan_config_t chan_a_config = {
@@ -88,13 +180,13 @@ esp_err_t ModeSelector::Init()
         .level_gpio_num = GPIO_NUM_20,
     };
     pcnt_channel_handle_t pcnt_chan_a = NULL;
-    ESP_ERROR_CHECK(pcnt_new_channel(pcnt_unit, &chan_a_config, &pcnt_chan_a));
+    ESP_ERROR_CHECK(pcnt_new_channel(mUnit, &chan_a_config, &pcnt_chan_a));
     pcnt_chan_config_t chan_b_config = {
         .edge_gpio_num = GPIO_NUM_20,
         .level_gpio_num = GPIO_NUM_18,
     };
     pcnt_channel_handle_t pcnt_chan_b = NULL;
-    ESP_ERROR_CHECK(pcnt_new_channel(pcnt_unit, &chan_b_config, &pcnt_chan_b));
+    ESP_ERROR_CHECK(pcnt_new_channel(mUnit, &chan_b_config, &pcnt_chan_b));
 
     ESP_LOGI(TAG, "set edge and level actions for pcnt channels");
     ESP_ERROR_CHECK(pcnt_channel_set_edge_action(pcnt_chan_a, PCNT_CHANNEL_EDGE_ACTION_DECREASE, PCNT_CHANNEL_EDGE_ACTION_INCREASE));
@@ -102,29 +194,27 @@ esp_err_t ModeSelector::Init()
     ESP_ERROR_CHECK(pcnt_channel_set_edge_action(pcnt_chan_b, PCNT_CHANNEL_EDGE_ACTION_INCREASE, PCNT_CHANNEL_EDGE_ACTION_DECREASE));
     ESP_ERROR_CHECK(pcnt_channel_set_level_action(pcnt_chan_b, PCNT_CHANNEL_LEVEL_ACTION_KEEP, PCNT_CHANNEL_LEVEL_ACTION_INVERSE));
 
+    // The task must exist before the first interrupt can notify it.
+    //
+    xTaskCreate(MonitorTask, "ModeSelector", 2048, NULL, tskIDLE_PRIORITY + 2, &mTask);
+
     ESP_LOGI(TAG, "add watch points and register callbacks");
-    int watch_points[] = {EXAMPLE_PCNT_LOW_LIMIT, -50, 0, 50, EXAMPLE_PCNT_HIGH_LIMIT};
-    for (size_t i = 0; i < sizeof(watch_points) / sizeof(watch_points[0]); i++)
-    {
-        ESP_ERROR_CHECK(pcnt_unit_add_watch_point(pcnt_unit, watch_points[i]));
-    }
+    ESP_ERROR_CHECK(pcnt_unit_add_watch_point(mUnit, -MODE_SELECTOR_DETENT));
+    ESP_ERROR_CHECK(pcnt_unit_add_watch_point(mUnit, MODE_SELECTOR_DETENT));
+
     pcnt_event_callbacks_t cbs = {
-        .on_reach = NULL,
+        .on_reach = OnReach,
     };
-
-    gpio_pulse_evt_queue = xQueueCreate(10, sizeof(int));
-    ESP_ERROR_CHECK(pcnt_unit_register_event_callbacks(pcnt_unit, &cbs, gpio_pulse_evt_queue));
+    ESP_ERROR_CHECK(pcnt_unit_register_event_callbacks(mUnit, &cbs, this));
 
     ESP_LOGI(TAG, "enable pcnt unit");
-    ESP_ERROR_CHECK(pcnt_unit_enable(pcnt_unit));
+    ESP_ERROR_CHECK(pcnt_unit_enable(mUnit));
     ESP_LOGI(TAG, "clear pcnt unit");
-    ESP_ERROR_CHECK(pcnt_unit_clear_count(pcnt_unit));
+    ESP_ERROR_CHECK(pcnt_unit_clear_count(mUnit));
     ESP_LOGI(TAG, "start pcnt unit");
-    ESP_ERROR_CHECK(pcnt_unit_start(pcnt_unit));
-
-    xTaskCreate(pulse_counter_monitor_task, "mode_selector_task", 2048, NULL, tskIDLE_PRIORITY, NULL);
+    ESP_ERROR_CHECK(pcnt_unit_start(mUnit));
 
     ESP_LOGI(TAG, "mode_selector initialised");
 
     return ESP_OK;
-}
\ No newline at end of file
+}
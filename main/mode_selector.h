@@ -1,17 +1,81 @@
+#pragma once
+
 #include <stdio.h>
 #include <esp_err.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include <inttypes.h>
+
+#include <driver/pulse_cnt.h>
 
+// The rotary encoder that selects the program, counted by the PCNT peripheral.
+//
+// Nothing polls it. The unit's limits are set one detent either side of zero, so the
+// hardware interrupts each time the wheel has turned a detent and starts again from zero.
+// The interrupt notifies the selector's task directly, which otherwise stays blocked.
+// The driver adds each detent to an accumulated count as it goes, so however far the
+// wheel is spun nothing is lost to the limits.
+//
+// The task turns the count into whole detents, and those into entries to move by,
+// further for a fast spin. Everything the wheel did since the task last ran is posted
+// to the DishwasherManager as a single kMoveSelection.
+//
 class ModeSelector
 {
 public:
     esp_err_t Init();
 
+    // So the latency from a detent to its command, and how often the task wakes, can be
+    // measured.
+    //
+    struct Statistics
+    {
+        uint32_t interrupts;   // Detents counted by the PCNT unit
+        uint32_t wakeups;      // Times the task woke
+        uint32_t idleWakeups;  // Wakeups with no detent to report
+        uint32_t detents;      // Whole detents turned, either way
+        uint32_t entries;      // Entries moved by, after acceleration
+        uint32_t accelerated;  // Moves that were accelerated
+        uint32_t commands;     // kMoveSelection commands posted
+        uint64_t latencyTotal; // Microseconds from each interrupt to its commands being posted
+        uint32_t latencyMax;
+        int32_t count;         // Pulses counted since boot
+    };
+
+    Statistics GetStatistics();
+
 private:
     friend ModeSelector & ModeSelectorMgr(void);
     static ModeSelector sModeSelector;
+
+    static bool OnReach(pcnt_unit_handle_t unit, const pcnt_watch_event_data_t *event, void *context);
+    static void MonitorTask(void *arg);
+
+    static constexpr int kMaxAcceleration = 4;
+
+    void HandleDetents();
+    int32_t Decode(int count, int64_t at, bool &accelerated);
+
+    pcnt_unit_handle_t mUnit = nullptr;
+    TaskHandle_t mTask = nullptr;
+
+    // Only used by the task.
+    //
+    int mReported = 0;      // Count that commands have been posted for, whole detents only
+    int mDirection = 0;     // Of the last detent, 1 or -1
+    int64_t mDetentAt = 0;  // When the last detent was counted
+
+    // Written by OnReach and read by the task. mInterruptAt is the time of the first
+    // interrupt the task hasn't handled yet, or 0, and mLatestAt of the last.
+    //
+    portMUX_TYPE mStatisticsLock = portMUX_INITIALIZER_UNLOCKED;
+    int64_t mInterruptAt = 0;
+    int64_t mLatestAt = 0;
+    Statistics mStatistics = {};
 };
 
 inline ModeSelector & ModeSelectorMgr(void)
 {
     return ModeSelector::sModeSelector;
-}
\ No newline at end of file
+}
@@ -0,0 +1,270 @@
+#include "panel_flush.h"
+
+#if CONFIG_DISHWASHER_DISPLAY_SSD1306
+
+#include "esp_log.h"
+#include <string.h>
+
+#include "status_display.h"
+
+#include <algorithm>
+
+static const char *TAG = "panel_flush";
+
+PanelFlush PanelFlush::sPanelFlush;
+
+void PanelFlush::Start(esp_lcd_panel_io_handle_t io, esp_lcd_panel_handle_t panel)
+{
+    mPanel = panel;
+
+    // esp_lvgl_port releases the buffer whenever a colour transfer completes, but a flush
+    // is now several transfers, so the release is queued after the last of them instead.
+    //
+    const esp_lcd_panel_io_callbacks_t callbacks = {
+        .on_color_trans_done = NULL,
+    };
+
+    esp_lcd_panel_io_register_event_callbacks(io, &callbacks, NULL);
+
+    mQueue = xQueueCreate(kQueueLength, sizeof(Transfer));
+
+    // The same priority as esp_lvgl_port's own task, so the bus is kept busy whilst LVGL
+    // renders the next frame. LVGL blocks in WaitCallback when it has to wait for a
+    // buffer, so the two never spin against each other.
+    //
+    xTaskCreate(TransferTask, "PanelFlush", 2048, NULL, tskIDLE_PRIORITY + 4, &mTask);
+}
+
+void PanelFlush::Attach(lv_disp_t *display, esp_lcd_panel_io_handle_t io, esp_lcd_panel_handle_t panel)
+{
+    Start(io, panel);
+
+    mReleased = xSemaphoreCreateBinary();
+
+    // esp_lvgl_port's rounder and set_px callbacks stay, so LVGL still renders whole pages
+    // in the panel's own byte layout. Only the transfer is replaced.
+    //
+    display->driver->flush_cb = FlushCallback;
+    display->driver->wait_cb = WaitCallback;
+}
+
+void PanelFlush::WaitCallback(lv_disp_drv_t *driver)
+{
+    // LVGL calls this in a loop for as long as a buffer is still being flushed. A give
+    // left over from an earlier release only costs one more time round that loop.
+    //
+    xSemaphoreTake(PanelFlushMgr().mReleased, pdMS_TO_TICKS(kWaitMs));
+}
+
+void PanelFlush::FlushCallback(lv_disp_drv_t *driver, const lv_area_t *area, lv_color_t *color_map)
+{
+    PanelFlushMgr().Flush(driver, area, (const uint8_t *)color_map);
+}
+
+void PanelFlush::TransferTask(void *arg)
+{
+    PanelFlush &flush = PanelFlushMgr();
+    Transfer transfer;
+
+    while (1)
+    {
+        xQueueReceive(flush.mQueue, &transfer, portMAX_DELAY);
+
+        esp_err_t err = ESP_OK;
+
+        switch (transfer.kind)
+        {
+        case Transfer::kWrite:
+            err = esp_lcd_panel_draw_bitmap(flush.mPanel, transfer.x1, transfer.page * 8, transfer.x2, (transfer.page + 1) * 8, transfer.data);
+            break;
+        case Transfer::kRelease:
+            if (transfer.driver != nullptr)
+            {
+                lv_disp_flush_ready(transfer.driver);
+                xSemaphoreGive(flush.mReleased);
+            }
+            else
+            {
+                xSemaphoreGive(transfer.released);
+            }
+            break;
+        case Transfer::kPower:
+            err = esp_lcd_panel_disp_on_off(flush.mPanel, transfer.on);
+            break;
+        }
+
+        if (err != ESP_OK)
+        {
+            ESP_LOGW(TAG, "Panel transfer failed: %s", esp_err_to_name(err));
+
+            // Only the first failure asks for a frame. It is drawn once the queue behind
+            // it has been sent.
+            //
+            if (!flush.mResync)
+            {
+                flush.mResync = true;
+                StatusDisplayMgr().RequestResync();
+            }
+
+            portENTER_CRITICAL(&flush.mStatisticsLock);
+            flush.mStatistics.failures++;
+            portEXIT_CRITICAL(&flush.mStatisticsLock);
+        }
+    }
+}
+
+void PanelFlush::Queue(const Transfer &transfer)
+{
+    if (xQueueSend(mQueue, &transfer, 0) == pdTRUE)
+    {
+        return;
+    }
+
+    portENTER_CRITICAL(&mStatisticsLock);
+    mStatistics.queueFull++;
+    portEXIT_CRITICAL(&mStatisticsLock);
+
+    xQueueSend(mQueue, &transfer, portMAX_DELAY);
+}
+
+void PanelFlush::SetPower(bool on)
+{
+    Transfer transfer = {};
+    transfer.kind = Transfer::kPower;
+    transfer.on = on;
+
+    Queue(transfer);
+}
+
+bool PanelFlush::TakeResync()
+{
+    if (!mResync)
+    {
+        return false;
+    }
+
+    // Whatever the panel holds now, the redraw will overwrite all of it.
+    //
+    mResync = false;
+    mShadowValid = false;
+
+    return true;
+}
+
+void PanelFlush::Flush(lv_disp_drv_t *driver, const lv_area_t *area, const uint8_t *data)
+{
+    Send(area, data);
+
+    Transfer release = {};
+    release.kind = Transfer::kRelease;
+    release.driver = driver;
+
+    Queue(release);
+}
+
+void PanelFlush::Present(const uint8_t *frame, SemaphoreHandle_t released)
+{
+    const lv_area_t area = { 0, 0, kPanelWidth - 1, kPanelHeight - 1 };
+
+    Send(&area, frame);
+
+    Transfer release = {};
+    release.kind = Transfer::kRelease;
+    release.released = released;
+
+    Queue(release);
+}
+
+void PanelFlush::Send(const lv_area_t *area, const uint8_t *data)
+{
+    int x1 = std::max<int>(area->x1, 0);
+    int x2 = std::min<int>(area->x2, kPanelWidth - 1);
+    int firstPage = std::max<int>(area->y1, 0) / 8;
+    int lastPage = std::min<int>(area->y2, kPanelHeight - 1) / 8;
+    int width = area->x2 - area->x1 + 1;
+
+    uint32_t runs = 0;
+    uint32_t bytesSent = 0;
+
+    for (int page = firstPage; page <= lastPage; page++)
+    {
+        const uint8_t *row = data + ((page - (area->y1 / 8)) * width) + (x1 - area->x1);
+        uint8_t *shadow = &mShadow[page][x1];
+        int columns = x2 - x1 + 1;
+        int column = 0;
+
+        while (column < columns)
+        {
+            if (mShadowValid && row[column] == shadow[column])
+            {
+                column++;
+                continue;
+            }
+
+            // Grow the run until there have been more unchanged bytes than it would cost
+            // to start a new one.
+            //
+            int start = column;
+            int end = column + 1;
+
+            for (int next = end, unchanged = 0; next < columns; next++)
+            {
+                if (!mShadowValid || row[next] != shadow[next])
+                {
+                    end = next + 1;
+                    unchanged = 0;
+                }
+                else if (++unchanged > kRunOverhead)
+                {
+                    break;
+                }
+            }
+
+            // The run points into the caller's buffer, which stays put until it is released.
+            //
+            Transfer transfer = {};
+            transfer.kind = Transfer::kWrite;
+            transfer.page = page;
+            transfer.x1 = x1 + start;
+            transfer.x2 = x1 + end;
+            transfer.data = row + start;
+
+            Queue(transfer);
+            memcpy(shadow + start, row + start, end - start);
+
+            runs++;
+            bytesSent += end - start;
+            column = end;
+        }
+    }
+
+    // Once the whole screen has been sent, the shadow matches the panel.
+    //
+    if (!mShadowValid && x1 == 0 && x2 == kPanelWidth - 1 && firstPage == 0 && lastPage == kPanelPages - 1)
+    {
+        mShadowValid = true;
+    }
+
+    portENTER_CRITICAL(&mStatisticsLock);
+    mStatistics.frames++;
+    mStatistics.runs += runs;
+    mStatistics.bytesRequested += (x2 - x1 + 1) * (lastPage - firstPage + 1);
+    mStatistics.bytesSent += bytesSent;
+    portEXIT_CRITICAL(&mStatisticsLock);
+}
+
+PanelFlush::Statistics PanelFlush::GetStatistics()
+{
+    portENTER_CRITICAL(&mStatisticsLock);
+    Statistics statistics = mStatistics;
+    portEXIT_CRITICAL(&mStatisticsLock);
+
+    return statistics;
+}
+
+void PanelFlush::Capture(uint8_t *frame)
+{
+    memcpy(frame, mShadow, sizeof(mShadow));
+}
+
+#endif // CONFIG_DISHWASHER_DISPLAY_SSD1306
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <stdio.h>
+#include <esp_err.h>
+#include "esp_lcd_panel_io.h"
+#include "esp_lcd_panel_ops.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "lvgl.h"
+
+#include <inttypes.h>
+
+constexpr uint16_t kPanelWidth = 128;
+constexpr uint16_t kPanelHeight = 64;
+constexpr uint16_t kPanelPages = kPanelHeight / 8;
+
+// Sits between LVGL and the SSD1306, sending the panel only the bytes that changed.
+//
+// The panel's RAM is organised as eight rows of bytes (pages), each byte being a column of
+// eight pixels, and esp_lvgl_port renders monochrome displays straight into that layout.
+// A shadow copy of what the panel holds is kept, and each flushed page is compared with it
+// column by column. Only the runs of bytes that differ are sent, each addressed with the
+// SSD1306's column and page range commands. Runs separated by a few unchanged bytes are
+// merged, as resending those is cheaper than the commands to skip them.
+//
+// The transfers themselves are queued to a task of their own, so neither LVGL nor the
+// caller waits on the bus. The LVGL buffer is handed back once its last run has been sent,
+// and with double buffering LVGL renders the next frame into the other one meanwhile.
+// When LVGL does need a buffer back, its wait_cb blocks until the release rather than
+// spinning, so the wait leaves the CPU to the transfer task and everything else.
+//
+// A failed transfer asks the StatusDisplay for a frame straight away, so the panel is
+// redrawn even if nothing else changes.
+//
+class PanelFlush
+{
+public:
+    struct Statistics
+    {
+        uint32_t frames;         // Flushes from LVGL
+        uint32_t runs;           // Transfers made to the panel
+        uint32_t bytesRequested; // Bytes LVGL asked to send, which is what a plain flush would send
+        uint32_t bytesSent;      // Bytes actually sent, excluding addressing
+        uint32_t queueFull;      // Times a flush had to wait for the transfer queue
+        uint32_t failures;       // Transfers the panel didn't accept
+    };
+
+    // Takes over the flush of an esp_lvgl_port monochrome display. Must be called with
+    // lvgl_port_lock held.
+    //
+    void Attach(lv_disp_t *display, esp_lcd_panel_io_handle_t io, esp_lcd_panel_handle_t panel);
+
+    // For drawing without LVGL. Start brings up the transfer task, after which whole
+    // frames, in the panel's page layout, are sent with Present. released is given once
+    // the frame has been sent and may be drawn into again.
+    //
+    void Start(esp_lcd_panel_io_handle_t io, esp_lcd_panel_handle_t panel);
+    void Present(const uint8_t *frame, SemaphoreHandle_t released);
+
+    // Queued behind any pending transfers, so it never splits a run from its addressing.
+    //
+    void SetPower(bool on);
+
+    // True, once, if a transfer failed and the panel no longer matches the shadow. The
+    // caller should invalidate the whole screen so it gets redrawn. Must be called with
+    // lvgl_port_lock held.
+    //
+    bool TakeResync();
+
+    Statistics GetStatistics();
+
+    // Copies the shadow, which is what the panel will hold once the queue has drained.
+    // Must be called with lvgl_port_lock held, or by the task calling Present.
+    //
+    void Capture(uint8_t *frame);
+
+private:
+    friend PanelFlush &PanelFlushMgr(void);
+    static PanelFlush sPanelFlush;
+
+    // Each run costs a column and a page range command, three bytes apiece.
+    //
+    static constexpr uint8_t kRunOverhead = 6;
+    static constexpr uint8_t kQueueLength = 32;
+    static constexpr uint32_t kWaitMs = 100; // LVGL checks again after this, in case a release was missed
+
+    struct Transfer
+    {
+        enum Kind : uint8_t
+        {
+            kWrite,   // Send data to columns x1 to x2 (exclusive) of page
+            kRelease, // Everything before this came from one buffer, so hand it back
+            kPower,   // Switch the panel on or off
+        };
+
+        Kind kind;
+        uint8_t page;
+        uint8_t x1;
+        uint8_t x2;
+        const uint8_t *data;
+        lv_disp_drv_t *driver;       // The LVGL display to release, or
+        SemaphoreHandle_t released; // what to give for a frame from Present
+        bool on;
+    };
+
+    static void FlushCallback(lv_disp_drv_t *driver, const lv_area_t *area, lv_color_t *color_map);
+    static void WaitCallback(lv_disp_drv_t *driver);
+    static void TransferTask(void *arg);
+
+    void Flush(lv_disp_drv_t *driver, const lv_area_t *area, const uint8_t *data);
+    void Send(const lv_area_t *area, const uint8_t *data);
+    void Queue(const Transfer &transfer);
+
+    esp_lcd_panel_handle_t mPanel = nullptr;
+    QueueHandle_t mQueue = nullptr;
+    TaskHandle_t mTask = nullptr;
+    SemaphoreHandle_t mReleased = nullptr; // Given each time an LVGL buffer is handed back
+    volatile bool mResync = false;
+
+    // Only used by flushes, under lvgl_port_lock, or by the one task calling Present. The
+    // shadow is updated as runs are queued, so it holds what the panel will hold once the
+    // queue has drained.
+    //
+    uint8_t mShadow[kPanelPages][kPanelWidth];
+    bool mShadowValid = false; // Nothing is known about the panel until it has been fully written
+
+    portMUX_TYPE mStatisticsLock = portMUX_INITIALIZER_UNLOCKED;
+    Statistics mStatistics = {};
+};
+
+inline PanelFlush &PanelFlushMgr(void)
+{
+    return PanelFlush::sPanelFlush;
+}
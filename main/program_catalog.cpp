@@ -0,0 +1,124 @@
+#include "program_catalog.h"
+
+#include <esp_log.h>
+#include <esp_rom_crc.h>
+#include <string.h>
+
+static const char *TAG = "program_catalog";
+
+#define PROGRAMS_PARTITION_LABEL "programs"
+
+ProgramCatalog ProgramCatalog::sProgramCatalog;
+
+bool ProgramCatalog::IsValid(const ProgramDefinition &program, uint8_t index)
+{
+    if (program.mode != index || program.phaseCount == 0 || program.phaseCount > kMaxProgramPhases)
+    {
+        return false;
+    }
+
+    if (program.tagCount == 0 || program.tagCount > kMaxModeTags)
+    {
+        return false;
+    }
+
+    if (program.label[0] == '\0' || memchr(program.label, '\0', sizeof(program.label)) == nullptr)
+    {
+        return false;
+    }
+
+    // The phase ends are precomputed by the tool, so make sure they add up.
+    //
+    uint32_t elapsed = 0;
+
+    for (uint8_t i = 0; i < program.phaseCount; i++)
+    {
+        // A phase must take some time. Its duration is divided by, for the forecast.
+        //
+        if (program.phases[i].phase >= kPhaseCount || program.phases[i].duration == 0)
+        {
+            return false;
+        }
+
+        elapsed += program.phases[i].duration;
+
+        if (program.phaseEnds[i] != elapsed)
+        {
+            return false;
+        }
+    }
+
+    return program.duration == elapsed && elapsed > 0;
+}
+
+esp_err_t ProgramCatalog::Init()
+{
+    ESP_LOGI(TAG, "ProgramCatalog::Init()");
+
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, PROGRAMS_PARTITION_LABEL);
+
+    if (partition == nullptr)
+    {
+        ESP_LOGI(TAG, "No %s partition, using the %d built in programs", PROGRAMS_PARTITION_LABEL, mCount);
+        return ESP_OK;
+    }
+
+    const void *mapped = nullptr;
+    esp_partition_mmap_handle_t handle;
+
+    esp_err_t err = esp_partition_mmap(partition, 0, partition->size, ESP_PARTITION_MMAP_DATA, &mapped, &handle);
+
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to map %s partition: %s", PROGRAMS_PARTITION_LABEL, esp_err_to_name(err));
+        return err;
+    }
+
+    const ProgramBlobHeader *header = (const ProgramBlobHeader *)mapped;
+    const ProgramDefinition *programs = (const ProgramDefinition *)(header + 1);
+
+    bool valid = header->magic == kProgramBlobMagic;
+
+    if (valid && header->version != kProgramBlobVersion)
+    {
+        ESP_LOGW(TAG, "Program blob is version %d, expected %d", header->version, kProgramBlobVersion);
+        valid = false;
+    }
+
+    if (valid && (header->programCount == 0 || header->programCount > kMaxPrograms ||
+                  sizeof(ProgramBlobHeader) + (header->programCount * sizeof(ProgramDefinition)) > partition->size))
+    {
+        ESP_LOGW(TAG, "Program blob has a bad program count (%d)", header->programCount);
+        valid = false;
+    }
+
+    if (valid && esp_rom_crc32_le(0, (const uint8_t *)programs, header->programCount * sizeof(ProgramDefinition)) != header->crc)
+    {
+        ESP_LOGW(TAG, "Program blob failed its CRC");
+        valid = false;
+    }
+
+    for (uint8_t i = 0; valid && i < header->programCount; i++)
+    {
+        if (!IsValid(programs[i], i))
+        {
+            ESP_LOGW(TAG, "Program %d in the blob is invalid", i);
+            valid = false;
+        }
+    }
+
+    if (!valid)
+    {
+        ESP_LOGI(TAG, "Using the %d built in programs", mCount);
+        esp_partition_munmap(handle);
+        return ESP_OK;
+    }
+
+    mPrograms = programs;
+    mCount = header->programCount;
+    mHandle = handle;
+
+    ESP_LOGI(TAG, "Mapped %d programs from the %s partition", mCount, PROGRAMS_PARTITION_LABEL);
+
+    return ESP_OK;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stdio.h>
+#include <esp_err.h>
+#include <esp_partition.h>
+
+#include <inttypes.h>
+
+#include "program_table.h"
+
+constexpr uint32_t kProgramBlobMagic = 0x47505744; // "DWPG"
+constexpr uint16_t kProgramBlobVersion = 1;
+constexpr uint8_t kMaxPrograms = 32;
+
+// The "programs" partition starts with this header, followed directly by programCount
+// ProgramDefinitions. The blob is built and checked by tools/program_blob.py.
+//
+struct ProgramBlobHeader
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t programCount;
+    uint32_t crc; // CRC32 of the ProgramDefinitions
+    uint32_t reserved;
+};
+
+static_assert(sizeof(ProgramBlobHeader) == 16, "ProgramBlobHeader layout is shared with the program blob");
+
+// The programs the dishwasher offers.
+//
+// If the "programs" partition holds a valid blob, it is memory mapped and every lookup is
+// served straight out of flash, without copying it into RAM. Otherwise the programs built
+// into the firmware are used.
+//
+class ProgramCatalog
+{
+public:
+    esp_err_t Init();
+
+    uint8_t GetCount() { return mCount; }
+    const ProgramDefinition &Get(uint8_t mode) { return mPrograms[mode < mCount ? mode : 0]; }
+
+    bool IsFromFlash() { return mHandle != 0; }
+
+private:
+    friend ProgramCatalog &ProgramCatalogMgr(void);
+    static ProgramCatalog sProgramCatalog;
+
+    static bool IsValid(const ProgramDefinition &program, uint8_t index);
+
+    const ProgramDefinition *mPrograms = kBuiltInPrograms;
+    uint8_t mCount = kBuiltInProgramCount;
+    esp_partition_mmap_handle_t mHandle = 0;
+};
+
+inline ProgramCatalog &ProgramCatalogMgr(void)
+{
+    return ProgramCatalog::sProgramCatalog;
+}
+
+inline const ProgramDefinition &GetProgram(uint8_t mode)
+{
+    return ProgramCatalogMgr().Get(mode);
+}
+
+inline uint8_t GetProgramCount()
+{
+    return ProgramCatalogMgr().GetCount();
+}
@@ -0,0 +1,185 @@
+#include "program_estimates.h"
+
+#include <esp_log.h>
+#include <esp_rom_crc.h>
+#include <nvs.h>
+#include <string.h>
+
+#include <algorithm>
+
+static const char *TAG = "program_estimates";
+
+#define ESTIMATES_NVS_NAMESPACE "dishwasher"
+#define ESTIMATES_NVS_KEY "estimates"
+
+ProgramEstimates ProgramEstimates::sProgramEstimates;
+
+// Too big for the manager's stack, and only ever used by one task at a time.
+//
+static uint8_t sBlob[sizeof(uint64_t) + (kMaxPrograms * kMaxProgramPhases * sizeof(uint32_t))];
+
+esp_err_t ProgramEstimates::Init()
+{
+    ESP_LOGI(TAG, "ProgramEstimates::Init()");
+
+    // The estimates only make sense for the programs they were learned from.
+    //
+    uint8_t programCount = GetProgramCount();
+    mFingerprint = esp_rom_crc32_le(0, (const uint8_t *)&GetProgram(0), programCount * sizeof(ProgramDefinition));
+
+    nvs_handle_t handle;
+
+    if (nvs_open(ESTIMATES_NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK)
+    {
+        return ESP_OK;
+    }
+
+    static_assert(sizeof(sBlob) == sizeof(Header) + sizeof(mEstimates), "sBlob must hold the header and every estimate");
+
+    Header header;
+    size_t length = 0;
+
+    if (nvs_get_blob(handle, ESTIMATES_NVS_KEY, nullptr, &length) == ESP_OK && length == sizeof(Header) + (programCount * sizeof(mEstimates[0])))
+    {
+        if (nvs_get_blob(handle, ESTIMATES_NVS_KEY, sBlob, &length) == ESP_OK)
+        {
+            memcpy(&header, sBlob, sizeof(header));
+
+            if (header.version == kVersion && header.programCount == programCount && header.fingerprint == mFingerprint)
+            {
+                memcpy(mEstimates, sBlob + sizeof(Header), programCount * sizeof(mEstimates[0]));
+                ESP_LOGI(TAG, "Loaded estimates for %d programs", programCount);
+            }
+            else
+            {
+                ESP_LOGI(TAG, "Programs have changed, discarding estimates");
+            }
+        }
+    }
+
+    nvs_close(handle);
+
+    return ESP_OK;
+}
+
+uint32_t ProgramEstimates::Update(uint32_t average, uint32_t sample)
+{
+    // average += (sample - average) / 2^kWeightBits, rounded towards the sample so the
+    // average always reaches it.
+    //
+    int64_t difference = (int64_t)sample - average;
+    int64_t step = difference / (1 << kWeightBits);
+
+    if (step == 0 && difference != 0)
+    {
+        step = difference > 0 ? 1 : -1;
+    }
+
+    return average + step;
+}
+
+void ProgramEstimates::RecordPhase(uint8_t mode, uint8_t phase, uint32_t duration)
+{
+    if (mode >= kMaxPrograms || phase >= kMaxProgramPhases)
+    {
+        return;
+    }
+
+    Estimate &estimate = mEstimates[mode][phase];
+    uint32_t nominal = GetProgram(mode).phases[phase].duration;
+
+    // A sample far from the nominal duration says more about something having gone wrong
+    // than about the phase, so it only counts for so much.
+    //
+    uint32_t lowest = std::max<uint32_t>(nominal / kMaxDeviation, 1);
+    uint32_t highest = std::clamp<uint64_t>((uint64_t)nominal * kMaxDeviation, lowest, UINT32_MAX >> kFractionBits);
+    uint32_t clamped = std::clamp<uint32_t>(duration, lowest, highest);
+    uint32_t sample = clamped << kFractionBits;
+
+    // The first sample is averaged against the nominal duration, like any other.
+    //
+    uint32_t average = estimate.duration != 0 ? estimate.duration : nominal << kFractionBits;
+
+    estimate.duration = std::max<uint32_t>(Update(average, sample), 1);
+
+    mChanged = true;
+
+    ESP_LOGI(TAG, "Mode %d phase %d took %lus, now estimated at %lus", mode, phase, duration, GetPhaseDuration(mode, phase));
+}
+
+uint32_t ProgramEstimates::GetPhaseDuration(uint8_t mode, uint8_t phase)
+{
+    const Estimate &estimate = mEstimates[mode % kMaxPrograms][phase % kMaxProgramPhases];
+
+    if (estimate.duration == 0)
+    {
+        return GetProgram(mode).phases[phase].duration;
+    }
+
+    return (estimate.duration + (1 << (kFractionBits - 1))) >> kFractionBits;
+}
+
+int64_t ProgramEstimates::GetPhaseEnergy(uint8_t mode, uint8_t phase)
+{
+    const ProgramPhase &nominal = GetProgram(mode).phases[phase];
+
+    return (nominal.power * nominal.duration) / 3600;
+}
+
+uint32_t ProgramEstimates::GetDurationFrom(uint8_t mode, uint8_t phase)
+{
+    const ProgramDefinition &program = GetProgram(mode);
+    uint32_t duration = 0;
+
+    for (uint8_t i = phase; i < program.phaseCount; i++)
+    {
+        duration += GetPhaseDuration(mode, i);
+    }
+
+    return duration;
+}
+
+void ProgramEstimates::Save()
+{
+    if (!mChanged)
+    {
+        return;
+    }
+
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(ESTIMATES_NVS_NAMESPACE, NVS_READWRITE, &handle);
+
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to open NVS: %s", esp_err_to_name(err));
+        return;
+    }
+
+    uint8_t programCount = GetProgramCount();
+
+    Header header = {};
+    header.version = kVersion;
+    header.programCount = programCount;
+    header.fingerprint = mFingerprint;
+
+    memcpy(sBlob, &header, sizeof(header));
+    memcpy(sBlob + sizeof(Header), mEstimates, programCount * sizeof(mEstimates[0]));
+
+    err = nvs_set_blob(handle, ESTIMATES_NVS_KEY, sBlob, sizeof(Header) + (programCount * sizeof(mEstimates[0])));
+
+    if (err == ESP_OK)
+    {
+        err = nvs_commit(handle);
+    }
+
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to save estimates: %s", esp_err_to_name(err));
+    }
+    else
+    {
+        mChanged = false;
+    }
+
+    nvs_close(handle);
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <stdio.h>
+#include <esp_err.h>
+
+#include <inttypes.h>
+
+#include "program_catalog.h"
+
+// How long each phase of each program really runs for, learned from the phases the
+// dishwasher completes. Only running time is learned, never time spent paused, which is
+// also all the countdown takes off, so the two always agree. The program table still ends
+// each phase, so for now a sample only differs from the nominal duration by how late the
+// program timer fired, but nothing here depends on that.
+//
+// Each estimate is an exponentially weighted moving average, kept in fixed point so that
+// folding in a new sample is a subtraction and a shift, with no floating point. None of
+// the targets, the C6 (RV32IMAC), C2 and H2, has an FPU. Each average starts from the
+// phase's nominal duration in the ProgramDefinition, and samples are clamped to within
+// kMaxDeviation times either side of it, so no single odd phase can throw it far out. The
+// averages are saved to NVS at
+// the end of each program, and thrown away if the programs change.
+//
+// Energy isn't metered, so it isn't learned. A phase's energy is its nominal power over
+// its nominal running time.
+//
+// Only used by the DishwasherManager's task.
+//
+class ProgramEstimates
+{
+public:
+    esp_err_t Init();
+
+    // O(1). duration is the seconds the phase ran for, not counting pauses.
+    //
+    void RecordPhase(uint8_t mode, uint8_t phase, uint32_t duration);
+
+    uint32_t GetPhaseDuration(uint8_t mode, uint8_t phase);
+    int64_t GetPhaseEnergy(uint8_t mode, uint8_t phase); // mWh
+
+    // Seconds from the start of the given phase to the end of the program.
+    //
+    uint32_t GetDurationFrom(uint8_t mode, uint8_t phase);
+    uint32_t GetDuration(uint8_t mode) { return GetDurationFrom(mode, 0); }
+
+    // Writes the averages to NVS, if any have changed since they were last saved.
+    //
+    void Save();
+
+private:
+    friend ProgramEstimates &ProgramEstimatesMgr(void);
+    static ProgramEstimates sProgramEstimates;
+
+    // Averages are stored shifted left by kFractionBits. Each sample moves the average
+    // 1/2^kWeightBits of the way towards it.
+    //
+    static constexpr uint8_t kFractionBits = 8;
+    static constexpr uint8_t kWeightBits = 3;
+    static constexpr uint32_t kMaxDeviation = 4;
+    static constexpr uint8_t kVersion = 3; // 1 also held energy, 2 included pauses
+
+    struct Estimate
+    {
+        uint32_t duration; // Seconds, fixed point. 0 until the phase has been seen, meaning nominal.
+    };
+
+    struct Header
+    {
+        uint8_t version;
+        uint8_t programCount;
+        uint16_t reserved;
+        uint32_t fingerprint; // CRC32 of the ProgramDefinitions the estimates were learned for
+    };
+
+    static uint32_t Update(uint32_t average, uint32_t sample);
+
+    Estimate mEstimates[kMaxPrograms][kMaxProgramPhases] = {};
+    uint32_t mFingerprint = 0;
+    bool mChanged = false;
+};
+
+inline ProgramEstimates &ProgramEstimatesMgr(void)
+{
+    return ProgramEstimates::sProgramEstimates;
+}
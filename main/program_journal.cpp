@@ -0,0 +1,179 @@
+#include "program_journal.h"
+
+#include <esp_log.h>
+#include <esp_rom_crc.h>
+#include <spi_flash_mmap.h>
+#include <string.h>
+
+#include <algorithm>
+
+static const char *TAG = "program_journal";
+
+#define JOURNAL_PARTITION_LABEL "journal"
+#define JOURNAL_BLANK_SEQUENCE 0xFFFFFFFF
+
+ProgramJournal ProgramJournal::sProgramJournal;
+
+uint32_t ProgramJournal::CalculateCrc(const Record &record)
+{
+    return esp_rom_crc32_le(0, (const uint8_t *)&record, offsetof(Record, crc));
+}
+
+esp_err_t ProgramJournal::Init()
+{
+    ESP_LOGI(TAG, "ProgramJournal::Init()");
+
+    mPartition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, JOURNAL_PARTITION_LABEL);
+
+    if (mPartition == nullptr)
+    {
+        ESP_LOGW(TAG, "No %s partition, programs will not survive a power cut", JOURNAL_PARTITION_LABEL);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    mSlotCount = mPartition->size / sizeof(Record);
+    mStatistics.sectorCount = mPartition->size / SPI_FLASH_SEC_SIZE;
+
+    // Scan the whole journal, a few records at a time, for the newest valid record. Torn
+    // writes from a power cut simply fail the CRC and are ignored. The scan only happens
+    // once, so a small buffer on the stack is worth the extra reads over holding a
+    // sector's worth of RAM for good.
+    //
+    Record records[8];
+    const uint32_t records_per_read = sizeof(records) / sizeof(Record);
+
+    uint32_t latest_slot = 0;
+
+    for (uint32_t slot = 0; slot < mSlotCount; slot += records_per_read)
+    {
+        uint32_t count = std::min(records_per_read, mSlotCount - slot);
+
+        esp_err_t err = esp_partition_read(mPartition, slot * sizeof(Record), records, count * sizeof(Record));
+
+        if (err != ESP_OK)
+        {
+            ESP_LOGE(TAG, "Failed to read journal: %s", esp_err_to_name(err));
+            return err;
+        }
+
+        for (uint32_t i = 0; i < count; i++)
+        {
+            const Record &record = records[i];
+
+            if (record.sequence == JOURNAL_BLANK_SEQUENCE || record.crc != CalculateCrc(record))
+            {
+                continue;
+            }
+
+            if (!mHasLatest || record.sequence > mSequence)
+            {
+                mHasLatest = true;
+                mSequence = record.sequence;
+                mLatest = record.checkpoint;
+                mStatistics.lifetimeSectorErases = record.lifetimeSectorErases;
+                latest_slot = slot + i;
+            }
+        }
+    }
+
+    mNextSlot = mHasLatest ? (latest_slot + 1) % mSlotCount : 0;
+
+    ESP_LOGI(TAG, "Journal has %lu slots, latest sequence %lu, next slot %lu", mSlotCount, mSequence, mNextSlot);
+
+    return ESP_OK;
+}
+
+bool ProgramJournal::GetLatest(ProgramCheckpoint &checkpoint)
+{
+    if (!mHasLatest)
+    {
+        return false;
+    }
+
+    checkpoint = mLatest;
+    return true;
+}
+
+esp_err_t ProgramJournal::Append(const ProgramCheckpoint &checkpoint)
+{
+    if (mPartition == nullptr)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    // Nothing has changed, so save the write.
+    //
+    if (mHasLatest && memcmp(&checkpoint, &mLatest, sizeof(ProgramCheckpoint)) == 0)
+    {
+        mStatistics.recordsSkipped++;
+        return ESP_OK;
+    }
+
+    // Entering a sector means the journal has wrapped round to its oldest records, so
+    // erase it. Elsewhere the slot should already be blank, unless a write was torn by
+    // a power cut, in which case we step over it.
+    //
+    for (uint32_t attempts = 0; attempts < mSlotCount; attempts++)
+    {
+        uint32_t offset = mNextSlot * sizeof(Record);
+
+        if (offset % SPI_FLASH_SEC_SIZE == 0)
+        {
+            esp_err_t err = esp_partition_erase_range(mPartition, offset, SPI_FLASH_SEC_SIZE);
+
+            if (err != ESP_OK)
+            {
+                ESP_LOGE(TAG, "Failed to erase journal sector: %s", esp_err_to_name(err));
+                return err;
+            }
+
+            mStatistics.sectorErases++;
+            mStatistics.lifetimeSectorErases++;
+            break;
+        }
+
+        uint32_t sequence = 0;
+        esp_partition_read(mPartition, offset, &sequence, sizeof(sequence));
+
+        if (sequence == JOURNAL_BLANK_SEQUENCE)
+        {
+            break;
+        }
+
+        mNextSlot = (mNextSlot + 1) % mSlotCount;
+    }
+
+    Record record;
+    memset(&record, 0, sizeof(record));
+    record.sequence = mSequence + 1;
+    record.checkpoint = checkpoint;
+    record.lifetimeSectorErases = mStatistics.lifetimeSectorErases;
+    record.crc = CalculateCrc(record);
+
+    esp_err_t err = esp_partition_write(mPartition, mNextSlot * sizeof(Record), &record, sizeof(record));
+
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to write journal record: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    mSequence = record.sequence;
+    mLatest = checkpoint;
+    mHasLatest = true;
+    mNextSlot = (mNextSlot + 1) % mSlotCount;
+
+    mStatistics.recordsWritten++;
+    mStatistics.bytesWritten += sizeof(record);
+
+    ESP_LOGI(TAG, "Checkpoint %lu written (state %d, mode %d, phase %d, elapsed %lus)", mSequence, checkpoint.state, checkpoint.mode, checkpoint.phase, checkpoint.elapsed);
+
+    return ESP_OK;
+}
+
+void ProgramJournal::LogStatistics()
+{
+    ESP_LOGI(TAG, "Records written: %lu (%lu bytes), skipped: %lu", mStatistics.recordsWritten, mStatistics.bytesWritten, mStatistics.recordsSkipped);
+    ESP_LOGI(TAG, "Sector erases: %lu since boot, %lu lifetime across %lu sectors (%lu per sector)", mStatistics.sectorErases, mStatistics.lifetimeSectorErases, mStatistics.sectorCount,
+             mStatistics.sectorCount > 0 ? mStatistics.lifetimeSectorErases / mStatistics.sectorCount : 0);
+}
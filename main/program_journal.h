@@ -0,0 +1,88 @@
+#pragma once
+
+#include <stdio.h>
+#include <esp_err.h>
+#include <esp_partition.h>
+
+#include <inttypes.h>
+
+// Everything needed to pick a program back up after a power cut.
+//
+struct ProgramCheckpoint
+{
+    enum Flags : uint8_t
+    {
+        kProgramSelected = 1 << 0,
+        kOptedIn = 1 << 1,
+        kPoweredOn = 1 << 2,
+    };
+
+    uint8_t state; // OperationalStateEnum
+    uint8_t mode;
+    uint8_t phase; // Index into the program's phases
+    uint8_t flags;
+    uint32_t elapsed;      // Seconds the program has been running for
+    uint32_t delayedStart; // Seconds of delayed start remaining
+};
+
+// An append-only journal of fixed size checkpoint records in the "journal" partition.
+//
+// Records are written one after another through the partition and each sector is only
+// erased when the journal wraps back round to it, so the erases are spread evenly. The
+// newest record is the valid one with the highest sequence number.
+//
+class ProgramJournal
+{
+public:
+    struct Statistics
+    {
+        uint32_t recordsWritten;       // Since boot
+        uint32_t bytesWritten;         // Since boot
+        uint32_t recordsSkipped;       // Appends that matched the latest record, so weren't written
+        uint32_t sectorErases;         // Since boot
+        uint32_t lifetimeSectorErases; // Carried forward in every record
+        uint32_t sectorCount;
+    };
+
+    esp_err_t Init();
+
+    bool GetLatest(ProgramCheckpoint &checkpoint);
+    esp_err_t Append(const ProgramCheckpoint &checkpoint);
+
+    const Statistics &GetStatistics() { return mStatistics; }
+    void LogStatistics();
+
+private:
+    friend ProgramJournal &ProgramJournalMgr(void);
+    static ProgramJournal sProgramJournal;
+
+    struct Record
+    {
+        uint32_t sequence;
+        ProgramCheckpoint checkpoint;
+        uint32_t lifetimeSectorErases;
+        uint8_t reserved[8];
+        uint32_t crc;
+    };
+
+    // 32 bytes keeps records aligned for encrypted flash writes.
+    //
+    static_assert(sizeof(Record) == 32, "Journal records must be 32 bytes");
+
+    static uint32_t CalculateCrc(const Record &record);
+
+    const esp_partition_t *mPartition = nullptr;
+    uint32_t mSlotCount = 0;
+    uint32_t mNextSlot = 0;
+    uint32_t mSequence = 0;
+
+    bool mHasLatest = false;
+    ProgramCheckpoint mLatest;
+
+    Statistics mStatistics = {};
+};
+
+inline ProgramJournal &ProgramJournalMgr(void)
+{
+    return ProgramJournal::sProgramJournal;
+}
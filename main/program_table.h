@@ -0,0 +1,163 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// The phases a program can move through. These are reported, in this order, as the
+// OperationalState PhaseList, so CurrentPhase is an index into this list.
+//
+enum ProgramPhaseId : uint8_t
+{
+    kPhasePreSoak = 0,
+    kPhaseMainWash,
+    kPhaseRinse,
+    kPhaseFinalRinse,
+    kPhaseDrying,
+    kPhaseCount
+};
+
+constexpr const char *kOperationalPhaseNames[kPhaseCount] = {"pre-soak", "main-wash", "rinse", "final-rinse", "drying"};
+
+constexpr size_t kMaxProgramPhases = kPhaseCount;
+constexpr size_t kMaxModeTags = 4;
+constexpr size_t kMaxProgramLabelLength = 32; // Including the terminator
+
+// Mode tags from ModeBase and DishwasherMode, as reported in SupportedModes.
+//
+enum ProgramModeTag : uint16_t
+{
+    kModeTagAuto = 0x0000,
+    kModeTagQuick = 0x0001,
+    kModeTagQuiet = 0x0002,
+    kModeTagLowNoise = 0x0003,
+    kModeTagLowEnergy = 0x0004,
+    kModeTagVacation = 0x0005,
+    kModeTagMin = 0x0006,
+    kModeTagMax = 0x0007,
+    kModeTagNight = 0x0008,
+    kModeTagDay = 0x0009,
+    kModeTagNormal = 0x4000,
+    kModeTagHeavy = 0x4001,
+    kModeTagLight = 0x4002,
+};
+
+// Programs can also be loaded from the "programs" partition, where they are read in place,
+// so these structures have a fixed little-endian layout with explicit padding. Any change
+// here must be matched in tools/program_blob.py and bump kProgramBlobVersion.
+//
+struct ProgramPhase
+{
+    uint8_t phase;       // ProgramPhaseId
+    uint8_t pausable;    // Can the program be paused whilst in this phase?
+    uint8_t reserved[2];
+    uint32_t duration;   // Seconds
+    int64_t power;       // Nominal power in mW, used for the forecast slot
+};
+
+struct ProgramDefinition
+{
+    uint8_t mode; // The DishwasherMode value, which is also the program's index
+    uint8_t phaseCount;
+    uint8_t tagCount;
+    uint8_t reserved[5];
+    ProgramPhase phases[kMaxProgramPhases];
+
+    // Seconds from the start of the program at which each phase completes.
+    // Precomputed so that working out the phase never needs to walk the table.
+    //
+    uint32_t phaseEnds[kMaxProgramPhases];
+    uint32_t duration;
+
+    uint16_t tags[kMaxModeTags]; // ProgramModeTag
+    char label[kMaxProgramLabelLength];
+};
+
+static_assert(sizeof(ProgramPhase) == 16, "ProgramPhase layout is shared with the program blob");
+static_assert(sizeof(ProgramDefinition) == 152, "ProgramDefinition layout is shared with the program blob");
+
+template <size_t N, size_t T, size_t L>
+constexpr ProgramDefinition MakeProgram(uint8_t mode, const char (&label)[L], const uint16_t (&tags)[T], const ProgramPhase (&phases)[N])
+{
+    static_assert(N > 0 && N <= kMaxProgramPhases, "A program needs between one and kMaxProgramPhases phases");
+    static_assert(T > 0 && T <= kMaxModeTags, "A program needs between one and kMaxModeTags mode tags");
+    static_assert(L <= kMaxProgramLabelLength, "Program label is too long");
+
+    ProgramDefinition program{};
+    program.mode = mode;
+    program.phaseCount = N;
+    program.tagCount = T;
+
+    uint32_t elapsed = 0;
+
+    for (size_t i = 0; i < N; i++)
+    {
+        program.phases[i] = phases[i];
+        elapsed += phases[i].duration;
+        program.phaseEnds[i] = elapsed;
+    }
+
+    program.duration = elapsed;
+
+    for (size_t i = 0; i < T; i++)
+    {
+        program.tags[i] = tags[i];
+    }
+
+    for (size_t i = 0; i < L; i++)
+    {
+        program.label[i] = label[i];
+    }
+
+    return program;
+}
+
+// Eco 50°
+//
+constexpr ProgramPhase kEcoPhases[] = {
+    {kPhasePreSoak, true, {}, 120, 100000},
+    {kPhaseMainWash, true, {}, 900, 2000000},
+    {kPhaseRinse, true, {}, 300, 150000},
+    {kPhaseFinalRinse, false, {}, 180, 1800000},
+    {kPhaseDrying, true, {}, 300, 50000},
+};
+
+constexpr uint16_t kEcoTags[] = {kModeTagNormal};
+
+// Chef 70°
+//
+constexpr ProgramPhase kChefPhases[] = {
+    {kPhasePreSoak, true, {}, 300, 100000},
+    {kPhaseMainWash, true, {}, 1800, 2800000},
+    {kPhaseRinse, true, {}, 600, 150000},
+    {kPhaseFinalRinse, false, {}, 300, 2200000},
+    {kPhaseDrying, true, {}, 600, 50000},
+};
+
+constexpr uint16_t kChefTags[] = {kModeTagMax, kModeTagHeavy};
+
+// Quick 45°
+//
+constexpr ProgramPhase kQuickPhases[] = {
+    {kPhasePreSoak, true, {}, 600, 100000},
+    {kPhaseMainWash, true, {}, 2700, 1800000},
+    {kPhaseRinse, true, {}, 900, 150000},
+    {kPhaseFinalRinse, false, {}, 600, 1600000},
+    {kPhaseDrying, true, {}, 600, 50000},
+};
+
+constexpr uint16_t kQuickTags[] = {kModeTagLight, kModeTagNight, kModeTagQuiet};
+
+// The programs built into the firmware, used when the "programs" partition is empty or
+// invalid. Indexed by DishwasherMode value.
+//
+constexpr ProgramDefinition kBuiltInPrograms[] = {
+    MakeProgram(0, "Eco 50°", kEcoTags, kEcoPhases),
+    MakeProgram(1, "Chef 70°", kChefTags, kChefPhases),
+    MakeProgram(2, "Quick 45°", kQuickTags, kQuickPhases),
+};
+
+constexpr uint8_t kBuiltInProgramCount = sizeof(kBuiltInPrograms) / sizeof(kBuiltInPrograms[0]);
+
+static_assert(kBuiltInPrograms[0].duration == 1800, "Eco should run for 30 minutes");
+static_assert(kBuiltInPrograms[1].duration == 3600, "Chef should run for 60 minutes");
+static_assert(kBuiltInPrograms[2].duration == 5400, "Quick should run for 90 minutes");
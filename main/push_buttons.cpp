@@ -0,0 +1,291 @@
+#include "push_buttons.h"
+#include <esp_err.h>
+#include <esp_log.h>
+#include <esp_sleep.h>
+#include <esp_timer.h>
+#include <string.h>
+
+#define BUTTON_DEBOUNCE_US (CONFIG_DISHWASHER_BUTTON_DEBOUNCE_MS * 1000LL)
+#define BUTTON_LONG_PRESS_US (CONFIG_DISHWASHER_BUTTON_LONG_PRESS_MS * 1000LL)
+
+static const char *TAG = "push_buttons";
+
+PushButtons PushButtons::sPushButtons;
+
+esp_err_t PushButtons::Add(gpio_num_t pin, uint8_t activeLevel, Callback click, Callback longPress)
+{
+    if (mCount == kMaxButtons || mTask != nullptr)
+    {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    Button &button = mButtons[mCount++];
+
+    button.pin = pin;
+    button.activeLevel = activeLevel;
+    button.click = click;
+    button.longPress = longPress;
+    button.state = kReleased;
+
+    return ESP_OK;
+}
+
+esp_err_t PushButtons::Init()
+{
+    ESP_LOGI(TAG, "PushButtons::Init()");
+
+    // Others may have installed the ISR service already.
+    //
+    esp_err_t err = gpio_install_isr_service(0);
+
+    if (err != ESP_OK && err != ESP_ERR_INVALID_STATE)
+    {
+        return err;
+    }
+
+    if (xTaskCreate(ButtonTask, "PushButtons", 3072, NULL, tskIDLE_PRIORITY + 2, &mTask) != pdPASS)
+    {
+        return ESP_ERR_NO_MEM;
+    }
+
+    for (int i = 0; i < mCount; i++)
+    {
+        Button &button = mButtons[i];
+
+        gpio_config_t config = {
+            .pin_bit_mask = 1ULL << button.pin,
+            .mode = GPIO_MODE_INPUT,
+            .pull_up_en = button.activeLevel == 0 ? GPIO_PULLUP_ENABLE : GPIO_PULLUP_DISABLE,
+            .pull_down_en = button.activeLevel == 1 ? GPIO_PULLDOWN_ENABLE : GPIO_PULLDOWN_DISABLE,
+            .intr_type = GPIO_INTR_DISABLE,
+        };
+
+        ESP_ERROR_CHECK(gpio_config(&config));
+        ESP_ERROR_CHECK(gpio_isr_handler_add(button.pin, OnLevel, (void *)(intptr_t)i));
+
+        Arm(button, button.activeLevel);
+    }
+
+    // Only wakes the chip once light sleep is in use, by power management.
+    //
+    ESP_ERROR_CHECK(esp_sleep_enable_gpio_wakeup());
+
+    return ESP_OK;
+}
+
+void PushButtons::Arm(Button &button, uint8_t level)
+{
+    // Sets the pin to interrupt on the level, and to wake from light sleep on it too.
+    // If the pin is already at that level, it interrupts straight away.
+    //
+    gpio_wakeup_enable(button.pin, level == 1 ? GPIO_INTR_HIGH_LEVEL : GPIO_INTR_LOW_LEVEL);
+    gpio_intr_enable(button.pin);
+}
+
+void PushButtons::OnLevel(void *arg)
+{
+    int index = (int)(intptr_t)arg;
+    int64_t now = esp_timer_get_time();
+
+    // The level holds, so it would interrupt again straight away. The task arms the pin
+    // for the opposite level once it has debounced this one.
+    //
+    gpio_intr_disable(sPushButtons.mButtons[index].pin);
+
+    portENTER_CRITICAL_ISR(&sPushButtons.mLock);
+    sPushButtons.mChanged |= 1 << index;
+    sPushButtons.mChangedAt[index] = now;
+    sPushButtons.mStatistics.interrupts++;
+    portEXIT_CRITICAL_ISR(&sPushButtons.mLock);
+
+    BaseType_t woken = pdFALSE;
+    vTaskNotifyGiveFromISR(sPushButtons.mTask, &woken);
+    portYIELD_FROM_ISR(woken);
+}
+
+void PushButtons::ButtonTask(void *arg)
+{
+    PushButtons &buttons = sPushButtons;
+    TickType_t wait = portMAX_DELAY;
+
+    while (true)
+    {
+        // Blocked indefinitely unless a button is being debounced or held.
+        //
+        ulTaskNotifyTake(pdTRUE, wait);
+
+        int64_t now = esp_timer_get_time();
+
+        portENTER_CRITICAL(&buttons.mLock);
+        uint32_t changed = buttons.mChanged;
+        int64_t changedAt[kMaxButtons];
+        memcpy(changedAt, buttons.mChangedAt, sizeof(changedAt));
+        buttons.mChanged = 0;
+        buttons.mStatistics.wakeups++;
+        portEXIT_CRITICAL(&buttons.mLock);
+
+        int64_t next = 0;
+
+        for (int i = 0; i < buttons.mCount; i++)
+        {
+            Button &button = buttons.mButtons[i];
+
+            if (changed & (1 << i))
+            {
+                buttons.Change(button, changedAt[i]);
+            }
+
+            int64_t deadline = buttons.Update(button, now);
+
+            if (deadline != 0 && (next == 0 || deadline < next))
+            {
+                next = deadline;
+            }
+        }
+
+        // Rounded up, so the task never wakes just before a deadline.
+        //
+        wait = next == 0 ? portMAX_DELAY : pdMS_TO_TICKS(((next - now) + 999) / 1000) + 1;
+    }
+}
+
+void PushButtons::Change(Button &button, int64_t at)
+{
+    switch (button.state)
+    {
+    case kReleased:
+        button.state = kPressing;
+        break;
+
+    case kPressed:
+        button.state = kReleasing;
+        break;
+
+    default:
+        // Still bouncing, so the debounce starts again from this change.
+        //
+        portENTER_CRITICAL(&mLock);
+        mStatistics.bounces++;
+        portEXIT_CRITICAL(&mLock);
+        break;
+    }
+
+    button.changedAt = at;
+
+    // Until the debounce ends, the pin interrupts on any further change, so the button
+    // has to hold its level for the whole of it. If the level has already changed back
+    // by now, this interrupts straight away.
+    //
+    Arm(button, !gpio_get_level(button.pin));
+}
+
+int64_t PushButtons::Update(Button &button, int64_t now)
+{
+    // Returns when the button next needs looking at, or 0 if only an interrupt will change
+    // it.
+    //
+    switch (button.state)
+    {
+    case kReleased:
+        return 0;
+
+    case kPressing:
+        if (now < button.changedAt + BUTTON_DEBOUNCE_US)
+        {
+            return button.changedAt + BUTTON_DEBOUNCE_US;
+        }
+
+        if (gpio_get_level(button.pin) != button.activeLevel)
+        {
+            portENTER_CRITICAL(&mLock);
+            mStatistics.bounces++;
+            portEXIT_CRITICAL(&mLock);
+
+            button.state = kReleased;
+            Arm(button, button.activeLevel);
+            return 0;
+        }
+
+        button.state = kPressed;
+        button.pressedAt = button.changedAt;
+        button.longPressed = false;
+        Arm(button, !button.activeLevel);
+        return Update(button, now);
+
+    case kPressed:
+        if (button.longPress == nullptr || button.longPressed)
+        {
+            return 0;
+        }
+
+        if (now < button.pressedAt + BUTTON_LONG_PRESS_US)
+        {
+            return button.pressedAt + BUTTON_LONG_PRESS_US;
+        }
+
+        button.longPressed = true;
+
+        portENTER_CRITICAL(&mLock);
+        mStatistics.longPresses++;
+        portEXIT_CRITICAL(&mLock);
+
+        Report(button.longPress, button.pressedAt + BUTTON_LONG_PRESS_US);
+        return 0;
+
+    case kReleasing:
+        if (now < button.changedAt + BUTTON_DEBOUNCE_US)
+        {
+            return button.changedAt + BUTTON_DEBOUNCE_US;
+        }
+
+        if (gpio_get_level(button.pin) == button.activeLevel)
+        {
+            portENTER_CRITICAL(&mLock);
+            mStatistics.bounces++;
+            portEXIT_CRITICAL(&mLock);
+
+            button.state = kPressed;
+            Arm(button, !button.activeLevel);
+            return Update(button, now);
+        }
+
+        button.state = kReleased;
+        Arm(button, button.activeLevel);
+
+        if (!button.longPressed)
+        {
+            portENTER_CRITICAL(&mLock);
+            mStatistics.clicks++;
+            portEXIT_CRITICAL(&mLock);
+
+            Report(button.click, button.changedAt);
+        }
+        return 0;
+    }
+
+    return 0;
+}
+
+void PushButtons::Report(Callback callback, int64_t since)
+{
+    uint32_t latency = esp_timer_get_time() - since;
+
+    portENTER_CRITICAL(&mLock);
+    mStatistics.latencyTotal += latency;
+    mStatistics.latencyMax = latency > mStatistics.latencyMax ? latency : mStatistics.latencyMax;
+    portEXIT_CRITICAL(&mLock);
+
+    if (callback != nullptr)
+    {
+        callback();
+    }
+}
+
+PushButtons::Statistics PushButtons::GetStatistics()
+{
+    portENTER_CRITICAL(&mLock);
+    Statistics statistics = mStatistics;
+    portEXIT_CRITICAL(&mLock);
+
+    return statistics;
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <stdio.h>
+#include <esp_err.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include <inttypes.h>
+
+#include <driver/gpio.h>
+
+// The dishwasher's push buttons, driven by GPIO interrupts.
+//
+// Nothing scans them. Each button's pin interrupts on the level it would change to, so an
+// idle button costs nothing, and the same level wakes the chip from light sleep. The
+// interrupt only notifies the task, which then times the debounce, restarting it on every
+// change until the level holds, and the long press while a button is held, before
+// waiting for the pin's next interrupt. Being on a level rather than an edge, a change
+// that happens while the task is busy is never missed.
+//
+// A click is a press released before it reaches the long press. A press held that long
+// is reported as soon as it does, and releasing it is not a click. Callbacks run on the
+// buttons' task.
+//
+class PushButtons
+{
+public:
+    typedef void (*Callback)();
+
+    static constexpr int kMaxButtons = 3;
+
+    // Buttons are added before Init. longPress may be nullptr.
+    //
+    esp_err_t Add(gpio_num_t pin, uint8_t activeLevel, Callback click, Callback longPress = nullptr);
+    esp_err_t Init();
+
+    // So the time from a button to its callback, and how often the task wakes, can be
+    // measured.
+    //
+    struct Statistics
+    {
+        uint32_t interrupts;   // Level changes seen by the ISR
+        uint32_t wakeups;      // Times the task woke, for an interrupt or a deadline
+        uint32_t bounces;      // Changes during a debounce, and debounces that ended where they started
+        uint32_t clicks;
+        uint32_t longPresses;
+        uint64_t latencyTotal; // Microseconds from a release, or reaching the long press, to the callback
+        uint32_t latencyMax;
+    };
+
+    Statistics GetStatistics();
+
+private:
+    friend PushButtons & PushButtonsMgr(void);
+    static PushButtons sPushButtons;
+
+    enum State : uint8_t
+    {
+        kReleased,
+        kPressing,  // Debouncing a press
+        kPressed,
+        kReleasing, // Debouncing a release
+    };
+
+    struct Button
+    {
+        gpio_num_t pin;
+        uint8_t activeLevel;
+        Callback click;
+        Callback longPress;
+        State state;
+        bool longPressed; // This press has been reported as a long press
+        int64_t changedAt; // When the level last changed, while debouncing
+        int64_t pressedAt;
+    };
+
+    static void OnLevel(void *arg);
+    static void ButtonTask(void *arg);
+
+    void Arm(Button &button, uint8_t level);
+    void Change(Button &button, int64_t at);
+    int64_t Update(Button &button, int64_t now);
+    void Report(Callback callback, int64_t since);
+
+    Button mButtons[kMaxButtons] = {};
+    int mCount = 0;
+    TaskHandle_t mTask = nullptr;
+
+    // Written by OnLevel and read by the task. A bit per button whose level has changed,
+    // and when.
+    //
+    portMUX_TYPE mLock = portMUX_INITIALIZER_UNLOCKED;
+    uint32_t mChanged = 0;
+    int64_t mChangedAt[kMaxButtons] = {};
+    Statistics mStatistics = {};
+};
+
+inline PushButtons & PushButtonsMgr(void)
+{
+    return PushButtons::sPushButtons;
+}
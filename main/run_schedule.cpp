@@ -0,0 +1,372 @@
+#include "run_schedule.h"
+
+#include <esp_log.h>
+#include <nvs.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "dishwasher_manager.h"
+#include "program_catalog.h"
+#include "utc_time.h"
+
+static const char *TAG = "run_schedule";
+
+#define SCHEDULE_NVS_NAMESPACE "dishwasher"
+#define SCHEDULE_NVS_KEY "schedule"
+
+#define SECONDS_PER_DAY 86400
+#define SECONDS_PER_WEEK (7 * SECONDS_PER_DAY)
+
+// A run that was due while we were powered off is still started if we come back within
+// this long. Anything older is skipped.
+//
+#define SCHEDULE_GRACE_PERIOD 3600
+
+RunSchedule RunSchedule::sRunSchedule;
+
+void RunSchedule::TimerCallback(void *arg)
+{
+    DishwasherMgr().PostCommand(DishwasherCommand::kRunScheduled);
+}
+
+esp_err_t RunSchedule::Init()
+{
+    ESP_LOGI(TAG, "RunSchedule::Init()");
+
+    mMutex = xSemaphoreCreateMutex();
+    memset(mPositions, kNotScheduled, sizeof(mPositions));
+
+    const esp_timer_create_args_t timer_args = {
+        .callback = TimerCallback,
+        .arg = NULL,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "schedule",
+        .skip_unhandled_events = true,
+    };
+
+    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &mTimer));
+
+    nvs_handle_t handle;
+
+    if (nvs_open(SCHEDULE_NVS_NAMESPACE, NVS_READONLY, &handle) == ESP_OK)
+    {
+        ScheduledRun runs[kCapacity];
+        size_t length = sizeof(runs);
+
+        if (nvs_get_blob(handle, SCHEDULE_NVS_KEY, runs, &length) == ESP_OK)
+        {
+            for (size_t i = 0; i < length / sizeof(ScheduledRun); i++)
+            {
+                // A corrupt or old blob could hold anything, and the id and repeat are used
+                // as indexes.
+                //
+                if (runs[i].id < kCapacity && mPositions[runs[i].id] == kNotScheduled && runs[i].mode < GetProgramCount() &&
+                    runs[i].repeat <= ScheduledRun::kWeekly)
+                {
+                    Insert(runs[i]);
+                }
+            }
+        }
+
+        nvs_close(handle);
+    }
+
+    ESP_LOGI(TAG, "Loaded %d scheduled runs", mCount);
+
+    Arm();
+
+    return ESP_OK;
+}
+
+esp_err_t RunSchedule::Add(uint8_t mode, uint32_t startTime, ScheduledRun::Repeat repeat, uint8_t &id)
+{
+    if (mode >= GetProgramCount())
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    xSemaphoreTake(mMutex, portMAX_DELAY);
+
+    if (mCount >= kCapacity)
+    {
+        xSemaphoreGive(mMutex);
+        return ESP_ERR_NO_MEM;
+    }
+
+    // With the heap not full, there is always a free id.
+    //
+    id = 0;
+
+    while (mPositions[id] != kNotScheduled)
+    {
+        id++;
+    }
+
+    ScheduledRun run = {};
+    run.startTime = startTime;
+    run.mode = mode;
+    run.repeat = repeat;
+    run.id = id;
+
+    Insert(run);
+    Save();
+    Arm();
+
+    xSemaphoreGive(mMutex);
+
+    ESP_LOGI(TAG, "Scheduled run %d: mode %d at %lu (repeat %d)", id, mode, startTime, repeat);
+
+    return ESP_OK;
+}
+
+esp_err_t RunSchedule::Cancel(uint8_t id)
+{
+    if (id >= kCapacity)
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    xSemaphoreTake(mMutex, portMAX_DELAY);
+
+    if (mPositions[id] == kNotScheduled)
+    {
+        xSemaphoreGive(mMutex);
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    RemoveAt(mPositions[id]);
+    Save();
+    Arm();
+
+    xSemaphoreGive(mMutex);
+
+    ESP_LOGI(TAG, "Cancelled run %d", id);
+
+    return ESP_OK;
+}
+
+uint8_t RunSchedule::List(ScheduledRun *runs, uint8_t capacity)
+{
+    xSemaphoreTake(mMutex, portMAX_DELAY);
+
+    uint8_t count = std::min(capacity, mCount);
+    memcpy(runs, mHeap, count * sizeof(ScheduledRun));
+
+    xSemaphoreGive(mMutex);
+
+    // Only the root of the heap is in order, and there are so few runs that a simple
+    // insertion sort is plenty.
+    //
+    for (uint8_t i = 1; i < count; i++)
+    {
+        for (uint8_t j = i; j > 0 && runs[j].startTime < runs[j - 1].startTime; j--)
+        {
+            std::swap(runs[j], runs[j - 1]);
+        }
+    }
+
+    return count;
+}
+
+bool RunSchedule::TakeDue(ScheduledRun &run)
+{
+    uint32_t now = GetUtcTime();
+    bool found = false;
+    bool changed = false;
+
+    if (now == 0)
+    {
+        return false;
+    }
+
+    xSemaphoreTake(mMutex, portMAX_DELAY);
+
+    while (!found && mCount > 0 && mHeap[0].startTime <= now + CONFIG_DISHWASHER_SCHEDULE_LEAD_TIME)
+    {
+        run = mHeap[0];
+        RemoveAt(0);
+        changed = true;
+
+        found = run.startTime + SCHEDULE_GRACE_PERIOD >= now;
+
+        if (!found)
+        {
+            ESP_LOGW(TAG, "Missed run %d, which was due at %lu", run.id, run.startTime);
+        }
+
+        if (run.repeat != ScheduledRun::kOnce)
+        {
+            ScheduledRun next = run;
+            uint32_t period = run.repeat == ScheduledRun::kDaily ? SECONDS_PER_DAY : SECONDS_PER_WEEK;
+
+            while (next.startTime <= now + CONFIG_DISHWASHER_SCHEDULE_LEAD_TIME)
+            {
+                next.startTime += period;
+            }
+
+            Insert(next);
+        }
+    }
+
+    if (changed)
+    {
+        Save();
+        Arm();
+    }
+
+    xSemaphoreGive(mMutex);
+
+    return found;
+}
+
+void RunSchedule::Rearm()
+{
+    xSemaphoreTake(mMutex, portMAX_DELAY);
+    Arm();
+    xSemaphoreGive(mMutex);
+}
+
+// Everything below expects mMutex to be held.
+//
+
+void RunSchedule::Insert(const ScheduledRun &run)
+{
+    mHeap[mCount] = run;
+    mPositions[run.id] = mCount;
+    mCount++;
+
+    SiftUp(mCount - 1);
+}
+
+void RunSchedule::RemoveAt(uint8_t index)
+{
+    mPositions[mHeap[index].id] = kNotScheduled;
+    mCount--;
+
+    if (index == mCount)
+    {
+        return;
+    }
+
+    // Fill the hole with the last run, then move it whichever way it needs to go.
+    //
+    mHeap[index] = mHeap[mCount];
+    mPositions[mHeap[index].id] = index;
+
+    if (index > 0 && mHeap[index].startTime < mHeap[(index - 1) / 2].startTime)
+    {
+        SiftUp(index);
+    }
+    else
+    {
+        SiftDown(index);
+    }
+}
+
+void RunSchedule::SiftUp(uint8_t index)
+{
+    while (index > 0)
+    {
+        uint8_t parent = (index - 1) / 2;
+
+        if (mHeap[parent].startTime <= mHeap[index].startTime)
+        {
+            break;
+        }
+
+        Swap(parent, index);
+        index = parent;
+    }
+}
+
+void RunSchedule::SiftDown(uint8_t index)
+{
+    while (true)
+    {
+        uint8_t smallest = index;
+        uint8_t left = (2 * index) + 1;
+        uint8_t right = left + 1;
+
+        if (left < mCount && mHeap[left].startTime < mHeap[smallest].startTime)
+        {
+            smallest = left;
+        }
+
+        if (right < mCount && mHeap[right].startTime < mHeap[smallest].startTime)
+        {
+            smallest = right;
+        }
+
+        if (smallest == index)
+        {
+            break;
+        }
+
+        Swap(smallest, index);
+        index = smallest;
+    }
+}
+
+void RunSchedule::Swap(uint8_t a, uint8_t b)
+{
+    std::swap(mHeap[a], mHeap[b]);
+    mPositions[mHeap[a].id] = a;
+    mPositions[mHeap[b].id] = b;
+}
+
+void RunSchedule::Arm()
+{
+    esp_timer_stop(mTimer);
+
+    uint32_t now = GetUtcTime();
+
+    // Without the wall clock we can't know when anything is due. Rearm() is called once
+    // the time has been synced.
+    //
+    if (mCount == 0 || now == 0)
+    {
+        return;
+    }
+
+    uint32_t fireAt = mHeap[0].startTime - std::min(mHeap[0].startTime, (uint32_t)CONFIG_DISHWASHER_SCHEDULE_LEAD_TIME);
+    uint64_t delay = fireAt > now ? (uint64_t)(fireAt - now) * 1000000ULL : 0;
+
+    ESP_LOGI(TAG, "Next run %d is due at %lu, waking in %llus", mHeap[0].id, mHeap[0].startTime, delay / 1000000ULL);
+
+    esp_timer_start_once(mTimer, delay);
+}
+
+void RunSchedule::Save()
+{
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(SCHEDULE_NVS_NAMESPACE, NVS_READWRITE, &handle);
+
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to open NVS: %s", esp_err_to_name(err));
+        return;
+    }
+
+    if (mCount > 0)
+    {
+        err = nvs_set_blob(handle, SCHEDULE_NVS_KEY, mHeap, mCount * sizeof(ScheduledRun));
+    }
+    else
+    {
+        err = nvs_erase_key(handle, SCHEDULE_NVS_KEY);
+        err = err == ESP_ERR_NVS_NOT_FOUND ? ESP_OK : err;
+    }
+
+    if (err == ESP_OK)
+    {
+        err = nvs_commit(handle);
+    }
+
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to save schedule: %s", esp_err_to_name(err));
+    }
+
+    nvs_close(handle);
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <stdio.h>
+#include <esp_err.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+
+#include <inttypes.h>
+
+struct ScheduledRun
+{
+    enum Repeat : uint8_t
+    {
+        kOnce = 0,
+        kDaily,
+        kWeekly,
+    };
+
+    uint32_t startTime; // UTC, seconds since the Unix epoch
+    uint8_t mode;
+    uint8_t repeat;
+    uint8_t id;
+    uint8_t reserved;
+};
+
+// Future program runs, kept in a fixed capacity min-heap ordered by start time.
+//
+// Only the earliest run matters, so a single esp_timer is armed for it and nothing is
+// ever polled. Each run is handed to the DishwasherManager a little before it is due to
+// start, so the DEM forecast for it is published in advance. The heap is saved to NVS
+// after every change.
+//
+// Add, Cancel and List may be called from any task.
+//
+class RunSchedule
+{
+public:
+    static constexpr uint8_t kCapacity = 8;
+
+    esp_err_t Init();
+
+    esp_err_t Add(uint8_t mode, uint32_t startTime, ScheduledRun::Repeat repeat, uint8_t &id);
+    esp_err_t Cancel(uint8_t id);
+
+    // Copies the scheduled runs, earliest first. Returns how many were copied.
+    //
+    uint8_t List(ScheduledRun *runs, uint8_t capacity);
+
+    // Called by the DishwasherManager when the timer fires. Returns each run that is now
+    // due, rescheduling any that repeat.
+    //
+    bool TakeDue(ScheduledRun &run);
+
+    // Call when the wall clock changes, e.g. after an SNTP sync.
+    //
+    void Rearm();
+
+private:
+    friend RunSchedule &RunScheduleMgr(void);
+    static RunSchedule sRunSchedule;
+
+    static constexpr uint8_t kNotScheduled = 0xFF;
+
+    static void TimerCallback(void *arg);
+
+    void Insert(const ScheduledRun &run);
+    void RemoveAt(uint8_t index);
+    void SiftUp(uint8_t index);
+    void SiftDown(uint8_t index);
+    void Swap(uint8_t a, uint8_t b);
+
+    void Arm();
+    void Save();
+
+    SemaphoreHandle_t mMutex = nullptr;
+    esp_timer_handle_t mTimer = nullptr;
+
+    ScheduledRun mHeap[kCapacity];
+    uint8_t mCount = 0;
+
+    // Where each run id currently sits in mHeap, so a run can be cancelled without a search.
+    //
+    uint8_t mPositions[kCapacity];
+};
+
+inline RunSchedule &RunScheduleMgr(void)
+{
+    return RunSchedule::sRunSchedule;
+}
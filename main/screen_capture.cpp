@@ -0,0 +1,182 @@
+#include "screen_capture.h"
+
+#if CONFIG_DISHWASHER_DISPLAY_CAPTURE
+
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+#include "mbedtls/base64.h"
+#include <string.h>
+
+#include "status_display.h"
+
+static const char *TAG = "screen_capture";
+
+ScreenCapture ScreenCapture::sScreenCapture;
+
+// Prints bytes base64 encoded as they are produced, so an encoded frame never has to be
+// held in full.
+//
+class Base64Printer
+{
+public:
+    void Put(uint8_t byte)
+    {
+        mPending[mCount++] = byte;
+        mTotal++;
+
+        if (mCount == sizeof(mPending))
+        {
+            Print();
+        }
+    }
+
+    // Prints whatever is left, padded. Returns the bytes encoded.
+    //
+    size_t Finish()
+    {
+        Print();
+        return mTotal;
+    }
+
+private:
+    void Print()
+    {
+        // Four characters for every three bytes, and a terminator.
+        //
+        unsigned char encoded[((sizeof(mPending) / 3) * 4) + 1];
+        size_t length = 0;
+
+        if (mCount > 0 && mbedtls_base64_encode(encoded, sizeof(encoded), &length, mPending, mCount) == 0)
+        {
+            fwrite(encoded, 1, length, stdout);
+        }
+
+        mCount = 0;
+    }
+
+    uint8_t mPending[48]; // A multiple of three, so only the last chunk is padded
+    size_t mCount = 0;
+    size_t mTotal = 0;
+};
+
+esp_err_t ScreenCapture::Init()
+{
+    mCaptured = xSemaphoreCreateBinary();
+
+    return mCaptured != nullptr ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+void ScreenCapture::Grab(DisplayBackend &backend, bool on)
+{
+    mFormat = backend.Capture(mFrame);
+    mOn = on;
+
+    xSemaphoreGive(mCaptured);
+}
+
+esp_err_t ScreenCapture::Stream(uint32_t frames, uint32_t intervalMs)
+{
+    DisplayBackend::CaptureFormat previousFormat = {};
+    size_t total = 0;
+    size_t first = 0;
+
+    for (uint32_t i = 0; i < frames; i++)
+    {
+        // Forget any capture left over from a stream that timed out.
+        //
+        xSemaphoreTake(mCaptured, 0);
+
+        StatusDisplayMgr().RequestCapture();
+
+        if (xSemaphoreTake(mCaptured, pdMS_TO_TICKS(kTimeoutMs)) != pdTRUE)
+        {
+            ESP_LOGE(TAG, "Timed out waiting for the display");
+            return ESP_ERR_TIMEOUT;
+        }
+
+        if (mFormat.layout == DisplayBackend::kCaptureNone)
+        {
+            ESP_LOGE(TAG, "%s display can't be captured", GetDisplayBackend().GetName());
+            return ESP_ERR_NOT_SUPPORTED;
+        }
+
+        size_t size = (mFormat.width * mFormat.height) / 8;
+        bool key = i == 0 || mFormat.layout != previousFormat.layout || mFormat.width != previousFormat.width || mFormat.height != previousFormat.height;
+
+        printf("CAPTURE %lu %c %c %u %u %s %08lx ", mSequence++, key ? 'K' : 'D', mFormat.layout == DisplayBackend::kCapturePages ? 'P' : 'R', mFormat.width,
+               mFormat.height, mOn ? "on" : "off", esp_rom_crc32_le(0, mFrame, size));
+
+        size_t encoded = Encode(key ? nullptr : mPrevious, size);
+
+        printf("\r\n");
+
+        memcpy(mPrevious, mFrame, size);
+        previousFormat = mFormat;
+
+        first = i == 0 ? encoded : first;
+        total += encoded;
+
+        if (i + 1 < frames)
+        {
+            vTaskDelay(pdMS_TO_TICKS(intervalMs));
+        }
+    }
+
+    printf("%lu frames, %zu bytes encoded (%zu for the first)\r\n", frames, total, first);
+
+    return ESP_OK;
+}
+
+size_t ScreenCapture::Encode(const uint8_t *previous, size_t size)
+{
+    // PackBits. A header byte n from 0 to 127 is followed by n + 1 literal bytes, and one
+    // from 129 to 255 by a single byte repeated 257 - n times.
+    //
+    auto at = [&](size_t i) -> uint8_t { return previous != nullptr ? mFrame[i] ^ previous[i] : mFrame[i]; };
+
+    Base64Printer out;
+    size_t i = 0;
+
+    while (i < size)
+    {
+        size_t run = 1;
+
+        while (i + run < size && run < 128 && at(i + run) == at(i))
+        {
+            run++;
+        }
+
+        if (run >= 2)
+        {
+            out.Put(257 - run);
+            out.Put(at(i));
+            i += run;
+            continue;
+        }
+
+        // Literals, up to the next run of three or more, which is cheaper repeated.
+        //
+        size_t start = i;
+
+        while (i < size && i - start < 128)
+        {
+            if (i + 2 < size && at(i) == at(i + 1) && at(i) == at(i + 2))
+            {
+                break;
+            }
+
+            i++;
+        }
+
+        out.Put(i - start - 1);
+
+        for (size_t j = start; j < i; j++)
+        {
+            out.Put(at(j));
+        }
+    }
+
+    return out.Finish();
+}
+
+#endif // CONFIG_DISHWASHER_DISPLAY_CAPTURE
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <stdio.h>
+#include <esp_err.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include <inttypes.h>
+
+#include "display_backend.h"
+
+// Captures what the status display shows and streams it over the console, so the screen
+// of a unit in the field can be seen remotely. tools/screen_capture.py turns the output
+// back into images.
+//
+// A capture is taken by the StatusDisplay's render task, at the end of a frame, from the
+// copy of the screen the backend keeps anyway. Nothing is done on the flush path unless a
+// capture has been asked for, and then it is a single copy.
+//
+// The first frame of a stream is sent whole and each one after it as the XOR with the
+// frame before, so an unchanged screen is almost all zeros. Either is compressed with
+// PackBits run-length encoding, and printed base64 encoded on one line:
+//
+//     CAPTURE <sequence> <K|D> <P|R> <width> <height> <on|off> <crc32> <base64>
+//
+// K is a whole frame and D a delta. P and R are DisplayBackend::kCapturePages and
+// kCaptureRows. The CRC32 is of the whole decoded frame, so a missed line is noticed.
+//
+// Only one console command may stream at a time.
+//
+class ScreenCapture
+{
+public:
+    esp_err_t Init();
+
+    // Streams frames captures, intervalMs apart. Called by the console.
+    //
+    esp_err_t Stream(uint32_t frames, uint32_t intervalMs);
+
+    // Called by the StatusDisplay's render task when a capture has been asked for, with
+    // the screen as it has just been drawn.
+    //
+    void Grab(DisplayBackend &backend, bool on);
+
+private:
+    friend ScreenCapture &ScreenCaptureMgr(void);
+    static ScreenCapture sScreenCapture;
+
+    static constexpr uint32_t kTimeoutMs = 2000;
+
+    size_t Encode(const uint8_t *previous, size_t size);
+
+    SemaphoreHandle_t mCaptured = nullptr; // Given by Grab
+
+    // Written by Grab, then read by Stream once mCaptured has been given.
+    //
+    uint8_t mFrame[DisplayBackend::kMaxCaptureSize];
+    DisplayBackend::CaptureFormat mFormat = {};
+    bool mOn = false;
+
+    // Only used by Stream.
+    //
+    uint8_t mPrevious[DisplayBackend::kMaxCaptureSize];
+    uint32_t mSequence = 0;
+};
+
+inline ScreenCapture &ScreenCaptureMgr(void)
+{
+    return ScreenCapture::sScreenCapture;
+}
@@ -0,0 +1,167 @@
+#include "ssd1306_backend.h"
+
+#if CONFIG_DISHWASHER_DISPLAY_SSD1306
+
+#include "driver/gpio.h"
+#include "driver/i2c_master.h"
+#include "esp_log.h"
+
+#include "esp_lcd_panel_vendor.h"
+#include "esp_lvgl_port.h"
+
+#include "panel_flush.h"
+
+static const char *TAG = "ssd1306_backend";
+
+#define I2C_BUS_PORT 0
+
+// TODO Move to configuration
+//
+#define EXAMPLE_LCD_PIXEL_CLOCK_HZ CONFIG_DISHWASHER_DISPLAY_I2C_SPEED
+#define EXAMPLE_PIN_NUM_SDA 22
+#define EXAMPLE_PIN_NUM_SCL 23
+#define EXAMPLE_PIN_NUM_RST 16
+#define EXAMPLE_I2C_HW_ADDR 0x3C
+
+#define EXAMPLE_LCD_CMD_BITS 8
+#define EXAMPLE_LCD_PARAM_BITS 8
+
+#define EXAMPLE_LCD_H_RES 128
+#define EXAMPLE_LCD_V_RES 64
+
+static_assert(EXAMPLE_LCD_H_RES == kPanelWidth && EXAMPLE_LCD_V_RES == kPanelHeight, "PanelFlush's shadow must match the panel");
+
+esp_err_t Ssd1306Backend::InitPanel()
+{
+    ESP_LOGI(TAG, "Initialize I2C bus");
+    i2c_master_bus_handle_t i2c_bus = NULL;
+    i2c_master_bus_config_t bus_config = {
+        .i2c_port = I2C_BUS_PORT,
+        .sda_io_num = (gpio_num_t)EXAMPLE_PIN_NUM_SDA,
+        .scl_io_num = (gpio_num_t)EXAMPLE_PIN_NUM_SCL,
+        .clk_source = I2C_CLK_SRC_DEFAULT,
+        .glitch_ignore_cnt = 7,
+        .flags = {
+            .enable_internal_pullup = true,
+        }};
+    ESP_ERROR_CHECK(i2c_new_master_bus(&bus_config, &i2c_bus));
+
+    ESP_LOGI(TAG, "Install panel IO");
+    esp_lcd_panel_io_i2c_config_t io_config = {
+        .dev_addr = EXAMPLE_I2C_HW_ADDR,
+        .control_phase_bytes = 1,
+        .dc_bit_offset = 6,                     // According to SSD1306 datasheet
+        .lcd_cmd_bits = EXAMPLE_LCD_CMD_BITS,   // According to SSD1306 datasheet
+        .lcd_param_bits = EXAMPLE_LCD_CMD_BITS, // According to SSD1306 datasheet
+        .scl_speed_hz = EXAMPLE_LCD_PIXEL_CLOCK_HZ,
+    };
+    ESP_ERROR_CHECK(esp_lcd_new_panel_io_i2c(i2c_bus, &io_config, &mIoHandle));
+
+    ESP_LOGI(TAG, "Install SSD1306 panel driver");
+    esp_lcd_panel_dev_config_t panel_config = {
+        .reset_gpio_num = EXAMPLE_PIN_NUM_RST,
+        .bits_per_pixel = 1,
+    };
+
+    esp_lcd_panel_ssd1306_config_t ssd1306_config = {
+        .height = EXAMPLE_LCD_V_RES,
+    };
+    panel_config.vendor_config = &ssd1306_config;
+    ESP_ERROR_CHECK(esp_lcd_new_panel_ssd1306(mIoHandle, &panel_config, &mPanelHandle));
+
+    ESP_ERROR_CHECK(esp_lcd_panel_reset(mPanelHandle));
+    ESP_ERROR_CHECK(esp_lcd_panel_init(mPanelHandle));
+
+    // Start dark. The DishwasherManager turns the display on when the dishwasher is.
+    //
+    ESP_ERROR_CHECK(esp_lcd_panel_disp_on_off(mPanelHandle, false));
+
+    return ESP_OK;
+}
+
+lv_disp_t *Ssd1306Backend::Init()
+{
+#if CONFIG_DISHWASHER_DISPLAY_DIRECT
+    return nullptr;
+#else
+    InitPanel();
+
+    const lvgl_port_display_cfg_t disp_cfg = {
+        .io_handle = mIoHandle,
+        .panel_handle = mPanelHandle,
+        .buffer_size = EXAMPLE_LCD_H_RES * EXAMPLE_LCD_V_RES,
+        .double_buffer = true,
+        .hres = EXAMPLE_LCD_H_RES,
+        .vres = EXAMPLE_LCD_V_RES,
+        .monochrome = true,
+        .rotation = {
+            .swap_xy = false,
+            .mirror_x = false,
+            .mirror_y = false,
+        }};
+
+    lv_disp_t *display = lvgl_port_add_disp(&disp_cfg);
+
+    // The module is mounted upside down.
+    //
+    lv_disp_set_rotation(display, LV_DISP_ROT_180);
+
+    // Only send the panel what has changed.
+    //
+    PanelFlushMgr().Attach(display, mIoHandle, mPanelHandle);
+
+    return display;
+#endif
+}
+
+esp_err_t Ssd1306Backend::InitDirect()
+{
+    InitPanel();
+
+    // The module is mounted upside down, which the panel can rotate for itself.
+    //
+    ESP_ERROR_CHECK(esp_lcd_panel_mirror(mPanelHandle, true, true));
+
+    PanelFlushMgr().Start(mIoHandle, mPanelHandle);
+
+    return ESP_OK;
+}
+
+void Ssd1306Backend::Present(const uint8_t *frame, SemaphoreHandle_t released)
+{
+    PanelFlushMgr().Present(frame, released);
+}
+
+void Ssd1306Backend::SetPower(bool on)
+{
+    PanelFlushMgr().SetPower(on);
+}
+
+bool Ssd1306Backend::TakeResync()
+{
+    return PanelFlushMgr().TakeResync();
+}
+
+DisplayBackend::CaptureFormat Ssd1306Backend::Capture(uint8_t *frame)
+{
+    PanelFlushMgr().Capture(frame);
+
+    return { kCapturePages, kPanelWidth, kPanelHeight };
+}
+
+DisplayBackend::Statistics Ssd1306Backend::GetStatistics()
+{
+    PanelFlush::Statistics flush = PanelFlushMgr().GetStatistics();
+    Statistics statistics = {};
+
+    statistics.flushes = flush.frames;
+    statistics.bytesRequested = flush.bytesRequested;
+    statistics.bytesSent = flush.bytesSent;
+    statistics.transfers = flush.runs;
+    statistics.queueFull = flush.queueFull;
+    statistics.failures = flush.failures;
+
+    return statistics;
+}
+
+#endif // CONFIG_DISHWASHER_DISPLAY_SSD1306
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "display_backend.h"
+#include "esp_lcd_panel_io.h"
+#include "esp_lcd_panel_ops.h"
+
+// The 128x64 SSD1306 OLED on I2C, registered through esp_lvgl_port. Flushes go through
+// PanelFlush, so only the bytes that changed are sent.
+//
+class Ssd1306Backend : public DisplayBackend
+{
+public:
+    const char *GetName() override { return "SSD1306"; }
+
+    lv_disp_t *Init() override;
+    esp_err_t InitDirect() override;
+    void Present(const uint8_t *frame, SemaphoreHandle_t released) override;
+    void SetPower(bool on) override;
+    bool TakeResync() override;
+    Statistics GetStatistics() override;
+    CaptureFormat Capture(uint8_t *frame) override;
+
+private:
+    esp_err_t InitPanel();
+
+    esp_lcd_panel_io_handle_t mIoHandle = nullptr;
+    esp_lcd_panel_handle_t mPanelHandle = nullptr;
+};
@@ -1,120 +1,225 @@
 #include <stdio.h>
 #include "driver/gpio.h"
+#include "esp_cpu.h"
+#include "esp_heap_caps.h"
 #include "esp_log.h"
 #include "status_display.h"
 
-#include "driver/i2c_master.h"
-
-#include "esp_lcd_panel_io.h"
-#include "esp_lcd_panel_ops.h"
-#include "esp_lcd_panel_vendor.h"
 #include "esp_lvgl_port.h"
 
 #include "lvgl.h"
 
+#include <string.h>
+
+#include "direct_renderer.h"
+#include "commissioning_code.h"
 #include "dishwasher_manager.h"
+#include "display_backend.h"
+#include "heap_guard.h"
+#include "screen_capture.h"
+#include "status_font.h"
 
 static const char *TAG = "status_display";
 
-#define I2C_BUS_PORT 0
+// How long LVGL's task sleeps when it has nothing to do. Frames are drawn by the render
+// task, so this only bounds how often an idle LVGL looks for work.
+//
+#define LVGL_MAX_SLEEP_MS 10000
+
+StatusDisplay StatusDisplay::sStatusDisplay;
+
+#if !CONFIG_DISHWASHER_DISPLAY_DIRECT
 
-// TODO Move to configuration
+// Text that never changes. With the font subset it is a prerendered image.
 //
-#define EXAMPLE_LCD_PIXEL_CLOCK_HZ (400 * 1000)
-#define EXAMPLE_PIN_NUM_SDA 22
-#define EXAMPLE_PIN_NUM_SCL 23
-#define EXAMPLE_PIN_NUM_RST 16
-#define EXAMPLE_I2C_HW_ADDR 0x3C
+static lv_obj_t *CreateFixedText(lv_obj_t *parent, const lv_img_dsc_t *image, const char *text, lv_align_t align)
+{
+    lv_obj_t *obj;
+
+    if (image != nullptr)
+    {
+        obj = lv_img_create(parent);
+        lv_img_set_src(obj, image);
+    }
+    else
+    {
+        obj = lv_label_create(parent);
+        lv_label_set_text_static(obj, text);
+    }
 
-#define EXAMPLE_LCD_CMD_BITS 8
-#define EXAMPLE_LCD_PARAM_BITS 8
+    lv_obj_align(obj, align, 0, 0);
 
-#define EXAMPLE_LCD_H_RES 128
-#define EXAMPLE_LCD_V_RES 64
+    return obj;
+}
 
-StatusDisplay StatusDisplay::sStatusDisplay;
+void StatusDisplay::MonitorCallback(lv_disp_drv_t *driver, uint32_t time, uint32_t pixels)
+{
+    StatusDisplay &display = StatusDisplayMgr();
+
+    portENTER_CRITICAL(&display.mStatisticsLock);
+    display.mStatistics.refreshes++;
+    display.mStatistics.pixelsFlushed += pixels;
+    portEXIT_CRITICAL(&display.mStatisticsLock);
+}
+
+extern "C" uint32_t __real_lv_timer_handler(void);
+
+uint32_t __wrap_lv_timer_handler(void)
+{
+    StatusDisplay &display = StatusDisplayMgr();
+
+    // The render task draws with lv_refr_now and never calls this, so every call is
+    // esp_lvgl_port's task waking up.
+    //
+    portENTER_CRITICAL(&display.mStatisticsLock);
+    display.mLvglTask = xTaskGetCurrentTaskHandle();
+    display.mStatistics.lvglWakeups++;
+    display.mStatistics.lvglIdleWakeups += display.mPowerState != StatusDisplay::kPowerRendering;
+    portEXIT_CRITICAL(&display.mStatisticsLock);
+
+    return __real_lv_timer_handler();
+}
+
+#endif // !CONFIG_DISHWASHER_DISPLAY_DIRECT
 
 esp_err_t StatusDisplay::Init()
 {
     ESP_LOGI(TAG, "StatusDisplay::Init()");
 
-    ESP_LOGI(TAG, "Initialize I2C bus");
-    i2c_master_bus_handle_t i2c_bus = NULL;
-    i2c_master_bus_config_t bus_config = {
-        .i2c_port = I2C_BUS_PORT,
-        .sda_io_num = (gpio_num_t)EXAMPLE_PIN_NUM_SDA,
-        .scl_io_num = (gpio_num_t)EXAMPLE_PIN_NUM_SCL,
-        .clk_source = I2C_CLK_SRC_DEFAULT,
-        .glitch_ignore_cnt = 7,
-        .flags = {
-            .enable_internal_pullup = true,
-        }};
-    ESP_ERROR_CHECK(i2c_new_master_bus(&bus_config, &i2c_bus));
-
-    ESP_LOGI(TAG, "Install panel IO");
-    esp_lcd_panel_io_handle_t io_handle = NULL;
-    esp_lcd_panel_io_i2c_config_t io_config = {
-        .dev_addr = EXAMPLE_I2C_HW_ADDR,
-        .control_phase_bytes = 1,
-        .dc_bit_offset = 6,                     // According to SSD1306 datasheet
-        .lcd_cmd_bits = EXAMPLE_LCD_CMD_BITS,   // According to SSD1306 datasheet
-        .lcd_param_bits = EXAMPLE_LCD_CMD_BITS, // According to SSD1306 datasheet
-        .scl_speed_hz = EXAMPLE_LCD_PIXEL_CLOCK_HZ,
-    };
-    ESP_ERROR_CHECK(esp_lcd_new_panel_io_i2c(i2c_bus, &io_config, &io_handle));
-
-    ESP_LOGI(TAG, "Install SSD1306 panel driver");
-    esp_lcd_panel_dev_config_t panel_config = {
-        .reset_gpio_num = EXAMPLE_PIN_NUM_RST,
-        .bits_per_pixel = 1,
-    };
-
-    esp_lcd_panel_ssd1306_config_t ssd1306_config = {
-        .height = EXAMPLE_LCD_V_RES,
-    };
-    panel_config.vendor_config = &ssd1306_config;
-    ESP_ERROR_CHECK(esp_lcd_new_panel_ssd1306(io_handle, &panel_config, &mPanelHandle));
-
-    ESP_ERROR_CHECK(esp_lcd_panel_reset(mPanelHandle));
-    ESP_ERROR_CHECK(esp_lcd_panel_init(mPanelHandle));
+    // Both renderers are counted the same way: whatever bringing them up took from the
+    // heap, such as LVGL's task and draw buffers or the panel driver, plus the buffers
+    // they reserve statically.
+    //
+    size_t freeBefore = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+
+#if CONFIG_DISHWASHER_DISPLAY_DIRECT
+    esp_err_t err = InitDirect();
+    size_t staticRam = DirectRendererMgr().GetRamUsed();
+#else
+    esp_err_t err = InitLvgl();
+    size_t staticRam = LV_MEM_SIZE; // LVGL's pool, all of it reserved whatever is in use
+#endif
+
+    if (err != ESP_OK)
+    {
+        return err;
+    }
+
+    size_t heapUsed = freeBefore - heap_caps_get_free_size(MALLOC_CAP_8BIT);
+
+    portENTER_CRITICAL(&mStatisticsLock);
+    mStatistics.rendererRam = heapUsed + staticRam;
+    portEXIT_CRITICAL(&mStatisticsLock);
+
+    ESP_LOGI(TAG, "Renderer uses %zu bytes of RAM, %zu from the heap", heapUsed + staticRam, heapUsed);
+
+    // What the screens were created with, so the first update is a diff like any other.
+    //
+    mView = {};
+    mView.screen = StatusView::kMainScreen;
+    mView.menuButton = true;
+    mView.optedIn = false;
+    strlcpy(mView.state, "STOPPED", sizeof(mView.state));
+    strlcpy(mView.mode, "Eco 50°", sizeof(mView.mode));
+
+    mPendingView = mView;
+
+#if CONFIG_DISHWASHER_DISPLAY_CAPTURE
+    ScreenCaptureMgr().Init();
+#endif
 
+    xTaskCreate(RenderTask, "StatusDisplay", 3072, NULL, tskIDLE_PRIORITY + 1, &mRenderTask);
+
+    ESP_LOGI(TAG, "StatusDisplay::Init() finished");
+
+    return ESP_OK;
+}
+
+#if CONFIG_DISHWASHER_DISPLAY_DIRECT
+
+esp_err_t StatusDisplay::InitDirect()
+{
+    DisplayBackend &backend = GetDisplayBackend();
+
+    ESP_LOGI(TAG, "Initialize %s display, drawn directly", backend.GetName());
+
+    esp_err_t err = backend.InitDirect();
+
+    if (err == ESP_OK)
+    {
+        err = DirectRendererMgr().Init();
+    }
+
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to initialize %s display: %s", backend.GetName(), esp_err_to_name(err));
+        return err;
+    }
+
+    mPowerState = kPowerOff;
+
+    return ESP_OK;
+}
+
+#else
+
+esp_err_t StatusDisplay::InitLvgl()
+{
     ESP_LOGI(TAG, "Initialize LVGL");
-    const lvgl_port_cfg_t lvgl_cfg = ESP_LVGL_PORT_INIT_CONFIG();
+    lvgl_port_cfg_t lvgl_cfg = ESP_LVGL_PORT_INIT_CONFIG();
+    lvgl_cfg.task_max_sleep_ms = LVGL_MAX_SLEEP_MS;
     lvgl_port_init(&lvgl_cfg);
 
-    ESP_LOGI(TAG, "LVGL1");
+    // The LVGL task is already running, so everything from here on needs the lock.
+    //
+    lvgl_port_lock(0);
 
-    const lvgl_port_display_cfg_t disp_cfg = {
-        .io_handle = io_handle,
-        .panel_handle = mPanelHandle,
-        .buffer_size = EXAMPLE_LCD_H_RES * EXAMPLE_LCD_V_RES,
-        .double_buffer = true,
-        .hres = EXAMPLE_LCD_H_RES,
-        .vres = EXAMPLE_LCD_V_RES,
-        .monochrome = true,
-        .rotation = {
-            .swap_xy = false,
-            .mirror_x = false,
-            .mirror_y = false,
-        }};
+    DisplayBackend &backend = GetDisplayBackend();
 
-    mDisplayHandle = lvgl_port_add_disp(&disp_cfg);
+    ESP_LOGI(TAG, "Initialize %s display", backend.GetName());
 
-    lv_disp_set_rotation(mDisplayHandle, LV_DISP_ROT_180);
+    mDisplayHandle = backend.Init();
 
-    ESP_LOGI(TAG, "LVGL2");
+    if (mDisplayHandle == nullptr)
+    {
+        ESP_LOGE(TAG, "Failed to initialize %s display", backend.GetName());
+        lvgl_port_unlock();
+        return ESP_FAIL;
+    }
+
+    // Called by LVGL after every refresh with the number of pixels it redrew.
+    //
+    mDisplayHandle->driver->monitor_cb = MonitorCallback;
+
+    // Each view is a screen of its own, built once here. Changing view is then a single
+    // lv_scr_load, rather than showing and hiding labels on a shared screen.
+    //
+    lv_coord_t width = mDisplayHandle->driver->hor_res;
+
+    mScreens[StatusView::kMainScreen] = lv_scr_act();
+    mScreens[StatusView::kMenuScreen] = lv_obj_create(NULL);
+    mScreens[StatusView::kDelayedStartScreen] = lv_obj_create(NULL);
+    mScreens[StatusView::kCommissioningScreen] = lv_obj_create(NULL);
+    mScreens[StatusView::kResetScreen] = lv_obj_create(NULL);
+
+    for (lv_obj_t *screen : mScreens)
+    {
+        lv_obj_set_style_text_font(screen, STATUS_FONT, LV_PART_MAIN);
+    }
 
-    lv_obj_t *scr = lv_scr_act();
+    // The main screen, with the program's state, mode and progress.
+    //
+    lv_obj_t *scr = mScreens[StatusView::kMainScreen];
 
     mModeLabel = lv_label_create(scr);
-    lv_label_set_text(mModeLabel, "Eco 50°"); // TODO Get this default from the DishwasherManager
-    lv_obj_set_width(mModeLabel, mDisplayHandle->driver->hor_res);
+    lv_label_set_text_static(mModeLabel, "Eco 50°"); // TODO Get this default from the DishwasherManager
+    lv_obj_set_width(mModeLabel, width);
     lv_obj_align(mModeLabel, LV_ALIGN_LEFT_MID, 0, 0);
 
     mStateLabel = lv_label_create(scr);
 
-    lv_label_set_text(mStateLabel, "STOPPED"); // TODO Get this default from the DishwasherManager
-    lv_obj_set_width(mStateLabel, mDisplayHandle->driver->hor_res);
+    lv_label_set_text_static(mStateLabel, "STOPPED"); // TODO Get this default from the DishwasherManager
+    lv_obj_set_width(mStateLabel, width);
     lv_obj_align(mStateLabel, LV_ALIGN_TOP_MID, 0, 0);
     lv_obj_set_style_bg_color(mStateLabel, lv_color_hex(0x000000), LV_PART_MAIN);
     lv_obj_set_style_bg_opa(mStateLabel, LV_OPA_COVER, LV_PART_MAIN);
@@ -122,223 +227,538 @@ esp_err_t StatusDisplay::Init()
 
     mStatusLabel = lv_label_create(scr);
 
-    lv_label_set_text(mStatusLabel, "");
-    lv_obj_set_width(mStatusLabel, mDisplayHandle->driver->hor_res);
+    lv_label_set_text_static(mStatusLabel, "");
+    lv_obj_set_width(mStatusLabel, width);
     lv_obj_align(mStatusLabel, LV_ALIGN_BOTTOM_LEFT, 0, 0);
 
-    mResetMessageLabel = lv_label_create(scr);
+    mMenuButtonLabel = CreateFixedText(scr, STATUS_TEXT_IMAGE(menu), "MENU", LV_ALIGN_BOTTOM_MID);
 
-    lv_label_set_text(mResetMessageLabel, "Reset the device?");
-    lv_obj_set_width(mResetMessageLabel, mDisplayHandle->driver->hor_res);
-    lv_obj_add_flag(mResetMessageLabel, LV_OBJ_FLAG_HIDDEN);
-    lv_obj_align(mResetMessageLabel, LV_ALIGN_TOP_MID, 0, 0);
+    // The energy management menu.
+    //
+    scr = mScreens[StatusView::kMenuScreen];
 
-    mYesButtonLabel = lv_label_create(scr);
+    CreateFixedText(scr, STATUS_TEXT_IMAGE(energy_mgr), "Energy Mgr", LV_ALIGN_TOP_LEFT);
 
-    lv_label_set_text(mYesButtonLabel, "Yes");
-    lv_obj_set_width(mYesButtonLabel, mDisplayHandle->driver->hor_res);
-    lv_obj_add_flag(mYesButtonLabel, LV_OBJ_FLAG_HIDDEN);
-    lv_obj_set_style_text_align(mYesButtonLabel, LV_TEXT_ALIGN_RIGHT, 0);
-    lv_obj_align(mYesButtonLabel, LV_ALIGN_BOTTOM_MID, 0, 0);
+    mEnergyManagementOptOutLabel = lv_label_create(scr);
+
+    lv_label_set_text_static(mEnergyManagementOptOutLabel, "Opt Out");
+    lv_obj_align(mEnergyManagementOptOutLabel, LV_ALIGN_LEFT_MID, 0, 0);
+    lv_obj_set_style_text_align(mEnergyManagementOptOutLabel, LV_TEXT_ALIGN_LEFT, 0);
+    lv_obj_set_style_bg_color(mEnergyManagementOptOutLabel, lv_color_hex(0x000000), LV_PART_MAIN);
+    lv_obj_set_style_bg_opa(mEnergyManagementOptOutLabel, LV_OPA_COVER, LV_PART_MAIN);
+    lv_obj_set_style_text_color(mEnergyManagementOptOutLabel, lv_color_hex(0xffffff), LV_PART_MAIN);
+
+    mEnergyManagementOptInLabel = lv_label_create(scr);
+
+    lv_label_set_text_static(mEnergyManagementOptInLabel, "Opt In");
+    lv_obj_align(mEnergyManagementOptInLabel, LV_ALIGN_RIGHT_MID, 0, 0);
+    lv_obj_set_style_text_align(mEnergyManagementOptInLabel, LV_TEXT_ALIGN_RIGHT, 0);
 
-    mNoButtonLabel = lv_label_create(scr);
+    CreateFixedText(scr, STATUS_TEXT_IMAGE(exit), "EXIT", LV_ALIGN_BOTTOM_MID);
 
-    lv_label_set_text(mNoButtonLabel, "No");
-    lv_obj_set_width(mNoButtonLabel, mDisplayHandle->driver->hor_res);
-    lv_obj_add_flag(mNoButtonLabel, LV_OBJ_FLAG_HIDDEN);
-    lv_obj_set_style_text_align(mNoButtonLabel, LV_TEXT_ALIGN_LEFT, 0);
-    lv_obj_align(mNoButtonLabel, LV_ALIGN_BOTTOM_MID, 0, 0);
+    // A delayed start counting down.
+    //
+    scr = mScreens[StatusView::kDelayedStartScreen];
 
     mStartsInLabel = lv_label_create(scr);
 
-    lv_label_set_text(mStartsInLabel, "");
-    lv_obj_set_width(mStartsInLabel, mDisplayHandle->driver->hor_res);
-    lv_obj_add_flag(mStartsInLabel, LV_OBJ_FLAG_HIDDEN);
+    lv_label_set_text_static(mStartsInLabel, "");
+    lv_obj_set_width(mStartsInLabel, width);
     lv_obj_set_style_text_align(mStartsInLabel, LV_TEXT_ALIGN_CENTER, 0);
     lv_obj_align(mStartsInLabel, LV_ALIGN_CENTER, 0, 0);
 
-    mMenuButtonLabel = lv_label_create(scr);
+    CreateFixedText(scr, STATUS_TEXT_IMAGE(cancel), "CANCEL", LV_ALIGN_BOTTOM_MID);
 
-    lv_label_set_text(mMenuButtonLabel, "MENU");
-    lv_obj_set_width(mMenuButtonLabel, mDisplayHandle->driver->hor_res);
-    lv_obj_set_style_text_align(mMenuButtonLabel, LV_TEXT_ALIGN_CENTER, 0);
-    lv_obj_align(mMenuButtonLabel, LV_ALIGN_BOTTOM_MID, 0, 0);
+    // The commissioning QR code. Its bitmap is only set once the CommissioningCode has
+    // been loaded, which is after Matter has started.
+    //
+    scr = mScreens[StatusView::kCommissioningScreen];
 
-    mMenuHeaderLabel = lv_label_create(scr);
+    mCommissioningImageDsc = {};
+    mCommissioningImageDsc.header.cf = LV_IMG_CF_ALPHA_1BIT;
+    mCommissioningImageDsc.header.w = CommissioningCode::kSize;
+    mCommissioningImageDsc.header.h = CommissioningCode::kSize;
+    mCommissioningImageDsc.data_size = CommissioningCode::kSize * CommissioningCode::kStride;
 
-    lv_label_set_text(mMenuHeaderLabel, "Energy Mgr");
-    lv_obj_set_width(mMenuHeaderLabel, mDisplayHandle->driver->hor_res);
-    lv_obj_add_flag(mMenuHeaderLabel, LV_OBJ_FLAG_HIDDEN);
-    lv_obj_set_style_text_align(mMenuHeaderLabel, LV_TEXT_ALIGN_LEFT, 0);
-    lv_obj_align(mMenuHeaderLabel, LV_ALIGN_TOP_LEFT, 0, 0);
+    // Set bits are light modules. They are drawn in the colour the panel shows as light,
+    // over a background in the other, so the code is dark on light on any panel.
+    //
+    lv_color_t light = backend.GetLightColor();
+    lv_color_t dark = light.full == lv_color_black().full ? lv_color_white() : lv_color_black();
 
-    mEnergyManagementOptOutLabel = lv_label_create(scr);
+    mCommissioningImage = lv_img_create(scr);
+    lv_obj_align(mCommissioningImage, LV_ALIGN_CENTER, 0, 0);
+    lv_obj_set_style_img_recolor(mCommissioningImage, light, LV_PART_MAIN);
+    lv_obj_set_style_img_recolor_opa(mCommissioningImage, LV_OPA_COVER, LV_PART_MAIN); // Or LVGL ignores the colour
+    lv_obj_set_style_bg_color(mCommissioningImage, dark, LV_PART_MAIN);
+    lv_obj_set_style_bg_opa(mCommissioningImage, LV_OPA_COVER, LV_PART_MAIN);
 
-    lv_label_set_text(mEnergyManagementOptOutLabel, "Opt Out");
-    lv_obj_add_flag(mEnergyManagementOptOutLabel, LV_OBJ_FLAG_HIDDEN);
-    lv_obj_align(mEnergyManagementOptOutLabel, LV_ALIGN_LEFT_MID, 0, 0);
-    lv_obj_set_style_text_align(mEnergyManagementOptOutLabel, LV_TEXT_ALIGN_LEFT, 0);
-    lv_obj_set_style_bg_color(mEnergyManagementOptOutLabel, lv_color_hex(0x000000), LV_PART_MAIN);
-    lv_obj_set_style_bg_opa(mEnergyManagementOptOutLabel, LV_OPA_COVER, LV_PART_MAIN);
-    lv_obj_set_style_text_color(mEnergyManagementOptOutLabel, lv_color_hex(0xffffff), LV_PART_MAIN);
+    // The factory reset prompt. Nothing on it ever changes.
+    //
+    scr = mScreens[StatusView::kResetScreen];
 
-    mEnergyManagementOptInLabel = lv_label_create(scr);
+    CreateFixedText(scr, STATUS_TEXT_IMAGE(reset_prompt), "Reset the device?", LV_ALIGN_TOP_LEFT);
+    CreateFixedText(scr, STATUS_TEXT_IMAGE(yes), "Yes", LV_ALIGN_BOTTOM_RIGHT);
+    CreateFixedText(scr, STATUS_TEXT_IMAGE(no), "No", LV_ALIGN_BOTTOM_LEFT);
 
-    lv_label_set_text(mEnergyManagementOptInLabel, "Opt In");
-    lv_obj_add_flag(mEnergyManagementOptInLabel, LV_OBJ_FLAG_HIDDEN);
-    lv_obj_align(mEnergyManagementOptInLabel, LV_ALIGN_RIGHT_MID, 0, 0);
-    lv_obj_set_style_text_align(mEnergyManagementOptInLabel, LV_TEXT_ALIGN_RIGHT, 0);
+    SuspendLvgl();
 
-    ESP_LOGI(TAG, "StatusDisplay::Init() finished");
+    lvgl_port_unlock();
 
     return ESP_OK;
 }
 
+#endif // CONFIG_DISHWASHER_DISPLAY_DIRECT
+
+void StatusDisplay::RenderTask(void *arg)
+{
+    StatusDisplay &display = StatusDisplayMgr();
+
+    const TickType_t frameInterval = pdMS_TO_TICKS(1000 / CONFIG_DISHWASHER_DISPLAY_MAX_FPS);
+    TickType_t lastFrame = xTaskGetTickCount() - frameInterval;
+
+    while (1)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        // Hold off until a frame is allowed. Anything requested in the meantime is
+        // picked up by this frame rather than causing another.
+        //
+        TickType_t sinceLastFrame = xTaskGetTickCount() - lastFrame;
+
+        if (sinceLastFrame < frameInterval)
+        {
+            vTaskDelay(frameInterval - sinceLastFrame);
+            ulTaskNotifyTake(pdTRUE, 0);
+        }
+
+        lastFrame = xTaskGetTickCount();
+
+        display.RenderPending();
+    }
+}
+
+void StatusDisplay::RequestFrame()
+{
+    portENTER_CRITICAL(&mStatisticsLock);
+    mStatistics.requests++;
+    portEXIT_CRITICAL(&mStatisticsLock);
+
+    if (mRenderTask != nullptr)
+    {
+        xTaskNotifyGive(mRenderTask);
+    }
+}
+
+void StatusDisplay::RenderPending()
+{
+    portENTER_CRITICAL(&mPendingLock);
+    StatusView view = mPendingView;
+    bool reset = mPendingReset;
+    bool commissioning = mPendingCommissioning;
+    bool on = mPendingOn;
+    bool capture = mPendingCapture;
+    mPendingCapture = false;
+    portEXIT_CRITICAL(&mPendingLock);
+
+    // The reset prompt and QR code cover whichever screen is showing, which is back when
+    // they go.
+    //
+    if (reset)
+    {
+        view.screen = StatusView::kResetScreen;
+    }
+    else if (commissioning)
+    {
+        view.screen = StatusView::kCommissioningScreen;
+    }
+
+    // Nothing is drawn whilst the screen is dark. The pending view is kept, and drawn
+    // when it is turned back on.
+    //
+    if (!on && !mPanelOn)
+    {
+        portENTER_CRITICAL(&mStatisticsLock);
+        mStatistics.whileOff++;
+        portEXIT_CRITICAL(&mStatisticsLock);
+
+#if CONFIG_DISHWASHER_DISPLAY_CAPTURE
+        if (capture)
+        {
+            ScreenCaptureMgr().Grab(GetDisplayBackend(), false);
+        }
+#endif
+
+        return;
+    }
+
+#if CONFIG_DISHWASHER_DISPLAY_DIRECT
+    mPowerState = kPowerRendering;
+#else
+    if (!lvgl_port_lock(0))
+    {
+        return;
+    }
+
+    ResumeLvgl();
+#endif
+
+    if (on != mPanelOn)
+    {
+        ESP_LOGI(TAG, "Turning display %s", on ? "on" : "off");
+        GetDisplayBackend().SetPower(on);
+        mPanelOn = on;
+    }
+
+#if CONFIG_DISHWASHER_DISPLAY_DIRECT
+    if (GetDisplayBackend().TakeResync())
+    {
+        mRedraw = true;
+    }
+
+    RenderDirect(view);
+
+#if CONFIG_DISHWASHER_DISPLAY_CAPTURE
+    if (capture)
+    {
+        ScreenCaptureMgr().Grab(GetDisplayBackend(), mPanelOn);
+    }
+#endif
+
+    mPowerState = mPanelOn ? kPowerIdle : kPowerOff;
+#else
+    if (GetDisplayBackend().TakeResync())
+    {
+        lv_obj_invalidate(lv_scr_act());
+    }
+
+    uint32_t start = esp_cpu_get_cycle_count();
+
+    Render(view);
+
+    // Draw and flush now, rather than waiting for LVGL's task to notice.
+    //
+    lv_refr_now(mDisplayHandle);
+
+    uint32_t cycles = esp_cpu_get_cycle_count() - start;
+
+#if CONFIG_DISHWASHER_DISPLAY_CAPTURE
+    if (capture)
+    {
+        ScreenCaptureMgr().Grab(GetDisplayBackend(), mPanelOn);
+    }
+#endif
+
+    SuspendLvgl();
+
+    lvgl_port_unlock();
+
+    portENTER_CRITICAL(&mStatisticsLock);
+    mStatistics.renderCycles += cycles;
+    portEXIT_CRITICAL(&mStatisticsLock);
+#endif
+}
+
+#if CONFIG_DISHWASHER_DISPLAY_DIRECT
+
+void StatusDisplay::RenderDirect(const StatusView &view)
+{
+    NoHeapScope noHeap;
+
+    // Every frame is drawn in full, so there is nothing to diff field by field. It is
+    // enough to know whether anything changed at all.
+    //
+    bool changed = mRedraw || view.screen != mView.screen || view.menuButton != mView.menuButton || view.optedIn != mView.optedIn ||
+                   strcmp(view.state, mView.state) != 0 || strcmp(view.mode, mView.mode) != 0 || strcmp(view.status, mView.status) != 0 ||
+                   strcmp(view.startsIn, mView.startsIn) != 0;
+
+    uint32_t cycles = 0;
+
+    if (changed)
+    {
+        uint32_t start = esp_cpu_get_cycle_count();
+        DirectRendererMgr().Render(view);
+        cycles = esp_cpu_get_cycle_count() - start;
+    }
+
+    portENTER_CRITICAL(&mStatisticsLock);
+    mStatistics.updates++;
+    mStatistics.unchanged += !changed;
+    mStatistics.screenChanges += view.screen != mView.screen;
+    mStatistics.renderCycles += cycles;
+    portEXIT_CRITICAL(&mStatisticsLock);
+
+    mView = view;
+    mRedraw = false;
+}
+
+#else
+
+void StatusDisplay::ResumeLvgl()
+{
+    lvgl_port_resume();
+
+    mPowerState = kPowerRendering;
+
+    portENTER_CRITICAL(&mStatisticsLock);
+    mStatistics.lvglResumes++;
+    portEXIT_CRITICAL(&mStatisticsLock);
+}
+
+void StatusDisplay::SuspendLvgl()
+{
+    // Stops the tick timer. LVGL's own refresh timer pauses itself once nothing is left
+    // to redraw, so with no animations its task has nothing to do until the next frame.
+    //
+    lvgl_port_stop();
+
+    mPowerState = mPanelOn ? kPowerIdle : kPowerOff;
+}
+
+#endif // CONFIG_DISHWASHER_DISPLAY_DIRECT
+
 void StatusDisplay::TurnOn()
 {
-    ESP_LOGI(TAG, "Turning display on");
-    esp_lcd_panel_disp_on_off(mPanelHandle, true);
+    portENTER_CRITICAL(&mPendingLock);
+    mPendingOn = true;
+    portEXIT_CRITICAL(&mPendingLock);
+
+    RequestFrame();
 }
 
 void StatusDisplay::TurnOff()
 {
-    ESP_LOGI(TAG, "Turning display off");
-    esp_lcd_panel_disp_on_off(mPanelHandle, false);
+    portENTER_CRITICAL(&mPendingLock);
+    mPendingOn = false;
+    portEXIT_CRITICAL(&mPendingLock);
+
+    RequestFrame();
 }
 
 void StatusDisplay::UpdateDisplay(bool showingMenu, bool hasOptedIn, bool isProgramSelected, int32_t startsIn, const char *state_text, const char *mode_text, const char *status_text)
 {
-    ESP_LOGI(TAG, "Updating the display");
+    ESP_LOGD(TAG, "UpdateDisplay(menu=%d, optedIn=%d, selected=%d, startsIn=%ld, [%s] [%s] [%s])", showingMenu, hasOptedIn, isProgramSelected, startsIn, state_text, mode_text, status_text);
+
+    // Start from the last view, so the text of anything hidden is left alone. Only the
+    // caller writes mPendingView, so it can be read without the lock.
+    //
+    StatusView view = mPendingView;
 
-    ESP_LOGI(TAG, "showingMenu: [%d]", showingMenu);
-    ESP_LOGI(TAG, "hasOptedIn: [%d]", hasOptedIn);
-    ESP_LOGI(TAG, "isProgramSelected: [%d]", isProgramSelected);
-    ESP_LOGI(TAG, "startsIn: [%lu]", startsIn);
-    ESP_LOGI(TAG, "state_text: [%s]", state_text);
-    ESP_LOGI(TAG, "mode_text: [%s]", mode_text);
-    ESP_LOGI(TAG, "status_text: [%s]", status_text);
+    view.optedIn = hasOptedIn;
 
     if (showingMenu)
     {
-        ESP_LOGI(TAG, "Showing the menu: hasOptedIn=%d", hasOptedIn);
+        view.screen = StatusView::kMenuScreen;
+    }
+    else if (isProgramSelected && startsIn > 0)
+    {
+        // A delayed start.
+        //
+        view.screen = StatusView::kDelayedStartScreen;
+        snprintf(view.startsIn, sizeof(view.startsIn), "Starting in %lus", startsIn);
+    }
+    else
+    {
+        // The standard screen (menu closed). The menu button is only offered when there's no program.
+        //
+        view.screen = StatusView::kMainScreen;
+        view.menuButton = !isProgramSelected;
 
-        lv_label_set_text(mMenuButtonLabel, "EXIT");
-        lv_obj_clear_flag(mMenuHeaderLabel, LV_OBJ_FLAG_HIDDEN);
+        strlcpy(view.state, state_text, sizeof(view.state));
+        strlcpy(view.mode, mode_text, sizeof(view.mode));
+        strlcpy(view.status, status_text, sizeof(view.status));
+    }
 
-        if (hasOptedIn)
-        {
-            // Remove background from Opt Out
-            lv_obj_set_style_bg_color(mEnergyManagementOptOutLabel, lv_color_hex(0xffffff), LV_PART_MAIN);
-            lv_obj_set_style_bg_opa(mEnergyManagementOptOutLabel, LV_OPA_COVER, LV_PART_MAIN);
-            lv_obj_set_style_text_color(mEnergyManagementOptOutLabel, lv_color_hex(0x000000), LV_PART_MAIN);
-
-            lv_obj_set_style_bg_color(mEnergyManagementOptInLabel, lv_color_hex(0x000000), LV_PART_MAIN);
-            lv_obj_set_style_bg_opa(mEnergyManagementOptInLabel, LV_OPA_COVER, LV_PART_MAIN);
-            lv_obj_set_style_text_color(mEnergyManagementOptInLabel, lv_color_hex(0xffffff), LV_PART_MAIN);
-        }
-        else
-        {
-            // Remove background from Opt In
-            lv_obj_set_style_bg_color(mEnergyManagementOptInLabel, lv_color_hex(0xffffff), LV_PART_MAIN);
-            lv_obj_set_style_bg_opa(mEnergyManagementOptInLabel, LV_OPA_COVER, LV_PART_MAIN);
-            lv_obj_set_style_text_color(mEnergyManagementOptInLabel, lv_color_hex(0x000000), LV_PART_MAIN);
-
-            lv_obj_set_style_bg_color(mEnergyManagementOptOutLabel, lv_color_hex(0x000000), LV_PART_MAIN);
-            lv_obj_set_style_bg_opa(mEnergyManagementOptOutLabel, LV_OPA_COVER, LV_PART_MAIN);
-            lv_obj_set_style_text_color(mEnergyManagementOptOutLabel, lv_color_hex(0xffffff), LV_PART_MAIN);
-        }
+    portENTER_CRITICAL(&mPendingLock);
+    mPendingView = view;
+    portEXIT_CRITICAL(&mPendingLock);
 
-        lv_obj_clear_flag(mEnergyManagementOptOutLabel, LV_OBJ_FLAG_HIDDEN);
-        lv_obj_clear_flag(mEnergyManagementOptInLabel, LV_OBJ_FLAG_HIDDEN);
+    RequestFrame();
+}
 
-        lv_obj_add_flag(mStateLabel, LV_OBJ_FLAG_HIDDEN);
-        lv_obj_add_flag(mModeLabel, LV_OBJ_FLAG_HIDDEN);
-        lv_obj_add_flag(mStatusLabel, LV_OBJ_FLAG_HIDDEN);
-        lv_obj_add_flag(mStartsInLabel, LV_OBJ_FLAG_HIDDEN);
-    }
-    else
+void StatusDisplay::ShowResetOptions()
+{
+    ESP_LOGI(TAG, "Show reset options");
+
+    portENTER_CRITICAL(&mPendingLock);
+    mPendingReset = true;
+    portEXIT_CRITICAL(&mPendingLock);
+
+    RequestFrame();
+}
+
+void StatusDisplay::HideResetOptions()
+{
+    ESP_LOGI(TAG, "Hide reset options");
+
+    portENTER_CRITICAL(&mPendingLock);
+    mPendingReset = false;
+    portEXIT_CRITICAL(&mPendingLock);
+
+    RequestFrame();
+}
+
+void StatusDisplay::ShowCommissioningCode()
+{
+    ESP_LOGI(TAG, "Show commissioning code");
+
+    portENTER_CRITICAL(&mPendingLock);
+    mPendingCommissioning = true;
+    portEXIT_CRITICAL(&mPendingLock);
+
+    RequestFrame();
+}
+
+void StatusDisplay::HideCommissioningCode()
+{
+    ESP_LOGI(TAG, "Hide commissioning code");
+
+    portENTER_CRITICAL(&mPendingLock);
+    mPendingCommissioning = false;
+    portEXIT_CRITICAL(&mPendingLock);
+
+    RequestFrame();
+}
+
+void StatusDisplay::RequestCapture()
+{
+    portENTER_CRITICAL(&mPendingLock);
+    mPendingCapture = true;
+    portEXIT_CRITICAL(&mPendingLock);
+
+    RequestFrame();
+}
+
+#if !CONFIG_DISHWASHER_DISPLAY_DIRECT
+
+void StatusDisplay::Render(const StatusView &view)
+{
+    NoHeapScope noHeap;
+
+    uint32_t screenChanges = 0;
+    uint32_t flagChanges = 0;
+    uint32_t textChanges = 0;
+    uint32_t styleChanges = 0;
+
+    if (view.screen != mView.screen)
     {
-        // The standard screen (menu closed)
-        //
-        lv_label_set_text(mMenuButtonLabel, "MENU");
-        lv_obj_clear_flag(mMenuButtonLabel, LV_OBJ_FLAG_HIDDEN);
+        lv_scr_load(mScreens[view.screen]);
+        mView.screen = view.screen;
+        screenChanges++;
+    }
 
-        lv_obj_add_flag(mMenuHeaderLabel, LV_OBJ_FLAG_HIDDEN);
-        lv_obj_add_flag(mEnergyManagementOptOutLabel, LV_OBJ_FLAG_HIDDEN);
-        lv_obj_add_flag(mEnergyManagementOptInLabel, LV_OBJ_FLAG_HIDDEN);
+    // Only the screen being shown is brought up to date. The others catch up when they
+    // are next loaded.
+    //
+    switch (view.screen)
+    {
+    case StatusView::kMainScreen:
+        textChanges += SetText(mStateLabel, mView.state, view.state, sizeof(mView.state));
+        textChanges += SetText(mModeLabel, mView.mode, view.mode, sizeof(mView.mode));
+        textChanges += SetText(mStatusLabel, mView.status, view.status, sizeof(mView.status));
 
-        if (isProgramSelected)
+        if (view.menuButton != mView.menuButton)
         {
-            // If there a delayed start?
-            //
-            if (startsIn > 0)
+            if (view.menuButton)
             {
-                lv_label_set_text(mMenuButtonLabel, "CANCEL");
                 lv_obj_clear_flag(mMenuButtonLabel, LV_OBJ_FLAG_HIDDEN);
-    
-                lv_obj_add_flag(mStateLabel, LV_OBJ_FLAG_HIDDEN);
-                lv_obj_add_flag(mModeLabel, LV_OBJ_FLAG_HIDDEN);
-                lv_obj_add_flag(mStatusLabel, LV_OBJ_FLAG_HIDDEN);
-
-                char *starts_in_formatted_buffer = (char *)malloc(128);
-                snprintf(starts_in_formatted_buffer, 128, "Starting in %lus", startsIn);
-
-                lv_label_set_text(mStartsInLabel, starts_in_formatted_buffer);
-                lv_obj_clear_flag(mStartsInLabel, LV_OBJ_FLAG_HIDDEN);
             }
             else
             {
                 lv_obj_add_flag(mMenuButtonLabel, LV_OBJ_FLAG_HIDDEN);
-                lv_obj_add_flag(mStartsInLabel, LV_OBJ_FLAG_HIDDEN);
-
-                lv_obj_clear_flag(mStateLabel, LV_OBJ_FLAG_HIDDEN);
-                lv_obj_clear_flag(mModeLabel, LV_OBJ_FLAG_HIDDEN);
-                lv_obj_clear_flag(mStatusLabel, LV_OBJ_FLAG_HIDDEN);
-
-                lv_label_set_text(mStateLabel, state_text);
-                lv_label_set_text(mModeLabel, mode_text);
-                lv_label_set_text(mStatusLabel, status_text);
             }
+
+            mView.menuButton = view.menuButton;
+            flagChanges++;
         }
-        else
+        break;
+
+    case StatusView::kMenuScreen:
+        if (view.optedIn != mView.optedIn)
         {
-            lv_obj_clear_flag(mStateLabel, LV_OBJ_FLAG_HIDDEN);
-            lv_obj_clear_flag(mModeLabel, LV_OBJ_FLAG_HIDDEN);
-            lv_obj_clear_flag(mStatusLabel, LV_OBJ_FLAG_HIDDEN);
+            SetHighlight(view.optedIn);
+            styleChanges++;
+        }
+        break;
 
-            lv_obj_add_flag(mStartsInLabel, LV_OBJ_FLAG_HIDDEN);
+    case StatusView::kDelayedStartScreen:
+        textChanges += SetText(mStartsInLabel, mView.startsIn, view.startsIn, sizeof(mView.startsIn));
+        break;
 
-            lv_label_set_text(mStateLabel, state_text);
-            lv_label_set_text(mModeLabel, mode_text);
-            lv_label_set_text(mStatusLabel, status_text);
+    case StatusView::kCommissioningScreen:
+        // The bitmap is used where it is, so this allocates nothing.
+        //
+        if (mCommissioningImageDsc.data == nullptr && CommissioningCodeMgr().IsReady())
+        {
+            mCommissioningImageDsc.data = CommissioningCodeMgr().GetBitmap();
+            lv_img_set_src(mCommissioningImage, &mCommissioningImageDsc);
+            flagChanges++;
         }
+        break;
+
+    default:
+        break;
     }
+
+    portENTER_CRITICAL(&mStatisticsLock);
+    mStatistics.updates++;
+    mStatistics.unchanged += (screenChanges + flagChanges + textChanges + styleChanges) == 0;
+    mStatistics.screenChanges += screenChanges;
+    mStatistics.flagChanges += flagChanges;
+    mStatistics.textChanges += textChanges;
+    mStatistics.styleChanges += styleChanges;
+    portEXIT_CRITICAL(&mStatisticsLock);
 }
 
-void StatusDisplay::ShowResetOptions()
+bool StatusDisplay::SetText(lv_obj_t *label, char *current, const char *text, size_t size)
 {
-    ESP_LOGI(TAG, "Show reset options");
+    if (strncmp(current, text, size) == 0)
+    {
+        return false;
+    }
 
-    lv_obj_add_flag(mStateLabel, LV_OBJ_FLAG_HIDDEN);
-    lv_obj_add_flag(mModeLabel, LV_OBJ_FLAG_HIDDEN);
-    lv_obj_add_flag(mStatusLabel, LV_OBJ_FLAG_HIDDEN);
-    lv_obj_add_flag(mMenuButtonLabel, LV_OBJ_FLAG_HIDDEN);
+    strlcpy(current, text, size);
+    // The view is a member of this singleton, so the text can be used where it is.
+    //
+    lv_label_set_text_static(label, current);
 
-    lv_obj_clear_flag(mResetMessageLabel, LV_OBJ_FLAG_HIDDEN);
-    lv_obj_clear_flag(mYesButtonLabel, LV_OBJ_FLAG_HIDDEN);
-    lv_obj_clear_flag(mNoButtonLabel, LV_OBJ_FLAG_HIDDEN);
+    return true;
 }
 
-void StatusDisplay::HideResetOptions()
+void StatusDisplay::SetHighlight(bool optedIn)
 {
-    ESP_LOGI(TAG, "Hide reset options");
+    // The highlighted option is drawn inverted, white on black.
+    //
+    lv_obj_t *highlighted = optedIn ? mEnergyManagementOptInLabel : mEnergyManagementOptOutLabel;
+    lv_obj_t *other = optedIn ? mEnergyManagementOptOutLabel : mEnergyManagementOptInLabel;
 
-    lv_obj_clear_flag(mStateLabel, LV_OBJ_FLAG_HIDDEN);
-    lv_obj_clear_flag(mModeLabel, LV_OBJ_FLAG_HIDDEN);
-    lv_obj_clear_flag(mStatusLabel, LV_OBJ_FLAG_HIDDEN);
-    lv_obj_clear_flag(mMenuButtonLabel, LV_OBJ_FLAG_HIDDEN);
+    lv_obj_set_style_bg_color(other, lv_color_hex(0xffffff), LV_PART_MAIN);
+    lv_obj_set_style_bg_opa(other, LV_OPA_COVER, LV_PART_MAIN);
+    lv_obj_set_style_text_color(other, lv_color_hex(0x000000), LV_PART_MAIN);
 
-    lv_obj_add_flag(mResetMessageLabel, LV_OBJ_FLAG_HIDDEN);
-    lv_obj_add_flag(mYesButtonLabel, LV_OBJ_FLAG_HIDDEN);
-    lv_obj_add_flag(mNoButtonLabel, LV_OBJ_FLAG_HIDDEN);
-}
\ No newline at end of file
+    lv_obj_set_style_bg_color(highlighted, lv_color_hex(0x000000), LV_PART_MAIN);
+    lv_obj_set_style_bg_opa(highlighted, LV_OPA_COVER, LV_PART_MAIN);
+    lv_obj_set_style_text_color(highlighted, lv_color_hex(0xffffff), LV_PART_MAIN);
+
+    mView.optedIn = optedIn;
+}
+
+#endif // !CONFIG_DISHWASHER_DISPLAY_DIRECT
+
+StatusDisplay::Statistics StatusDisplay::GetStatistics()
+{
+    portENTER_CRITICAL(&mStatisticsLock);
+    Statistics statistics = mStatistics;
+    TaskHandle_t lvglTask = mLvglTask;
+    portEXIT_CRITICAL(&mStatisticsLock);
+
+    // Counted by FreeRTOS against esp_timer, so only the time the task actually ran,
+    // however it was woken.
+    //
+    if (lvglTask != nullptr)
+    {
+        statistics.lvglTime = ulTaskGetRunTimeCounter(lvglTask);
+    }
+
+    return statistics;
+}
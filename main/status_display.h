@@ -1,18 +1,69 @@
 #include <stdio.h>
 #include "driver/gpio.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 #include "lvgl.h"
-#include "esp_lcd_panel_io.h"
-#include "esp_lcd_panel_ops.h"
-#include "esp_lcd_panel_vendor.h"
 
 #include <inttypes.h>
 
+#include "program_table.h"
+
 enum State {
   STOPPED,
   RUNNING,
   PAUSED
 }; 
 
+// Everything the screen shows, as plain data. UpdateDisplay builds one of these and only
+// the fields that differ from the last one rendered turn into LVGL calls, so the
+// countdown ticking over redraws the status line and nothing else.
+//
+// Each Screen is a prebuilt LVGL screen. Only the fields belonging to the screen being
+// shown are rendered.
+//
+struct StatusView
+{
+    enum Screen : uint8_t
+    {
+        kMainScreen = 0,      // State, mode and progress
+        kMenuScreen,          // Energy management opt in or out
+        kDelayedStartScreen,  // Counting down to the start
+        kCommissioningScreen, // The QR code to pair with
+        kResetScreen,         // Confirming a factory reset
+        kScreenCount
+    };
+
+    Screen screen;
+    bool menuButton; // Whether the main screen offers the menu
+    bool optedIn;    // Whether Opt In or Opt Out is highlighted in the menu
+
+    char state[12];
+    char mode[kMaxProgramLabelLength];
+    char status[64];
+    char startsIn[24];
+};
+
+// Stands in for lv_timer_handler, which only LVGL's task calls, so its wakeups can be
+// counted. Linked in with --wrap, see main/CMakeLists.txt.
+//
+extern "C" uint32_t __wrap_lv_timer_handler(void);
+
+// The dishwasher's display. The panel itself is driven by the DisplayBackend chosen in
+// Kconfig.
+//
+// All LVGL work happens on the display's own render task, under lvgl_port_lock. The
+// public methods only record what should be shown and wake that task, so they can be
+// called from any task. Bursts of changes, such as a fast spin of the wheel, are folded
+// into a single frame, and frames are never drawn more often than
+// CONFIG_DISHWASHER_DISPLAY_MAX_FPS.
+//
+// Between frames LVGL is suspended: its tick timer is stopped and its task only wakes
+// every few seconds, so a dark or unchanging screen costs next to nothing. A frame resumes
+// LVGL, renders and flushes there and then with lv_refr_now, and suspends it again.
+//
+// With CONFIG_DISHWASHER_DISPLAY_DIRECT, LVGL isn't used at all and the DirectRenderer
+// draws each changed view in full instead.
+//
 class StatusDisplay
 {
 public:
@@ -26,23 +77,115 @@ public:
     void ShowResetOptions();
     void HideResetOptions();
 
+    // Shows the CommissioningCode until the device has been commissioned. The reset prompt
+    // still goes over it.
+    //
+    void ShowCommissioningCode();
+    void HideCommissioningCode();
+
+    // Has the next frame handed to the ScreenCapture once it is drawn, drawing one now if
+    // nothing else is pending.
+    //
+    void RequestCapture();
+
+    // For a backend that has lost track of what the panel shows. Takes a frame even if
+    // nothing has changed, in which the backend's TakeResync redraws the whole screen.
+    //
+    void RequestResync() { RequestFrame(); }
+
+    enum PowerState : uint8_t
+    {
+        kPowerOff,       // The panel is off and LVGL suspended
+        kPowerIdle,      // The panel is on, showing the last frame, and LVGL suspended
+        kPowerRendering, // LVGL is running to draw a frame
+    };
+
+    PowerState GetPowerState() { return mPowerState; }
+
+    // How much work the display has been given, so the effect of only rendering changes
+    // can be measured.
+    //
+    struct Statistics
+    {
+        uint32_t requests;       // Changes asked for by the public methods
+        uint32_t updates;        // Frames rendered, each covering one or more requests
+        uint32_t unchanged;      // Frames that changed nothing at all
+        uint32_t whileOff;       // Requests left undrawn because the screen was off
+        uint32_t screenChanges;  // lv_scr_load calls
+        uint32_t textChanges;    // lv_label_set_text calls
+        uint32_t flagChanges;    // Labels shown or hidden
+        uint32_t styleChanges;   // Highlight swaps in the menu
+        uint32_t refreshes;      // LVGL refreshes that redrew something
+        uint32_t pixelsFlushed;  // Pixels redrawn and sent to the panel (1 bit each)
+        uint32_t lvglResumes;    // Times LVGL was resumed to draw a frame
+        uint32_t lvglWakeups;    // Times LVGL's task woke to run its timers
+        uint32_t lvglIdleWakeups; // Of those, while LVGL was suspended
+        uint64_t lvglTime;       // Microseconds of CPU time used by LVGL's task, from FreeRTOS run-time stats
+        uint64_t renderCycles;   // CPU cycles from starting each frame to handing it to the backend
+        uint32_t rendererRam;    // Bytes LVGL or the DirectRenderer took at Init, heap and static buffers together
+    };
+
+    Statistics GetStatistics();
+
 private:
     friend StatusDisplay & StatusDisplayMgr(void);
     static StatusDisplay sStatusDisplay;
+
+    friend uint32_t ::__wrap_lv_timer_handler(void);
+
+    static void MonitorCallback(lv_disp_drv_t *driver, uint32_t time, uint32_t pixels);
+    static void RenderTask(void *arg);
+
+    esp_err_t InitLvgl();
+    esp_err_t InitDirect();
+    void RequestFrame();
+    void RenderPending();
+    void RenderDirect(const StatusView &view);
+    void ResumeLvgl();
+    void SuspendLvgl();
+    void Render(const StatusView &view);
+    bool SetText(lv_obj_t *label, char *current, const char *text, size_t size);
+    void SetHighlight(bool optedIn);
+
     lv_disp_t *mDisplayHandle;
-    esp_lcd_panel_handle_t mPanelHandle;
+
+    lv_obj_t *mScreens[StatusView::kScreenCount];
 
     lv_obj_t *mStatusLabel;
     lv_obj_t *mStateLabel;
     lv_obj_t *mModeLabel;
-    lv_obj_t *mResetMessageLabel;
-    lv_obj_t *mYesButtonLabel;
-    lv_obj_t *mNoButtonLabel;
     lv_obj_t *mStartsInLabel;
     lv_obj_t *mMenuButtonLabel;
-    lv_obj_t *mMenuHeaderLabel;
     lv_obj_t *mEnergyManagementOptOutLabel;
     lv_obj_t *mEnergyManagementOptInLabel;
+    lv_obj_t *mCommissioningImage;
+    lv_img_dsc_t mCommissioningImageDsc;
+
+    TaskHandle_t mRenderTask = nullptr;
+
+    // Only touched by the render task, under lvgl_port_lock.
+    //
+    StatusView mView; // What is on the screen now
+    bool mPanelOn = false;
+    bool mRedraw = true; // Direct only. Draw the next frame even if nothing has changed.
+
+    volatile PowerState mPowerState = kPowerRendering; // LVGL is running until Init suspends it
+
+    // What should be on the screen, written by the public methods.
+    //
+    portMUX_TYPE mPendingLock = portMUX_INITIALIZER_UNLOCKED;
+    StatusView mPendingView;            // The status or menu screen
+    bool mPendingReset = false;         // Whether the reset prompt is over it
+    bool mPendingCommissioning = false; // Whether the QR code is over it
+    bool mPendingOn = false;
+    bool mPendingCapture = false;
+
+    // LVGL's own task, found the first time it runs its timers.
+    //
+    TaskHandle_t mLvglTask = nullptr;
+
+    portMUX_TYPE mStatisticsLock = portMUX_INITIALIZER_UNLOCKED;
+    Statistics mStatistics = {};
 };
 
 inline StatusDisplay & StatusDisplayMgr(void)
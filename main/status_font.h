@@ -0,0 +1,42 @@
+#pragma once
+
+#include "lvgl.h"
+
+// The status display's font, and its fixed texts.
+//
+// With CONFIG_DISHWASHER_DISPLAY_FONT_SUBSET, tools/font_subset.py generates a 1bpp font
+// at build time holding only the characters the display can show, along with 1bpp images
+// of the texts that never change. Drawing one of those is a blit, with no glyphs to look
+// up or lay out. The names here must match STATIC_TEXTS in the tool.
+//
+// Otherwise LVGL's default font is used, and the fixed texts are ordinary labels.
+//
+#if CONFIG_DISHWASHER_DISPLAY_FONT_SUBSET
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+LV_FONT_DECLARE(status_font);
+
+LV_IMG_DECLARE(status_text_menu);
+LV_IMG_DECLARE(status_text_exit);
+LV_IMG_DECLARE(status_text_cancel);
+LV_IMG_DECLARE(status_text_energy_mgr);
+LV_IMG_DECLARE(status_text_reset_prompt);
+LV_IMG_DECLARE(status_text_yes);
+LV_IMG_DECLARE(status_text_no);
+
+#ifdef __cplusplus
+}
+#endif
+
+#define STATUS_FONT (&status_font)
+#define STATUS_TEXT_IMAGE(name) (&status_text_##name)
+
+#else
+
+#define STATUS_FONT LV_FONT_DEFAULT
+#define STATUS_TEXT_IMAGE(name) ((const lv_img_dsc_t *)nullptr)
+
+#endif
@@ -0,0 +1,202 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// The dishwasher's user interface as a table driven state machine.
+//
+// Every input, be it a button, the encoder or a Matter command, is an event. Looking up
+// kUiTransitions[state][event] gives the next state and the single action to run, so
+// dispatch never has to reason about combinations of flags. Whether the dishwasher is
+// powered, has a program selected or is showing the menu is a property of the state.
+//
+enum UiState : uint8_t
+{
+    kUiOff = 0,
+    kUiIdle,         // Powered, choosing a program
+    kUiMenu,         // Powered, showing the energy management menu
+    kUiProgram,      // A program is selected (delayed, running or paused)
+    kUiResetIdle,    // Asking to confirm a factory reset, over kUiIdle
+    kUiResetProgram, // Asking to confirm a factory reset, over kUiProgram
+    kUiStateCount
+};
+
+enum UiEvent : uint8_t
+{
+    kUiOnOffClicked = 0,
+    kUiStartClicked,
+    kUiWheelClicked,
+    kUiResetRequested,
+    kUiSelectNext,
+    kUiSelectPrevious,
+    kUiPowerOn,        // OnOff attribute written over Matter
+    kUiPowerOff,       // OnOff attribute written over Matter
+    kUiStartRequested, // OperationalState Start command
+    kUiStopRequested,  // OperationalState Stop command, or the program ended
+    kUiRunScheduled,   // A scheduled run is about to start
+    kUiEventCount
+};
+
+enum UiAction : uint8_t
+{
+    kActionNone = 0,
+    kActionSwitchOn,  // Power on from the button, so report it to the OnOff attribute
+    kActionSwitchOff, // Power off from the button, so report it to the OnOff attribute
+    kActionPowerOn,
+    kActionPowerOff,
+    kActionStartProgram,
+    kActionStopProgram,
+    kActionToggleProgram,
+    kActionToggleOptIn,
+    kActionMoveMode, // By as many programs as the wheel moved
+    kActionFactoryReset,
+    kActionStartScheduledRun,
+    kActionSwitchOnScheduledRun, // Power on for a scheduled run, reporting it to the OnOff attribute
+};
+
+// What is on the display. Entry and exit actions belong to the screen, so moving between
+// states that share a screen doesn't redo them.
+//
+enum UiScreen : uint8_t
+{
+    kScreenOff = 0,
+    kScreenStatus,
+    kScreenMenu,
+    kScreenReset,
+};
+
+struct UiStateInfo
+{
+    UiScreen screen;
+    bool poweredOn;
+    bool programSelected;
+};
+
+constexpr UiStateInfo kUiStates[kUiStateCount] = {
+    {kScreenOff, false, false},    // kUiOff
+    {kScreenStatus, true, false},  // kUiIdle
+    {kScreenMenu, true, false},    // kUiMenu
+    {kScreenStatus, true, true},   // kUiProgram
+    {kScreenReset, true, false},   // kUiResetIdle
+    {kScreenReset, true, true},    // kUiResetProgram
+};
+
+struct UiTransition
+{
+    UiState state;
+    UiEvent event;
+    UiState next;
+    UiAction action;
+};
+
+// One row per state and one entry per event, in enum order. The state and event are
+// repeated in every entry so the static_assert below can prove the table is complete.
+//
+constexpr UiTransition kUiTransitions[kUiStateCount][kUiEventCount] = {
+    {
+        {kUiOff, kUiOnOffClicked, kUiIdle, kActionSwitchOn},
+        {kUiOff, kUiStartClicked, kUiOff, kActionNone},
+        {kUiOff, kUiWheelClicked, kUiOff, kActionNone},
+        {kUiOff, kUiResetRequested, kUiOff, kActionNone},
+        {kUiOff, kUiSelectNext, kUiOff, kActionNone},
+        {kUiOff, kUiSelectPrevious, kUiOff, kActionNone},
+        {kUiOff, kUiPowerOn, kUiIdle, kActionPowerOn},
+        {kUiOff, kUiPowerOff, kUiOff, kActionNone},
+        {kUiOff, kUiStartRequested, kUiOff, kActionNone},
+        {kUiOff, kUiStopRequested, kUiOff, kActionNone},
+        {kUiOff, kUiRunScheduled, kUiProgram, kActionSwitchOnScheduledRun},
+    },
+    {
+        {kUiIdle, kUiOnOffClicked, kUiOff, kActionSwitchOff},
+        {kUiIdle, kUiStartClicked, kUiProgram, kActionStartProgram},
+        {kUiIdle, kUiWheelClicked, kUiMenu, kActionNone},
+        {kUiIdle, kUiResetRequested, kUiResetIdle, kActionNone},
+        {kUiIdle, kUiSelectNext, kUiIdle, kActionMoveMode},
+        {kUiIdle, kUiSelectPrevious, kUiIdle, kActionMoveMode},
+        {kUiIdle, kUiPowerOn, kUiIdle, kActionNone},
+        {kUiIdle, kUiPowerOff, kUiOff, kActionPowerOff},
+        {kUiIdle, kUiStartRequested, kUiProgram, kActionStartProgram},
+        {kUiIdle, kUiStopRequested, kUiIdle, kActionNone},
+        {kUiIdle, kUiRunScheduled, kUiProgram, kActionStartScheduledRun},
+    },
+    {
+        {kUiMenu, kUiOnOffClicked, kUiOff, kActionSwitchOff},
+        {kUiMenu, kUiStartClicked, kUiProgram, kActionStartProgram},
+        {kUiMenu, kUiWheelClicked, kUiIdle, kActionNone},
+        {kUiMenu, kUiResetRequested, kUiResetIdle, kActionNone},
+        {kUiMenu, kUiSelectNext, kUiMenu, kActionToggleOptIn},
+        {kUiMenu, kUiSelectPrevious, kUiMenu, kActionToggleOptIn},
+        {kUiMenu, kUiPowerOn, kUiMenu, kActionNone},
+        {kUiMenu, kUiPowerOff, kUiOff, kActionPowerOff},
+        {kUiMenu, kUiStartRequested, kUiProgram, kActionStartProgram},
+        {kUiMenu, kUiStopRequested, kUiMenu, kActionNone},
+        {kUiMenu, kUiRunScheduled, kUiProgram, kActionStartScheduledRun},
+    },
+    {
+        {kUiProgram, kUiOnOffClicked, kUiOff, kActionSwitchOff},
+        {kUiProgram, kUiStartClicked, kUiProgram, kActionToggleProgram},
+        {kUiProgram, kUiWheelClicked, kUiIdle, kActionStopProgram},
+        {kUiProgram, kUiResetRequested, kUiResetProgram, kActionNone},
+        {kUiProgram, kUiSelectNext, kUiProgram, kActionNone},
+        {kUiProgram, kUiSelectPrevious, kUiProgram, kActionNone},
+        {kUiProgram, kUiPowerOn, kUiProgram, kActionNone},
+        {kUiProgram, kUiPowerOff, kUiOff, kActionPowerOff},
+        {kUiProgram, kUiStartRequested, kUiProgram, kActionNone},
+        {kUiProgram, kUiStopRequested, kUiIdle, kActionStopProgram},
+        {kUiProgram, kUiRunScheduled, kUiProgram, kActionNone},
+    },
+    {
+        {kUiResetIdle, kUiOnOffClicked, kUiIdle, kActionNone},
+        {kUiResetIdle, kUiStartClicked, kUiResetIdle, kActionFactoryReset},
+        {kUiResetIdle, kUiWheelClicked, kUiResetIdle, kActionNone},
+        {kUiResetIdle, kUiResetRequested, kUiResetIdle, kActionNone},
+        {kUiResetIdle, kUiSelectNext, kUiResetIdle, kActionNone},
+        {kUiResetIdle, kUiSelectPrevious, kUiResetIdle, kActionNone},
+        {kUiResetIdle, kUiPowerOn, kUiResetIdle, kActionNone},
+        {kUiResetIdle, kUiPowerOff, kUiOff, kActionPowerOff},
+        {kUiResetIdle, kUiStartRequested, kUiResetProgram, kActionStartProgram},
+        {kUiResetIdle, kUiStopRequested, kUiResetIdle, kActionNone},
+        {kUiResetIdle, kUiRunScheduled, kUiResetIdle, kActionNone},
+    },
+    {
+        {kUiResetProgram, kUiOnOffClicked, kUiProgram, kActionNone},
+        {kUiResetProgram, kUiStartClicked, kUiResetProgram, kActionFactoryReset},
+        {kUiResetProgram, kUiWheelClicked, kUiResetProgram, kActionNone},
+        {kUiResetProgram, kUiResetRequested, kUiResetProgram, kActionNone},
+        {kUiResetProgram, kUiSelectNext, kUiResetProgram, kActionNone},
+        {kUiResetProgram, kUiSelectPrevious, kUiResetProgram, kActionNone},
+        {kUiResetProgram, kUiPowerOn, kUiResetProgram, kActionNone},
+        {kUiResetProgram, kUiPowerOff, kUiOff, kActionPowerOff},
+        {kUiResetProgram, kUiStartRequested, kUiResetProgram, kActionNone},
+        {kUiResetProgram, kUiStopRequested, kUiResetIdle, kActionStopProgram},
+        {kUiResetProgram, kUiRunScheduled, kUiResetProgram, kActionNone},
+    },
+};
+
+constexpr bool IsUiTransitionTableComplete()
+{
+    for (size_t state = 0; state < kUiStateCount; state++)
+    {
+        for (size_t event = 0; event < kUiEventCount; event++)
+        {
+            const UiTransition &transition = kUiTransitions[state][event];
+
+            if (transition.state != state || transition.event != event || transition.next >= kUiStateCount)
+            {
+                return false;
+            }
+
+            // A program can only be selected whilst powered, so the table must never
+            // lead to a state that says otherwise.
+            //
+            if (kUiStates[transition.next].programSelected && !kUiStates[transition.next].poweredOn)
+            {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+static_assert(IsUiTransitionTableComplete(), "kUiTransitions must have exactly one entry for every state and event, in order");
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <system/SystemClock.h>
+
+// Seconds since the Unix epoch, or 0 if the wall clock hasn't been synced yet.
+//
+inline uint32_t GetUtcTime()
+{
+    chip::System::Clock::Microseconds64 utcTime;
+
+    if (chip::System::SystemClock().GetClock_RealTime(utcTime) != CHIP_NO_ERROR)
+    {
+        return 0;
+    }
+
+    return std::chrono::duration_cast<chip::System::Clock::Seconds32>(utcTime).count();
+}
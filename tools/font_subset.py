@@ -0,0 +1,213 @@
+#!/usr/bin/env python3
+"""
+Generates the status display's font, cut down to the characters it can actually show, and
+prerendered images of the text on it that never changes.
+
+The characters are collected from the program labels in tools/programs.json and the
+string literals in the given sources (logging is skipped), plus the digits. lv_font_conv
+turns them into a 1bpp LVGL font, status_font.c. The fixed texts in STATIC_TEXTS are then
+laid out with that font's glyphs, exactly as an LVGL label would, into 1bpp alpha images
+in status_text.c. These must match the declarations in main/status_font.h.
+
+    font_subset.py --font Montserrat-Medium.ttf --size 14 --output-dir build \\
+        tools/programs.json main/program_table.h main/status_display.cpp main/dishwasher_manager.cpp
+
+    font_subset.py --symbols-only tools/programs.json main/status_display.cpp
+
+Run by the build when CONFIG_DISHWASHER_DISPLAY_FONT_SUBSET is set. Needs lv_font_conv
+(npm install -g lv_font_conv).
+"""
+
+import argparse
+import json
+import os
+import re
+import subprocess
+import sys
+
+FONT_NAME = "status_font"
+
+# name -> text. Each becomes status_text_<name>.
+#
+STATIC_TEXTS = {
+    "menu": "MENU",
+    "exit": "EXIT",
+    "cancel": "CANCEL",
+    "energy_mgr": "Energy Mgr",
+    "reset_prompt": "Reset the device?",
+    "yes": "Yes",
+    "no": "No",
+}
+
+# Anything printed into a label goes through snprintf, so digits are always needed.
+#
+ALWAYS = " 0123456789"
+
+STRING_LITERAL = re.compile(r'"((?:[^"\\]|\\.)*)"')
+FORMAT_SPECIFIER = re.compile(r"%[-+ #0-9.*]*(?:hh|h|ll|l|z|j|t)?[diouxXcsfp%]")
+SKIPPED_LINES = re.compile(r"ESP_LOG|[^n]printf\(|#include|xTaskCreate|\bTAG\b|\.name\s*=")
+
+
+class FontError(Exception):
+    pass
+
+
+def literals(path):
+    with open(path, encoding="utf-8") as source:
+        for line in source:
+            if SKIPPED_LINES.search(line):
+                continue
+
+            for literal in STRING_LITERAL.findall(line):
+                yield FORMAT_SPECIFIER.sub("", bytes(literal, "utf-8").decode("unicode_escape").encode("latin-1").decode("utf-8"))
+
+
+def collect_symbols(paths):
+    symbols = set(ALWAYS)
+
+    for text in STATIC_TEXTS.values():
+        symbols.update(text)
+
+    for path in paths:
+        if path.endswith(".json"):
+            with open(path, encoding="utf-8") as programs:
+                for program in json.load(programs)["programs"]:
+                    symbols.update(program["label"])
+        else:
+            for literal in literals(path):
+                symbols.update(literal)
+
+    return "".join(sorted(c for c in symbols if c.isprintable()))
+
+
+def parse_font(path):
+    """Reads the glyphs back out of lv_font_conv's output, which lists them in code point order."""
+    with open(path, encoding="utf-8") as source:
+        text = source.read()
+
+    bitmap_body = re.search(r"glyph_bitmap\[\] = \{(.*?)\n\};", text, re.S).group(1)
+    code_points = [int(cp, 16) for cp in re.findall(r"/\* U\+([0-9A-F]+) ", bitmap_body)]
+    bitmap = bytes(int(b, 16) for b in re.findall(r"0x([0-9a-f]{2})", re.sub(r"/\*.*?\*/", "", bitmap_body)))
+
+    fields = ("bitmap_index", "adv_w", "box_w", "box_h", "ofs_x", "ofs_y")
+    dsc_body = re.search(r"glyph_dsc\[\] = \{(.*?)\n\};", text, re.S).group(1)
+    dscs = [dict(zip(fields, map(int, entry))) for entry in re.findall(
+        r"\.bitmap_index = (\d+), \.adv_w = (\d+), \.box_w = (\d+), \.box_h = (\d+), \.ofs_x = (-?\d+), \.ofs_y = (-?\d+)", dsc_body)]
+
+    line_height = int(re.search(r"\.line_height = (\d+)", text).group(1))
+    base_line = int(re.search(r"\.base_line = (-?\d+)", text).group(1))
+
+    # Glyph 0 is reserved.
+    #
+    if len(dscs) != len(code_points) + 1:
+        raise FontError("%s: %d glyphs but %d descriptions" % (path, len(code_points), len(dscs) - 1))
+
+    return dict(zip(code_points, dscs[1:])), bitmap, line_height, base_line
+
+
+def render(text, glyphs, bitmap, line_height, base_line):
+    """Lays text out as lv_label would, without kerning. Returns (width, rows of 0/1)."""
+    # LVGL rounds each advance, given in 1/16 px, to the nearest pixel.
+    #
+    advances = [(glyphs[ord(c)]["adv_w"] + 8) >> 4 for c in text]
+    width = sum(advances)
+    rows = [[0] * width for _ in range(line_height)]
+    x = 0
+
+    for c, advance in zip(text, advances):
+        glyph = glyphs[ord(c)]
+        top = line_height - base_line - glyph["box_h"] - glyph["ofs_y"]
+
+        # 1bpp glyphs are packed without padding at the end of each row.
+        #
+        for i in range(glyph["box_w"] * glyph["box_h"]):
+            bit = glyph["bitmap_index"] * 8 + i
+            gx, gy = i % glyph["box_w"], i // glyph["box_w"]
+            px, py = x + glyph["ofs_x"] + gx, top + gy
+
+            if 0 <= px < width and 0 <= py < line_height and bitmap[bit >> 3] & (0x80 >> (bit & 7)):
+                rows[py][px] = 1
+
+        x += advance
+
+    return width, rows
+
+
+def write_images(path, font_path):
+    glyphs, bitmap, line_height, base_line = parse_font(font_path)
+
+    with open(path, "w", encoding="utf-8") as out:
+        out.write("// Generated by tools/font_subset.py from %s. Do not edit.\n\n" % os.path.basename(font_path))
+        out.write('#include "lvgl.h"\n')
+
+        for name, text in STATIC_TEXTS.items():
+            missing = [c for c in text if ord(c) not in glyphs]
+
+            if missing:
+                raise FontError("%s: no glyph for %r" % (name, "".join(missing)))
+
+            width, rows = render(text, glyphs, bitmap, line_height, base_line)
+            stride = (width + 7) // 8
+            data = bytearray()
+
+            for row in rows:
+                packed = bytearray(stride)
+
+                for px, on in enumerate(row):
+                    if on:
+                        packed[px >> 3] |= 0x80 >> (px & 7)
+
+                data += packed
+
+            out.write("\n// \"%s\"\n//\n" % text)
+            out.write("static const uint8_t status_text_%s_map[] = {\n" % name)
+
+            for offset in range(0, len(data), stride):
+                out.write("    %s\n" % " ".join("0x%02x," % b for b in data[offset:offset + stride]))
+
+            out.write("};\n\n")
+            out.write("const lv_img_dsc_t status_text_%s = {\n" % name)
+            out.write("    .header = {.cf = LV_IMG_CF_ALPHA_1BIT, .always_zero = 0, .reserved = 0, .w = %d, .h = %d},\n" % (width, line_height))
+            out.write("    .data_size = sizeof(status_text_%s_map),\n" % name)
+            out.write("    .data = status_text_%s_map,\n" % name)
+            out.write("};\n")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--font", help="TTF to take the glyphs from")
+    parser.add_argument("--size", type=int, default=14)
+    parser.add_argument("--output-dir")
+    parser.add_argument("--lv-font-conv", default="lv_font_conv")
+    parser.add_argument("--symbols-only", action="store_true", help="print the characters found and stop")
+    parser.add_argument("sources", nargs="+", help="programs.json and C++ sources to take strings from")
+
+    args = parser.parse_args()
+
+    try:
+        symbols = collect_symbols(args.sources)
+
+        if args.symbols_only:
+            print(symbols)
+            return 0
+
+        if not args.font or not args.output_dir:
+            parser.error("--font and --output-dir are needed to generate the font")
+
+        font_path = os.path.join(args.output_dir, FONT_NAME + ".c")
+
+        subprocess.run([args.lv_font_conv, "--font", args.font, "--size", str(args.size), "--bpp", "1", "--format", "lvgl", "--no-compress", "--no-kerning",
+                        "--lv-font-name", FONT_NAME, "--symbols", symbols, "-o", font_path], check=True)
+
+        write_images(os.path.join(args.output_dir, "status_text.c"), font_path)
+
+        print("%s: %d glyphs, %d fixed texts" % (FONT_NAME, len(symbols), len(STATIC_TEXTS)))
+    except (FontError, OSError, subprocess.CalledProcessError) as e:
+        print("font_subset.py: %s" % e, file=sys.stderr)
+        return 1
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,231 @@
+#!/usr/bin/env python3
+"""
+Builds and checks the program blob that the dishwasher maps from its "programs" partition.
+
+The layout must match ProgramBlobHeader (main/program_catalog.h) and ProgramDefinition
+(main/program_table.h). Everything is little-endian with explicit padding.
+
+    program_blob.py build tools/programs.json build/programs.bin
+    program_blob.py check build/programs.bin
+    program_blob.py dump build/programs.bin
+
+Flash it with:
+
+    parttool.py write_partition --partition-name programs --input build/programs.bin
+"""
+
+import argparse
+import json
+import struct
+import sys
+import zlib
+
+MAGIC = 0x47505744  # "DWPG"
+VERSION = 1
+PARTITION_SIZE = 0x4000
+
+MAX_PROGRAMS = 32
+MAX_PHASES = 5
+MAX_TAGS = 4
+MAX_LABEL_LENGTH = 32  # Including the terminator
+
+PHASES = ["pre-soak", "main-wash", "rinse", "final-rinse", "drying"]
+
+TAGS = {
+    "Auto": 0x0000,
+    "Quick": 0x0001,
+    "Quiet": 0x0002,
+    "LowNoise": 0x0003,
+    "LowEnergy": 0x0004,
+    "Vacation": 0x0005,
+    "Min": 0x0006,
+    "Max": 0x0007,
+    "Night": 0x0008,
+    "Day": 0x0009,
+    "Normal": 0x4000,
+    "Heavy": 0x4001,
+    "Light": 0x4002,
+}
+
+HEADER = struct.Struct("<IHHII")
+PHASE = struct.Struct("<BB2xIq")
+DEFINITION = struct.Struct("<BBB5x%ds%dsI%dH%ds" % (PHASE.size * MAX_PHASES, 4 * MAX_PHASES, MAX_TAGS, MAX_LABEL_LENGTH))
+
+assert HEADER.size == 16
+assert PHASE.size == 16
+assert DEFINITION.size == 152
+
+
+class BlobError(Exception):
+    pass
+
+
+def encode_program(index, program):
+    label = program["label"].encode("utf-8")
+    phases = program["phases"]
+    tags = program["tags"]
+
+    if not label or len(label) >= MAX_LABEL_LENGTH:
+        raise BlobError("program %d: label must be 1 to %d bytes" % (index, MAX_LABEL_LENGTH - 1))
+
+    if not 1 <= len(phases) <= MAX_PHASES:
+        raise BlobError("%s: needs 1 to %d phases" % (program["label"], MAX_PHASES))
+
+    if not 1 <= len(tags) <= MAX_TAGS:
+        raise BlobError("%s: needs 1 to %d mode tags" % (program["label"], MAX_TAGS))
+
+    encoded_phases = b""
+    phase_ends = []
+    elapsed = 0
+
+    for phase in phases:
+        if phase["phase"] not in PHASES:
+            raise BlobError("%s: unknown phase '%s'" % (program["label"], phase["phase"]))
+
+        if phase["duration"] <= 0:
+            raise BlobError("%s: %s must have a duration" % (program["label"], phase["phase"]))
+
+        elapsed += phase["duration"]
+        phase_ends.append(elapsed)
+        encoded_phases += PHASE.pack(PHASES.index(phase["phase"]), 1 if phase.get("pausable", True) else 0, phase["duration"], phase["power"])
+
+    for tag in tags:
+        if tag not in TAGS:
+            raise BlobError("%s: unknown mode tag '%s'" % (program["label"], tag))
+
+    return DEFINITION.pack(
+        index,
+        len(phases),
+        len(tags),
+        encoded_phases.ljust(PHASE.size * MAX_PHASES, b"\0"),
+        struct.pack("<%dI" % len(phase_ends), *phase_ends).ljust(4 * MAX_PHASES, b"\0"),
+        elapsed,
+        *([TAGS[tag] for tag in tags] + [0] * (MAX_TAGS - len(tags))),
+        label,
+    )
+
+
+def build(programs):
+    if not 1 <= len(programs) <= MAX_PROGRAMS:
+        raise BlobError("needs 1 to %d programs" % MAX_PROGRAMS)
+
+    body = b"".join(encode_program(index, program) for index, program in enumerate(programs))
+    blob = HEADER.pack(MAGIC, VERSION, len(programs), zlib.crc32(body), 0) + body
+
+    if len(blob) > PARTITION_SIZE:
+        raise BlobError("blob is %d bytes, the partition is only %d" % (len(blob), PARTITION_SIZE))
+
+    return blob
+
+
+def decode(blob):
+    """Checks a blob the same way ProgramCatalog::Init() does and returns its programs."""
+    if len(blob) < HEADER.size:
+        raise BlobError("too short for a header")
+
+    magic, version, count, crc, _ = HEADER.unpack_from(blob)
+
+    if magic != MAGIC:
+        raise BlobError("bad magic 0x%08x" % magic)
+
+    if version != VERSION:
+        raise BlobError("version %d, expected %d" % (version, VERSION))
+
+    if not 1 <= count <= MAX_PROGRAMS or HEADER.size + count * DEFINITION.size > min(len(blob), PARTITION_SIZE):
+        raise BlobError("bad program count %d" % count)
+
+    body = blob[HEADER.size:HEADER.size + count * DEFINITION.size]
+
+    if zlib.crc32(body) != crc:
+        raise BlobError("CRC mismatch")
+
+    programs = []
+
+    for index in range(count):
+        mode, phase_count, tag_count, phases, phase_ends, duration, *rest = DEFINITION.unpack_from(body, index * DEFINITION.size)
+        tags, label = rest[:MAX_TAGS], rest[MAX_TAGS]
+
+        if mode != index or not 1 <= phase_count <= MAX_PHASES or not 1 <= tag_count <= MAX_TAGS:
+            raise BlobError("program %d: bad mode, phase or tag count" % index)
+
+        if b"\0" not in label or label[0] == 0:
+            raise BlobError("program %d: bad label" % index)
+
+        ends = struct.unpack("<%dI" % MAX_PHASES, phase_ends)
+        decoded_phases = []
+        elapsed = 0
+
+        for i in range(phase_count):
+            phase, pausable, phase_duration, power = PHASE.unpack_from(phases, i * PHASE.size)
+
+            if phase >= len(PHASES):
+                raise BlobError("program %d: unknown phase %d" % (index, phase))
+
+            if phase_duration == 0:
+                raise BlobError("program %d: phase %d has no duration" % (index, i))
+
+            elapsed += phase_duration
+
+            if ends[i] != elapsed:
+                raise BlobError("program %d: phase ends don't add up" % index)
+
+            decoded_phases.append({"phase": PHASES[phase], "duration": phase_duration, "power": power, "pausable": bool(pausable)})
+
+        if duration != elapsed:
+            raise BlobError("program %d: duration doesn't match its phases" % index)
+
+        names = {value: name for name, value in TAGS.items()}
+
+        programs.append({
+            "label": label.split(b"\0")[0].decode("utf-8"),
+            "tags": [names.get(tag, "0x%04x" % tag) for tag in tags[:tag_count]],
+            "phases": decoded_phases,
+        })
+
+    return programs
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    commands = parser.add_subparsers(dest="command", required=True)
+
+    build_parser = commands.add_parser("build", help="build a blob from a JSON description")
+    build_parser.add_argument("input")
+    build_parser.add_argument("output")
+
+    check_parser = commands.add_parser("check", help="check a blob")
+    check_parser.add_argument("input")
+
+    dump_parser = commands.add_parser("dump", help="print a blob as JSON")
+    dump_parser.add_argument("input")
+
+    args = parser.parse_args()
+
+    try:
+        if args.command == "build":
+            with open(args.input, encoding="utf-8") as f:
+                blob = build(json.load(f)["programs"])
+
+            decode(blob)
+
+            with open(args.output, "wb") as f:
+                f.write(blob)
+
+            print("Wrote %d programs (%d bytes) to %s" % ((len(blob) - HEADER.size) // DEFINITION.size, len(blob), args.output))
+        else:
+            with open(args.input, "rb") as f:
+                programs = decode(f.read())
+
+            if args.command == "check":
+                print("OK, %d programs" % len(programs))
+            else:
+                print(json.dumps({"programs": programs}, indent=4, ensure_ascii=False))
+    except BlobError as e:
+        print("error: %s" % e, file=sys.stderr)
+        return 1
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
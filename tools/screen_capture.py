@@ -0,0 +1,159 @@
+#!/usr/bin/env python3
+"""
+Turns the frames streamed by `matter esp dishwasher capture` back into images.
+
+Reads a console log, or stdin, picks out the CAPTURE lines (see main/screen_capture.h),
+undoes the PackBits and delta encoding, checks each frame against its CRC32 and writes it
+as a PNG.
+
+    idf.py monitor | tee capture.log
+    > matter esp dishwasher capture 10 500
+    screen_capture.py capture.log --output-dir frames --scale 4
+
+Lines around the captures, such as log output, are ignored. A delta whose previous frame
+was missed can't be decoded, and is skipped until the next whole frame.
+"""
+
+import argparse
+import base64
+import os
+import struct
+import sys
+import zlib
+
+
+class CaptureError(Exception):
+    pass
+
+
+def unpack_bits(data, size):
+    out = bytearray()
+    i = 0
+
+    while i < len(data) and len(out) < size:
+        n = data[i]
+        i += 1
+
+        if n < 128:
+            out += data[i:i + n + 1]
+            i += n + 1
+        elif n > 128:
+            out += bytes([data[i]]) * (257 - n)
+            i += 1
+
+    if len(out) != size:
+        raise CaptureError("decoded %d bytes, expected %d" % (len(out), size))
+
+    return bytes(out)
+
+
+def to_rows(frame, layout, width, height):
+    """Returns rows of 0 (dark) or 1 (light)."""
+    if layout == "P":
+        return [[(frame[(y // 8) * width + x] >> (y % 8)) & 1 for x in range(width)] for y in range(height)]
+
+    stride = width // 8
+    return [[(frame[y * stride + x // 8] >> (7 - x % 8)) & 1 for x in range(width)] for y in range(height)]
+
+
+def write_png(path, rows, scale):
+    width = len(rows[0]) * scale
+    raw = bytearray()
+
+    for row in rows:
+        line = bytearray([0])  # No filter
+
+        for value in row:
+            line += bytes([255 if value else 0]) * scale
+
+        raw += line * scale
+
+    def chunk(kind, data):
+        body = kind + data
+        return struct.pack(">I", len(data)) + body + struct.pack(">I", zlib.crc32(body))
+
+    with open(path, "wb") as out:
+        out.write(b"\x89PNG\r\n\x1a\n")
+        out.write(chunk(b"IHDR", struct.pack(">IIBBBBB", width, len(rows) * scale, 8, 0, 0, 0, 0)))
+        out.write(chunk(b"IDAT", zlib.compress(bytes(raw))))
+        out.write(chunk(b"IEND", b""))
+
+
+def decode(lines):
+    """Yields (sequence, on, layout, width, height, frame, encoded length) for each frame decoded."""
+    previous = None
+
+    for line in lines:
+        start = line.find("CAPTURE ")
+
+        if start < 0:
+            continue
+
+        fields = line[start:].split()
+
+        if len(fields) != 9:
+            continue
+
+        _, sequence, kind, layout, width, height, power, crc, payload = fields
+        width, height = int(width), int(height)
+        size = width * height // 8
+
+        try:
+            encoded = base64.b64decode(payload, validate=True)
+            frame = unpack_bits(encoded, size)
+        except (ValueError, CaptureError) as e:
+            print("screen_capture.py: frame %s: %s" % (sequence, e), file=sys.stderr)
+            previous = None
+            continue
+
+        if kind == "D":
+            if previous is None or len(previous) != size:
+                print("screen_capture.py: frame %s: no previous frame to apply it to" % sequence, file=sys.stderr)
+                continue
+
+            frame = bytes(a ^ b for a, b in zip(frame, previous))
+
+        if zlib.crc32(frame) != int(crc, 16):
+            print("screen_capture.py: frame %s: CRC mismatch" % sequence, file=sys.stderr)
+            previous = None
+            continue
+
+        previous = frame
+
+        yield int(sequence), power == "on", layout, width, height, frame, len(encoded)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("log", nargs="?", help="console log to read, stdin if not given")
+    parser.add_argument("--output-dir", default=".")
+    parser.add_argument("--scale", type=int, default=2, help="pixels per display pixel")
+    parser.add_argument("--prefix", default="capture")
+
+    args = parser.parse_args()
+
+    try:
+        with (open(args.log, encoding="utf-8", errors="replace") if args.log else sys.stdin) as lines:
+            os.makedirs(args.output_dir, exist_ok=True)
+
+            for sequence, on, layout, width, height, frame, encoded in decode(lines):
+                rows = to_rows(frame, layout, width, height)
+
+                # An OLED that is off is dark, whatever it holds. E-ink keeps its image.
+                #
+                if not on and layout == "P":
+                    rows = [[0] * width for _ in range(height)]
+
+                path = os.path.join(args.output_dir, "%s-%05d.png" % (args.prefix, sequence))
+                write_png(path, rows, args.scale)
+
+                print("%s: %dx%d, %s, %d bytes" % (path, width, height, "on" if on else "off", encoded))
+    except OSError as e:
+        print("screen_capture.py: %s" % e, file=sys.stderr)
+        return 1
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())